@@ -28,36 +28,30 @@
 #define API_VERSION "2014031201"
 
 CommandHandler::CommandHandler(TcpHandler& handler,
-			       boost::asio::ip::tcp::endpoint& endpoint) :
+			       const Listener::EndpointList& endpoints) :
     m_handler(handler),
-    m_acceptor(handler, endpoint),
-    m_sendTimer(handler)
+    m_pacer(MinDistanceBetweenRequests)
 {
-    startAccepting();
+    for (size_t i = 0; i < endpoints.size(); i++) {
+	m_listeners.push_back(boost::shared_ptr<Listener>(
+		new Listener(handler, endpoints[i],
+			     boost::bind(&CommandHandler::handleAccept, this, _1))));
+    }
 }
 
 CommandHandler::~CommandHandler()
 {
-    m_acceptor.close();
+    m_listeners.clear();
     std::for_each(m_connections.begin(), m_connections.end(),
 		  boost::bind(&CommandConnection::close, _1));
     m_connections.clear();
-    m_sendTimer.cancel();
+    m_pacedMessages.clear();
 }
 
 void
-CommandHandler::handleAccept(CommandConnection::Ptr connection,
-			     const boost::system::error_code& error)
+CommandHandler::handleAccept(Listener::Socket& socket)
 {
-    if (error) {
-	if (error != boost::asio::error::operation_aborted) {
-	    std::cerr << "Accept error: " << error.message() << std::endl;
-	}
-	return;
-    }
-
-    startConnection(connection);
-    startAccepting();
+    startConnection(CommandConnection::Ptr(new CommandConnection(*this, socket)));
 }
 
 void
@@ -77,7 +71,8 @@ CommandHandler::stopConnection(CommandConnection::Ptr connection)
 void
 CommandHandler::handlePcMessage(const EmsMessage& message)
 {
-    m_lastCommTimes[message.getSource()] = boost::posix_time::microsec_clock::universal_time();
+    m_pacer.handleActivity(message.getSource(),
+			   boost::posix_time::microsec_clock::universal_time());
 
     std::for_each(m_connections.begin(), m_connections.end(),
 		  boost::bind(&CommandConnection::handlePcMessage,
@@ -85,50 +80,38 @@ CommandHandler::handlePcMessage(const EmsMessage& message)
 }
 
 void
-CommandHandler::startAccepting()
+CommandHandler::sendMessage(const EmsMessage& msg, const TcpHandler::SendCallback& callback)
 {
-    CommandConnection::Ptr connection(new CommandConnection(*this));
-    m_acceptor.async_accept(connection->socket(),
-		            boost::bind(&CommandHandler::handleAccept, this,
-					connection, boost::asio::placeholders::error));
-}
-
-void
-CommandHandler::sendMessage(const EmsMessage& msg)
-{
-    std::map<uint8_t, boost::posix_time::ptime>::iterator timeIter = m_lastCommTimes.find(msg.getDestination());
-    bool scheduled = false;
+    long delay = m_pacer.reserve(msg.getDestination(),
+				 boost::posix_time::microsec_clock::universal_time());
 
-    if (timeIter != m_lastCommTimes.end()) {
-	boost::posix_time::ptime now(boost::posix_time::microsec_clock::universal_time());
-	boost::posix_time::time_duration diff = now - timeIter->second;
+    if (delay > 0) {
+	PacedMessageList::iterator paced;
 
-	if (diff.total_milliseconds() <= MinDistanceBetweenRequests) {
-	    m_sendTimer.expires_at(timeIter->second + boost::posix_time::milliseconds(MinDistanceBetweenRequests));
-	    m_sendTimer.async_wait(boost::bind(&CommandHandler::doSendMessage, this, msg));
-	    scheduled = true;
-	}
-    }
-    if (!scheduled) {
-	doSendMessage(msg);
+	m_pacedMessages.emplace_back(m_handler.getTimers(), msg, callback);
+	paced = --m_pacedMessages.end();
+	paced->timer.start(delay, boost::bind(&CommandHandler::sendPacedMessage, this, paced));
+    } else {
+	m_handler.sendMessage(msg, callback);
     }
 }
 
 void
-CommandHandler::doSendMessage(const EmsMessage& msg)
+CommandHandler::sendPacedMessage(PacedMessageList::iterator message)
 {
-    m_handler.sendMessage(msg);
-    m_lastCommTimes[msg.getDestination()] = boost::posix_time::microsec_clock::universal_time();
+    m_handler.sendMessage(message->message, message->callback);
+    m_pacedMessages.erase(message);
 }
 
 
-CommandConnection::CommandConnection(CommandHandler& handler) :
-    m_socket(handler.getHandler()),
+CommandConnection::CommandConnection(CommandHandler& handler, Listener::Socket& socket) :
+    m_socket(std::move(socket)),
     m_handler(handler),
-    m_responseTimeout(handler.getHandler()),
+    m_responseTimeout(handler.getHandler().getTimers()),
     m_responseCounter(0),
     m_parsePosition(0),
-    m_outputRawData(false)
+    m_outputRawData(false),
+    m_historyPending(false)
 {
 }
 
@@ -149,7 +132,7 @@ CommandConnection::handleRequest(const boost::system::error_code& error)
 
     std::istream requestStream(&m_request);
 
-    if (m_activeRequest) {
+    if (m_activeRequest || m_historyPending) {
 	respond("ERRBUSY");
     } else if (m_request.size() > 2) {
 	CommandResult result = handleCommand(requestStream);
@@ -174,10 +157,19 @@ CommandConnection::handleRequest(const boost::system::error_code& error)
 }
 
 void
-CommandConnection::handleWrite(const boost::system::error_code& error)
+CommandConnection::handleWrite(const boost::system::error_code& error, OutputBuffer response)
 {
-    if (error && error != boost::asio::error::operation_aborted) {
-	m_handler.stopConnection(shared_from_this());
+    if (error) {
+	m_output.clear();
+	if (error != boost::asio::error::operation_aborted) {
+	    m_handler.stopConnection(shared_from_this());
+	}
+	return;
+    }
+
+    m_output.pop_front();
+    if (!m_output.empty()) {
+	writeNext();
     }
 }
 
@@ -209,6 +201,8 @@ CommandConnection::handleCommand(std::istream& request)
 		"raw\n"
 #endif
 		"cache\n"
+		"stats\n"
+		"history\n"
 		"getversion\n"
 		"OK");
 	return Ok;
@@ -232,6 +226,10 @@ CommandConnection::handleCommand(std::istream& request)
 #endif
     } else if (category == "cache") {
 	return handleCacheCommand(request);
+    } else if (category == "stats") {
+	return handleStatsCommand(request);
+    } else if (category == "history") {
+	return handleHistoryCommand(request);
     } else if (category == "getversion") {
 	respond("collector version: " API_VERSION);
 	startRequest(EmsProto::addressUBA, 0x02, 0, 3);
@@ -551,6 +549,133 @@ CommandConnection::handleCacheCommand(std::istream& request)
     return InvalidCmd;
 }
 
+CommandConnection::CommandResult
+CommandConnection::handleStatsCommand(std::istream& request)
+{
+    std::string cmd;
+    request >> cmd;
+
+    if (cmd == "help") {
+	respond("Available subcommands:\n"
+		"latency\n"
+		"decoding\n"
+		"sending\n"
+		"reset\n"
+		"OK");
+	return Ok;
+    } else if (cmd == "latency") {
+	std::ostringstream stream;
+
+	LatencyStats::output(stream);
+	respond(stream.str());
+	respond("OK");
+	return Ok;
+    } else if (cmd == "decoding") {
+	std::ostringstream stream;
+
+	m_handler.getHandler().outputDecodeStats(stream);
+	respond(stream.str());
+	respond("OK");
+	return Ok;
+    } else if (cmd == "sending") {
+	std::ostringstream stream;
+
+	m_handler.getHandler().outputSendStats(stream);
+	respond(stream.str());
+	respond("OK");
+	return Ok;
+    } else if (cmd == "reset") {
+	LatencyStats::reset();
+	m_handler.getHandler().resetDecodeStats();
+	m_handler.getHandler().resetSendStats();
+	respond("OK");
+	return Ok;
+    }
+
+    return InvalidCmd;
+}
+
+CommandConnection::CommandResult
+CommandConnection::handleHistoryCommand(std::istream& request)
+{
+    std::vector<std::string> args;
+
+    while (request) {
+	std::string token;
+	request >> token;
+	if (!token.empty()) {
+	    args.push_back(token);
+	}
+    }
+
+    if (args.size() == 1 && args[0] == "help") {
+	respond("Usage: history <sensor> [<sensor>...] <from> <to> <maxpoints>\n"
+		"Outputs '<sensor> <time> <value>' lines with at most <maxpoints>\n"
+		"points per sensor, times being seconds since the epoch\n"
+		"OK");
+	return Ok;
+    }
+    if (args.size() < 4) {
+	return InvalidArgs;
+    }
+
+    std::map<unsigned int, Downsampler> series;
+    std::vector<unsigned int> sensors;
+    time_t from, to;
+    unsigned int maxPoints;
+
+    try {
+	size_t count = args.size() - 3;
+	from = boost::lexical_cast<time_t>(args[count]);
+	to = boost::lexical_cast<time_t>(args[count + 1]);
+	maxPoints = boost::lexical_cast<unsigned int>(args[count + 2]);
+	for (size_t i = 0; i < count; i++) {
+	    sensors.push_back(boost::lexical_cast<unsigned int>(args[i]));
+	}
+    } catch (boost::bad_lexical_cast& e) {
+	return InvalidArgs;
+    }
+
+    if (from >= to || maxPoints < 3 || maxPoints > MaxHistoryPoints) {
+	return InvalidArgs;
+    }
+
+    for (size_t i = 0; i < sensors.size(); i++) {
+	series.insert(std::make_pair(sensors[i], Downsampler(from, to, maxPoints)));
+    }
+
+    /* further commands are refused until the last series is written */
+    m_historyPending = m_handler.getHandler().getDatabase().readNumericHistory(from, to, series,
+	    boost::bind(&CommandConnection::handleHistorySeries, shared_from_this(), _1, _2),
+	    boost::bind(&CommandConnection::handleHistoryDone, shared_from_this(), _1));
+    if (!m_historyPending) {
+	respond("FAIL");
+    }
+    return Ok;
+}
+
+void
+CommandConnection::handleHistorySeries(unsigned int sensor, const Downsampler& series)
+{
+    const std::vector<Downsampler::Point>& points = series.points();
+    std::ostringstream stream;
+
+    if (points.empty()) {
+	return;
+    }
+    for (size_t i = 0; i < points.size(); i++) {
+	stream << (i > 0 ? "\n" : "") << sensor << " " << points[i].time << " " << points[i].value;
+    }
+    respond(stream.str());
+}
+
+void
+CommandConnection::handleHistoryDone(bool success)
+{
+    m_historyPending = false;
+    respond(success ? "OK" : "FAIL");
+}
+
 CommandConnection::CommandResult
 CommandConnection::handleHkCommand(std::istream& request, uint8_t type)
 {
@@ -1348,15 +1473,14 @@ CommandConnection::loopOverResponse(const char *prefix)
 void
 CommandConnection::scheduleResponseTimeout()
 {
-    m_responseTimeout.expires_from_now(boost::posix_time::milliseconds(RequestTimeout));
-    m_responseTimeout.async_wait(boost::bind(&CommandConnection::responseTimeout,
-					     this, boost::asio::placeholders::error));
+    m_responseTimeout.start(RequestTimeout,
+			    boost::bind(&CommandConnection::responseTimeout, this));
 }
 
 void
-CommandConnection::responseTimeout(const boost::system::error_code& error)
+CommandConnection::responseTimeout()
 {
-    if (!m_activeRequest || error == boost::asio::error::operation_aborted) {
+    if (!m_activeRequest) {
 	return;
     }
     m_retriesLeft--;
@@ -1365,10 +1489,30 @@ CommandConnection::responseTimeout(const boost::system::error_code& error)
 	respond("ERRTIMEOUT");
     } else {
 	scheduleResponseTimeout();
-	m_handler.sendMessage(*m_activeRequest);
+	sendRequest();
     }
 }
 
+void
+CommandConnection::sendRequest()
+{
+    m_handler.sendMessage(*m_activeRequest,
+			  boost::bind(&CommandConnection::handleSendResult,
+				      shared_from_this(), _1));
+}
+
+void
+CommandConnection::handleSendResult(const boost::system::error_code& error)
+{
+    if (!error || !m_activeRequest) {
+	return;
+    }
+
+    m_responseTimeout.cancel();
+    m_activeRequest.reset();
+    respond("ERRSEND");
+}
+
 std::string
 CommandConnection::buildRecordResponse(const EmsProto::ErrorRecord *record)
 {
@@ -1558,8 +1702,7 @@ CommandConnection::sendCommand(uint8_t dest, uint8_t type, uint8_t offset,
     m_activeRequest.reset(new EmsMessage(dest, type, offset, sendData, expectResponse));
 
     scheduleResponseTimeout();
-
-    m_handler.sendMessage(*m_activeRequest);
+    sendRequest();
 }
 
 bool
@@ -20,6 +20,8 @@
 #ifndef __COMMANDHANDLER_H__
 #define __COMMANDHANDLER_H__
 
+#include <deque>
+#include <list>
 #include <set>
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -28,7 +30,10 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/logic/tribool.hpp>
+#include "Downsampler.h"
 #include "EmsMessage.h"
+#include "Listener.h"
+#include "RequestPacer.h"
 #include "TcpHandler.h"
 
 class CommandHandler;
@@ -40,13 +45,10 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 	typedef boost::shared_ptr<CommandConnection> Ptr;
 
     public:
-	CommandConnection(CommandHandler& handler);
+	CommandConnection(CommandHandler& handler, Listener::Socket& socket);
 	~CommandConnection();
 
     public:
-	boost::asio::ip::tcp::socket& socket() {
-	    return m_socket;
-	}
 	void startRead() {
 	    boost::asio::async_read_until(m_socket, m_request, "\n",
 		boost::bind(&CommandConnection::handleRequest, shared_from_this(),
@@ -64,7 +66,9 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 
     private:
 	void handleRequest(const boost::system::error_code& error);
-	void handleWrite(const boost::system::error_code& error);
+	typedef boost::shared_ptr<std::string> OutputBuffer;
+
+	void handleWrite(const boost::system::error_code& error, OutputBuffer response);
 
 	typedef enum {
 	    Ok,
@@ -79,6 +83,8 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 	CommandResult handleRawCommand(std::istream& request);
 #endif
 	CommandResult handleCacheCommand(std::istream& request);
+	CommandResult handleStatsCommand(std::istream& request);
+	CommandResult handleHistoryCommand(std::istream& request);
 	CommandResult handleHkCommand(std::istream& request, uint8_t base);
 	CommandResult handleSingleByteValue(std::istream& request, uint8_t dest, uint8_t type,
 					    uint8_t offset, int multiplier, int min, int max);
@@ -92,14 +98,27 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 	bool parseScheduleEntry(std::istream& request, EmsProto::ScheduleEntry *entry);
 	bool parseHolidayEntry(const std::string& string, EmsProto::HolidayEntry *entry);
 
+	/* responses are written one after another, so a long one written in
+	 * several parts can't get mixed up with the next */
 	void respond(const std::string& response) {
-	    boost::asio::async_write(m_socket, boost::asio::buffer(response + "\n"),
+	    m_output.push_back(OutputBuffer(new std::string(response + "\n")));
+	    if (m_output.size() == 1) {
+		writeNext();
+	    }
+	}
+	void writeNext() {
+	    /* the buffer is kept alive by the completion handler */
+	    boost::asio::async_write(m_socket, boost::asio::buffer(*m_output.front()),
 		boost::bind(&CommandConnection::handleWrite, shared_from_this(),
-			    boost::asio::placeholders::error));
+			    boost::asio::placeholders::error, m_output.front()));
 	}
+	void handleHistorySeries(unsigned int sensor, const Downsampler& series);
+	void handleHistoryDone(bool success);
 	boost::tribool handleResponse();
 	void scheduleResponseTimeout();
-	void responseTimeout(const boost::system::error_code& error);
+	void responseTimeout();
+	void sendRequest();
+	void handleSendResult(const boost::system::error_code& error);
 	void startRequest(uint8_t dest, uint8_t type, size_t offset, size_t length,
 			  bool newRequest = true, bool raw = false);
 	bool continueRequest();
@@ -111,11 +130,12 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
     private:
 	static const unsigned int MaxRequestRetries = 5;
 	static const unsigned int RequestTimeout = 1000; /* ms */
+	static const unsigned int MaxHistoryPoints = 10000;
 
-	boost::asio::ip::tcp::socket m_socket;
+	Listener::Socket m_socket;
 	boost::asio::streambuf m_request;
 	CommandHandler& m_handler;
-	boost::asio::deadline_timer m_responseTimeout;
+	TimerWheel::Timer m_responseTimeout;
 	unsigned int m_responseCounter;
 	unsigned int m_retriesLeft;
 	std::unique_ptr<EmsMessage> m_activeRequest;
@@ -126,13 +146,15 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 	uint8_t m_requestType;
 	size_t m_parsePosition;
 	bool m_outputRawData;
+	/* the DB is reading the history for this connection */
+	bool m_historyPending;
+	std::deque<OutputBuffer> m_output;
 };
 
 class CommandHandler : private boost::noncopyable
 {
     public:
-	CommandHandler(TcpHandler& handler,
-		       boost::asio::ip::tcp::endpoint& endpoint);
+	CommandHandler(TcpHandler& handler, const Listener::EndpointList& endpoints);
 	~CommandHandler();
 
     public:
@@ -142,23 +164,35 @@ class CommandHandler : private boost::noncopyable
 	TcpHandler& getHandler() const {
 	    return m_handler;
 	}
-	void sendMessage(const EmsMessage& msg);
+	void sendMessage(const EmsMessage& msg,
+			 const TcpHandler::SendCallback& callback = TcpHandler::SendCallback());
 
     private:
-	void handleAccept(CommandConnection::Ptr connection,
-			  const boost::system::error_code& error);
-	void startAccepting();
-	void doSendMessage(const EmsMessage& msg);
+	void handleAccept(Listener::Socket& socket);
 
     private:
 	static const long MinDistanceBetweenRequests = 100; /* ms */
 
+	/* message held back to keep the distance to the previous one */
+	struct PacedMessage {
+	    PacedMessage(TimerWheel& timers, const EmsMessage& msg,
+			 const TcpHandler::SendCallback& cb) :
+		timer(timers), message(msg), callback(cb) {}
+
+	    TimerWheel::Timer timer;
+	    EmsMessage message;
+	    TcpHandler::SendCallback callback;
+	};
+	typedef std::list<PacedMessage> PacedMessageList;
+
+	void sendPacedMessage(PacedMessageList::iterator message);
+
     private:
 	TcpHandler& m_handler;
-	boost::asio::ip::tcp::acceptor m_acceptor;
+	std::vector<boost::shared_ptr<Listener> > m_listeners;
 	std::set<CommandConnection::Ptr> m_connections;
-	boost::asio::deadline_timer m_sendTimer;
-	std::map<uint8_t, boost::posix_time::ptime> m_lastCommTimes;
+	PacedMessageList m_pacedMessages;
+	RequestPacer m_pacer;
 };
 
 #endif /* __COMMANDHANDLER_H__ */
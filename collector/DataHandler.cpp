@@ -22,35 +22,28 @@
 #include "CommandHandler.h"
 #include "ValueApi.h"
 
-DataHandler::DataHandler(TcpHandler& handler,
-			 boost::asio::ip::tcp::endpoint& endpoint) :
-    m_handler(handler),
-    m_acceptor(handler, endpoint)
+DataHandler::DataHandler(TcpHandler& handler, const Listener::EndpointList& endpoints) :
+    m_handler(handler)
 {
-    startAccepting();
+    for (size_t i = 0; i < endpoints.size(); i++) {
+	m_listeners.push_back(boost::shared_ptr<Listener>(
+		new Listener(handler, endpoints[i],
+			     boost::bind(&DataHandler::handleAccept, this, _1))));
+    }
 }
 
 DataHandler::~DataHandler()
 {
-    m_acceptor.close();
+    m_listeners.clear();
     std::for_each(m_connections.begin(), m_connections.end(),
 		  boost::bind(&DataConnection::close, _1));
     m_connections.clear();
 }
 
 void
-DataHandler::handleAccept(DataConnection::Ptr connection,
-			  const boost::system::error_code& error)
+DataHandler::handleAccept(Listener::Socket& socket)
 {
-    if (error) {
-	if (error != boost::asio::error::operation_aborted) {
-	    std::cerr << "Accept error: " << error.message() << std::endl;
-	}
-	return;
-    }
-
-    startConnection(connection);
-    startAccepting();
+    startConnection(DataConnection::Ptr(new DataConnection(*this, socket)));
 }
 
 void
@@ -67,25 +60,20 @@ DataHandler::stopConnection(DataConnection::Ptr connection)
 }
 
 void
-DataHandler::handleValue(const EmsValue& value)
+DataHandler::handleValues(const EmsValueList& values, uint64_t rxTime)
 {
+    /* with io_uring, the sends to all clients are submitted together
+     * after the bus read completion that led here */
     std::for_each(m_connections.begin(), m_connections.end(),
-		  boost::bind(&DataConnection::handleValue, _1, value));
-}
-
-void
-DataHandler::startAccepting()
-{
-    DataConnection::Ptr connection(new DataConnection(*this));
-    m_acceptor.async_accept(connection->socket(),
-		            boost::bind(&DataHandler::handleAccept, this,
-					connection, boost::asio::placeholders::error));
+		  boost::bind(&DataConnection::handleValues, _1, boost::cref(values), rxTime));
 }
 
 
-DataConnection::DataConnection(DataHandler& handler) :
-    m_socket(handler.getHandler()),
-    m_handler(handler)
+DataConnection::DataConnection(DataHandler& handler, Listener::Socket& socket) :
+    m_socket(std::move(socket)),
+    m_handler(handler),
+    m_uring(handler.getHandler().getUring()),
+    m_sendOffset(0)
 {
 }
 
@@ -94,28 +82,102 @@ DataConnection::~DataConnection()
 }
 
 void
-DataConnection::handleWrite(const boost::system::error_code& error)
+DataConnection::handleWrite(const boost::system::error_code& error,
+			    OutputBuffer text, uint64_t rxTime)
 {
     if (error && error != boost::asio::error::operation_aborted) {
 	m_handler.stopConnection(shared_from_this());
+    } else if (!error) {
+	LatencyStats::record(LatencyStats::ClientDelivery, rxTime);
     }
 }
 
 void
-DataConnection::handleValue(const EmsValue& value)
+DataConnection::output(OutputBuffer text, uint64_t rxTime)
 {
-    std::ostringstream stream;
-    std::string type = ValueApi::getTypeName(value.getType());
-    std::string subtype = ValueApi::getSubTypeName(value.getSubType());
+    if (m_uring) {
+	m_sendQueue.push_back(std::make_pair(text, rxTime));
+	if (m_sendQueue.size() == 1) {
+	    sendNext();
+	}
+	return;
+    }
+
+    /* the buffer is kept alive by the completion handler */
+    boost::asio::async_write(m_socket, boost::asio::buffer(*text),
+	boost::bind(&DataConnection::handleWrite, shared_from_this(),
+		    boost::asio::placeholders::error, text, rxTime));
+}
 
-    if (type.empty()) {
+void
+DataConnection::sendNext()
+{
+    const std::string& text = *m_sendQueue.front().first;
+
+    /* the queue keeps the buffer alive, the handler keeps the queue alive */
+    m_uring->send(m_socket.native_handle(), text.data() + m_sendOffset,
+		  text.size() - m_sendOffset,
+		  boost::bind(&DataConnection::handleSend, shared_from_this(), _1));
+}
+
+void
+DataConnection::handleSend(int result)
+{
+    std::pair<OutputBuffer, uint64_t> front = m_sendQueue.front();
+
+    if (result < 0) {
+	handleWrite(IoUring::toError(result), front.first, front.second);
 	return;
     }
 
-    if (!subtype.empty()) {
-	stream << subtype << " ";
+    m_sendOffset += result;
+    if (m_sendOffset < front.first->size()) {
+	sendNext();
+	return;
     }
-    stream << type << " " << ValueApi::formatValue(value);
 
-    output(stream.str());
+    m_sendQueue.pop_front();
+    m_sendOffset = 0;
+    handleWrite(boost::system::error_code(), front.first, front.second);
+    if (!m_sendQueue.empty()) {
+	sendNext();
+    }
+}
+
+void
+DataConnection::handleValues(const EmsValueList& values, uint64_t rxTime)
+{
+    OutputBuffer text(new std::string);
+    char buffer[ValueApi::FormatBufferSize];
+
+    /* one line per value, sent in a single write per message */
+    text->reserve(values.size() * 48);
+    for (size_t i = 0; i < values.size(); i++) {
+	const EmsValue& value = values[i];
+	const char *type = ValueApi::getTypeName(value.getType());
+	const char *subtype = ValueApi::getSubTypeName(value.getSubType());
+
+	if (!*type) {
+	    continue;
+	}
+
+	if (*subtype) {
+	    text->append(subtype);
+	    text->push_back(' ');
+	}
+	text->append(type);
+	text->push_back(' ');
+
+	size_t length = ValueApi::formatValue(value, buffer, sizeof(buffer));
+	if (length < sizeof(buffer)) {
+	    text->append(buffer, length);
+	} else {
+	    text->append(ValueApi::formatValue(value));
+	}
+	text->push_back('\n');
+    }
+
+    if (!text->empty()) {
+	output(text, rxTime);
+    }
 }
@@ -20,6 +20,7 @@
 #ifndef __DATAHANDLER_H__
 #define __DATAHANDLER_H__
 
+#include <deque>
 #include <set>
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -28,6 +29,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include "EmsMessage.h"
+#include "Listener.h"
 #include "TcpHandler.h"
 
 class DataHandler;
@@ -39,54 +41,57 @@ class DataConnection : public boost::enable_shared_from_this<DataConnection>,
 	typedef boost::shared_ptr<DataConnection> Ptr;
 
     public:
-	DataConnection(DataHandler& handler);
+	DataConnection(DataHandler& handler, Listener::Socket& socket);
 	~DataConnection();
 
     public:
-	boost::asio::ip::tcp::socket& socket() {
-	    return m_socket;
-	}
 	void close() {
+	    if (m_uring) {
+		m_uring->cancel(m_socket.native_handle());
+	    }
 	    m_socket.close();
 	}
-	void handleValue(const EmsValue& value);
+	void handleValues(const EmsValueList& values, uint64_t rxTime);
 
     private:
-	void handleWrite(const boost::system::error_code& error);
+	typedef boost::shared_ptr<std::string> OutputBuffer;
+
+	void handleWrite(const boost::system::error_code& error,
+			 OutputBuffer text, uint64_t rxTime);
+	void output(OutputBuffer text, uint64_t rxTime);
+	void sendNext();
+	void handleSend(int result);
 
-	void output(const std::string& text) {
-	    boost::asio::async_write(m_socket, boost::asio::buffer(text + "\n"),
-		boost::bind(&DataConnection::handleWrite, shared_from_this(),
-			    boost::asio::placeholders::error));
-	}
     private:
-	boost::asio::ip::tcp::socket m_socket;
+	Listener::Socket m_socket;
 	DataHandler& m_handler;
+	IoUring *m_uring;
+	/* with io_uring, only one send per connection is in flight, so
+	 * short writes can't reorder the output */
+	std::deque<std::pair<OutputBuffer, uint64_t> > m_sendQueue;
+	size_t m_sendOffset;
 };
 
 class DataHandler : private boost::noncopyable
 {
     public:
-	DataHandler(TcpHandler& handler,
-		    boost::asio::ip::tcp::endpoint& endpoint);
+	DataHandler(TcpHandler& handler, const Listener::EndpointList& endpoints);
 	~DataHandler();
 
     public:
 	void startConnection(DataConnection::Ptr connection);
 	void stopConnection(DataConnection::Ptr connection);
-	void handleValue(const EmsValue& value);
+	void handleValues(const EmsValueList& values, uint64_t rxTime);
 	TcpHandler& getHandler() const {
 	    return m_handler;
 	}
 
     private:
-	void handleAccept(DataConnection::Ptr connection,
-			  const boost::system::error_code& error);
-	void startAccepting();
+	void handleAccept(Listener::Socket& socket);
 
     private:
 	TcpHandler& m_handler;
-	boost::asio::ip::tcp::acceptor m_acceptor;
+	std::vector<boost::shared_ptr<Listener> > m_listeners;
 	std::set<DataConnection::Ptr> m_connections;
 };
 
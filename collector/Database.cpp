@@ -17,55 +17,174 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
 #include <iostream>
+#include <boost/bind.hpp>
 #include <mysql++/exceptions.h>
 #include <mysql++/query.h>
-#include <mysql++/ssqls.h>
 #include "Database.h"
+#include "LatencyStats.h"
 #include "Options.h"
+#include "PendingWrites.h"
+#include "Schema.h"
+#include "ValueApi.h"
 
 const char * Database::dbName = "ems_data";
 const char * Database::numericTableName = "numeric_data";
 const char * Database::booleanTableName = "boolean_data";
 const char * Database::stateTableName = "state_data";
+const char * Database::aggregateTableName = "numeric_aggregates";
+const char * Database::currentTableName = "current_values";
 
-sql_create_4(NumericSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_float, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
-sql_create_4(BooleanSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_bool, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
-sql_create_4(StateSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_varchar, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
+/* every sample counts here, regardless of rate limits and policies */
+template<typename T> static void
+queueCurrentValue(std::vector<std::pair<unsigned int, T> >& values,
+		  const std::map<unsigned int, T>& current, unsigned int sensor, const T& value)
+{
+    typename std::map<unsigned int, T>::const_iterator iter = current.find(sensor);
+    if (iter == current.end() || iter->second != value) {
+	values.push_back(std::make_pair(sensor, value));
+    }
+}
+
+template<typename T> static void
+updateCurrentValues(const std::vector<std::pair<unsigned int, T> >& values,
+		    std::map<unsigned int, T>& current)
+{
+    for (auto& entry : values) {
+	current[entry.first] = entry.second;
+    }
+}
+
+/* like the IO thread, leave signal handling to the main thread */
+static boost::thread
+startThread(const boost::function<void ()>& function)
+{
+    sigset_t oldMask, newMask;
+    sigfillset(&newMask);
+    pthread_sigmask(SIG_BLOCK, &newMask, &oldMask);
+    boost::thread thread(function);
+    pthread_sigmask(SIG_SETMASK, &oldMask, 0);
+
+    return thread;
+}
 
 Database::Database() :
-    m_connection(NULL)
+    m_fixedPoint(false),
+    m_lastCheckpoint(time(NULL)),
+    m_lastPartitionCheck(time(NULL)),
+    m_connection(NULL),
+    m_service(NULL),
+    m_connecting(false),
+    m_ready(false),
+    m_historyConnection(NULL),
+    m_lastHistoryQuery(0),
+    m_bufferedValues(0),
+    m_droppedValues(0)
 {
 }
 
 Database::~Database()
 {
+    if (m_historyThread.joinable()) {
+	/* lets a running query complete, dropping the queued ones */
+	m_historyService.stop();
+	m_historyThread.join();
+    }
+    if (m_connectThread.joinable()) {
+	m_connectThread.interrupt();
+	m_connectThread.join();
+    }
+    if (m_ready) {
+	/* the DB came up after the last message */
+	replayBuffer();
+    } else if (!m_buffer.empty() || m_droppedValues) {
+	std::cerr << "Database not ready, discarding " << m_bufferedValues + m_droppedValues
+		  << " values" << std::endl;
+    }
     if (m_connection) {
+	if (m_ready) {
+	    flushEndtimes();
+	    flushAggregates();
+	}
 	delete m_connection;
     }
 }
 
+void
+Database::startConnecting(const std::string& server, const std::string& user,
+			  const std::string& password)
+{
+    m_server = server;
+    m_user = user;
+    m_password = password;
+    m_connecting = true;
+    m_connectThread = startThread(boost::bind(&Database::connectLoop, this));
+}
+
+void
+Database::setService(boost::asio::io_service *service)
+{
+    boost::mutex::scoped_lock lock(m_serviceLock);
+
+    m_service = service;
+    if (!m_service) {
+	/* the connections of running history queries go with the service,
+	 * their results are dropped */
+	m_historyHandlers.clear();
+    } else if (m_ready.load(std::memory_order_acquire)) {
+	/* values buffered while there was no IO handler */
+	m_service->post(boost::bind(&Database::replayBuffer, this));
+    }
+}
+
+void
+Database::connectLoop()
+{
+    static const unsigned int maxRetryDelay = 300;
+    unsigned int delay = 5;
+    unsigned int attempts = 1;
+
+    mysqlpp::Connection::thread_start();
+
+    try {
+	while (!connect()) {
+	    std::cerr << "Could not connect to database, retrying in "
+		      << delay << "s" << std::endl;
+	    boost::this_thread::sleep(boost::posix_time::seconds(delay));
+	    delay = std::min(2 * delay, maxRetryDelay);
+	    attempts++;
+	}
+	if (attempts > 1) {
+	    std::cerr << "Connected to database after " << attempts << " attempts" << std::endl;
+	}
+	/* hands everything set up by connect() over to the IO thread */
+	m_ready.store(true, std::memory_order_release);
+
+	boost::mutex::scoped_lock lock(m_serviceLock);
+	if (m_service) {
+	    m_service->post(boost::bind(&Database::replayBuffer, this));
+	}
+    } catch (boost::thread_interrupted& e) {
+	/* shutting down */
+    }
+
+    mysqlpp::Connection::thread_end();
+}
+
 bool
-Database::connect(const std::string& server, const std::string& user, const std::string& password)
+Database::connect()
 {
     bool success = false;
 
     m_connection = new mysqlpp::Connection();
     m_connection->set_option(new mysqlpp::ReconnectOption(true));
+    /* keeps shutdown from waiting for an unreachable server too long */
+    m_connection->set_option(new mysqlpp::ConnectTimeoutOption(10));
 
-    if (!m_connection->connect(NULL, server.c_str(), user.c_str(), password.c_str())) {
+    if (!m_connection->connect(NULL, m_server.c_str(), m_user.c_str(), m_password.c_str())) {
 	delete m_connection;
 	m_connection = NULL;
 	return false;
@@ -74,6 +193,7 @@ Database::connect(const std::string& server, const std::string& user, const std:
     NumericSensorValue::table(numericTableName);
     BooleanSensorValue::table(booleanTableName);
     StateSensorValue::table(stateTableName);
+    NumericAggregateValue::table(aggregateTableName);
 
     try {
 	m_connection->select_db(dbName);
@@ -92,6 +212,23 @@ Database::connect(const std::string& server, const std::string& user, const std:
     if (success) {
 	success = createTables();
     }
+    if (success && Options::rateLimitAggregate()) {
+	success = createAggregateTable();
+    }
+    if (success) {
+	success = createCurrentValuesTable();
+    }
+    if (success) {
+	/* not fatal, rows beyond the last month go to the last partition */
+	extendPartitions(time(NULL));
+    }
+    if (success) {
+	success = loadSensors();
+    }
+    if (success && Options::dbRecoveryLimit() > 0) {
+	recoverIntervals();
+	loadCurrentValues();
+    }
     if (!success) {
 	delete m_connection;
 	m_connection = NULL;
@@ -103,6 +240,8 @@ Database::connect(const std::string& server, const std::string& user, const std:
 bool
 Database::createTables()
 {
+    time_t now = time(NULL);
+
     try {
 	mysqlpp::Query query = m_connection->query();
 	
@@ -122,50 +261,50 @@ Database::createTables()
 	      << "  reading_type TINYINT UNSIGNED, "
 	      << "  unit VARCHAR(10), "
 	      << "  `precision` TINYINT UNSIGNED, "
+	      << "  ems_type VARCHAR(40), "
+	      << "  ems_subtype VARCHAR(20), "
+	      << "  scale SMALLINT UNSIGNED, "
 	      << "  PRIMARY KEY (type)) "
-	      << "ENGINE MyISAM CHARACTER SET utf8";
+	      << "ENGINE InnoDB CHARACTER SET utf8";
 	query.execute();
 
-	/* insert sensor data (id, type, name, unit) */
-	createSensorRows();
-
 	/* Create numeric sensor data table */
 	query << "CREATE TABLE IF NOT EXISTS " << numericTableName << " ("
-	      << "  id INT AUTO_INCREMENT, "
+	      << "  id BIGINT UNSIGNED AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
-	      << "  value FLOAT NOT NULL, "
+	      << "  value " << (Options::dbFixedPoint() ? "INT" : "FLOAT") << " NOT NULL, "
 	      << "  starttime DATETIME NOT NULL, "
 	      << "  endtime DATETIME NOT NULL, "
-	      << "  PRIMARY KEY (id), "
-	      << "  KEY sensor_starttime (sensor, starttime), "
+	      << "  PRIMARY KEY (sensor, starttime, id), "
+	      << "  KEY id (id), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
-	      << "ENGINE MyISAM PACK_KEYS 1 ROW_FORMAT DYNAMIC";
+	      << Schema::tableOptions(now, now);
 	query.execute();
 
 	/* Create boolean sensor data table */
 	query << "CREATE TABLE IF NOT EXISTS " << booleanTableName << " ("
-	      << "  id INT AUTO_INCREMENT, "
+	      << "  id BIGINT UNSIGNED AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
 	      << "  value TINYINT NOT NULL, "
 	      << "  starttime DATETIME NOT NULL, "
 	      << "  endtime DATETIME NOT NULL, "
-	      << "  PRIMARY KEY (id), "
-	      << "  KEY sensor_starttime (sensor, starttime), "
+	      << "  PRIMARY KEY (sensor, starttime, id), "
+	      << "  KEY id (id), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
-	      << "ENGINE MyISAM PACK_KEYS 1 ROW_FORMAT DYNAMIC";
+	      << Schema::tableOptions(now, now);
 	query.execute();
 
 	/* Create state sensor data table */
 	query << "CREATE TABLE IF NOT EXISTS " << stateTableName << " ("
-	      << "  id INT AUTO_INCREMENT, "
+	      << "  id BIGINT UNSIGNED AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
 	      << "  value VARCHAR(100) NOT NULL, "
 	      << "  starttime DATETIME NOT NULL, "
 	      << "  endtime DATETIME NOT NULL, "
-	      << "  PRIMARY KEY (id), "
-	      << "  KEY sensor_starttime (sensor, starttime), "
+	      << "  PRIMARY KEY (sensor, starttime, id), "
+	      << "  KEY id (id), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
-	      << "ENGINE MyISAM PACK_KEYS 1 ROW_FORMAT DYNAMIC";
+	      << Schema::tableOptions(now, now);
 	query.execute();
     } catch (const mysqlpp::BadQuery& er) {
 	std::cerr << "Query error: " << er.what() << std::endl;
@@ -183,97 +322,308 @@ Database::createTables()
     return true;
 }
 
+/* separate from the data tables, so existing installations get it when
+ * enabling the aggregation */
+bool
+Database::createAggregateTable()
+{
+    mysqlpp::Query query = m_connection->query();
+    time_t now = time(NULL);
+
+    query << "CREATE TABLE IF NOT EXISTS " << aggregateTableName << " ("
+	  << "  id BIGINT UNSIGNED AUTO_INCREMENT, "
+	  << "  sensor SMALLINT UNSIGNED NOT NULL, "
+	  << "  starttime DATETIME NOT NULL, "
+	  << "  endtime DATETIME NOT NULL, "
+	  << "  min_value FLOAT NOT NULL, "
+	  << "  max_value FLOAT NOT NULL, "
+	  << "  mean_value FLOAT NOT NULL, "
+	  << "  samples INT UNSIGNED NOT NULL, "
+	  << "  PRIMARY KEY (sensor, starttime, id), "
+	  << "  KEY id (id)) "
+	  << Schema::tableOptions(now, now);
+
+    return executeQuery(query);
+}
+
+/* tables created by older versions lack the EMS type and scale columns */
+static void
+addSensorColumns(mysqlpp::Query& query)
+{
+    query << "show columns from sensors like 'ems_type'";
+    mysqlpp::StoreQueryResult res = query.store();
+    if (res.num_rows() == 0) {
+	query << "alter table sensors add ems_type VARCHAR(40), add ems_subtype VARCHAR(20)";
+	query.execute();
+    }
+
+    query << "show columns from sensors like 'scale'";
+    res = query.store();
+    if (res.num_rows() == 0) {
+	query << "alter table sensors add scale SMALLINT UNSIGNED";
+	query.execute();
+    }
+}
+
+/* one row per sensor with its latest value, so reading the current
+ * state doesn't need to search the data tables */
+bool
+Database::createCurrentValuesTable()
+{
+    mysqlpp::Query query = m_connection->query();
+
+    query << "CREATE TABLE IF NOT EXISTS " << currentTableName << " ("
+	  << "  sensor SMALLINT UNSIGNED NOT NULL, "
+	  << "  numeric_value FLOAT, "
+	  << "  boolean_value TINYINT, "
+	  << "  state_value VARCHAR(100), "
+	  << "  starttime DATETIME NOT NULL, "
+	  << "  PRIMARY KEY (sensor)) "
+	  << "ENGINE InnoDB CHARACTER SET utf8";
+
+    return executeQuery(query);
+}
+
+bool
+Database::loadSensors()
+{
+    try {
+	mysqlpp::Query query = m_connection->query();
+
+	addSensorColumns(query);
+
+	/* the format is that of the table, the option only applies to
+	 * new tables and the conversion of existing ones */
+	query << "show columns from " << numericTableName << " like 'value'";
+	mysqlpp::StoreQueryResult res = query.store();
+	m_fixedPoint = res.num_rows() > 0 &&
+		std::string(res[0]["Type"].c_str()).compare(0, 3, "int") == 0;
+	if (Options::dbFixedPoint() && !m_fixedPoint) {
+	    std::cerr << "Numeric values are stored as floats until " << numericTableName
+		      << " is converted with --migrate-schema" << std::endl;
+	}
+
+	query << "select type, value_type, name, reading_type, unit, `precision`, "
+	      << "ems_type, ems_subtype, scale from sensors where ems_type is not null";
+	res = query.store();
+
+	for (size_t i = 0; i < res.num_rows(); i++) {
+	    const mysqlpp::Row& row = res[i];
+	    SensorRegistry::Sensor sensor;
+
+	    sensor.id = (unsigned int) row["type"];
+	    sensor.valueType = (SensorRegistry::ValueType) (unsigned int) row["value_type"];
+	    sensor.name = row["name"].c_str();
+	    sensor.readingType = row["reading_type"].is_null() ?
+		    SensorRegistry::ReadingNone : (SensorRegistry::ReadingType) (unsigned int) row["reading_type"];
+	    sensor.unit = row["unit"].is_null() ? "" : row["unit"].c_str();
+	    sensor.precision = row["precision"].is_null() ? -1 : (int) row["precision"];
+	    if (!row["scale"].is_null()) {
+		m_scales[sensor.id] = (unsigned int) row["scale"];
+	    }
+	    /* NULL subtype matches any subtype, empty subtype none */
+	    sensor.anySubtype = row["ems_subtype"].is_null();
+	    sensor.subtype = EmsValue::None;
+
+	    if (!ValueApi::parseTypeName(row["ems_type"].c_str(), sensor.type) ||
+		    (!sensor.anySubtype && row["ems_subtype"].c_str()[0] &&
+		     !ValueApi::parseSubTypeName(row["ems_subtype"].c_str(), sensor.subtype))) {
+		std::cerr << "Ignoring sensor " << sensor.id
+			  << " with unknown type " << row["ems_type"].c_str() << std::endl;
+		continue;
+	    }
+
+	    m_sensors.add(sensor);
+	}
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not load sensors: " << e.what() << std::endl;
+	return false;
+    }
+
+    for (size_t i = 0; i < Options::sensorDefinitions().size(); i++) {
+	const std::string& definition = Options::sensorDefinitions()[i];
+	if (!m_sensors.addDefinition(definition)) {
+	    std::cerr << "Ignoring invalid sensor definition " << definition << std::endl;
+	}
+    }
+    for (size_t i = 0; i < Options::storagePolicies().size(); i++) {
+	const std::string& definition = Options::storagePolicies()[i];
+	StoragePolicy policy;
+	unsigned int sensor;
+
+	if (StoragePolicy::parse(definition, sensor, policy)) {
+	    m_policies[sensor] = policy;
+	} else {
+	    std::cerr << "Ignoring invalid storage policy " << definition << std::endl;
+	}
+    }
+    m_sensors.compile();
+
+    for (size_t i = 0; i < m_sensors.sensors().size(); i++) {
+	writeSensorRow(m_sensors.sensors()[i]);
+    }
+
+    return true;
+}
+
+static void
+readValue(const mysqlpp::String& field, float& value)
+{
+    value = (float) field;
+}
+
+static void
+readValue(const mysqlpp::String& field, bool& value)
+{
+    value = (int) field != 0;
+}
+
+static void
+readValue(const mysqlpp::String& field, std::string& value)
+{
+    value = field.c_str();
+}
+
 void
-Database::createSensorRows()
+Database::recoverIntervals()
+{
+    uint64_t start = LatencyStats::now();
+    size_t count = 0;
+
+    count += recoverIntervals(numericTableName, m_numericCache);
+    if (m_fixedPoint) {
+	/* the cache holds the values as decoded */
+	for (auto& entry : m_numericCache) {
+	    entry.second /= getScale(entry.first);
+	}
+    }
+    count += recoverIntervals(booleanTableName, m_booleanCache);
+    count += recoverIntervals(stateTableName, m_stateCache);
+
+    if (Options::statsDebug()) {
+	Options::statsDebug() << "STATS: recovered " << count << " open intervals in "
+			      << (LatencyStats::now() - start) / 1000000 << " ms" << std::endl;
+    }
+}
+
+/* continues the newest row of every sensor whose end time is within the
+ * recovery limit, so an unchanged value doesn't start a new row */
+template<typename T> size_t
+Database::recoverIntervals(const char *table, std::map<unsigned int, T>& cache)
+{
+    size_t count = 0;
+
+    try {
+	mysqlpp::Query query = m_connection->query();
+
+	/* the derived table is a loose index scan of the primary key, whose
+	 * leading columns are (sensor, starttime); older MyISAM tables have
+	 * the sensor_starttime key for it */
+	query << "select v.id, v.sensor, v.value from " << table << " v "
+	      << "inner join (select sensor, max(starttime) starttime from " << table
+	      << " group by sensor) latest "
+	      << "on v.sensor = latest.sensor and v.starttime = latest.starttime "
+	      << "where v.endtime >= now() - interval " << Options::dbRecoveryLimit()
+	      << " second order by v.id";
+
+	/* with duplicate start times, the highest id wins */
+	mysqlpp::StoreQueryResult res = query.store();
+	for (size_t i = 0; i < res.num_rows(); i++) {
+	    const mysqlpp::Row& row = res[i];
+	    unsigned int sensor = (unsigned int) row["sensor"];
+
+	    m_lastInsertIds[sensor] = (mysqlpp::ulonglong) row["id"];
+	    readValue(row["value"], cache[sensor]);
+	    count++;
+	}
+    } catch (const mysqlpp::Exception& e) {
+	/* not fatal, the sensors just start new rows */
+	std::cerr << "Could not recover intervals from " << table << ": "
+		  << e.what() << std::endl;
+    }
+
+    return count;
+}
+
+/* without these, every value would differ from the (empty) maps after a
+ * restart and reset its start time in the current values table */
+void
+Database::loadCurrentValues()
+{
+    loadCurrentValues("numeric_value", m_numericCurrent);
+    loadCurrentValues("boolean_value", m_booleanCurrent);
+    loadCurrentValues("state_value", m_stateCurrent);
+}
+
+template<typename T> void
+Database::loadCurrentValues(const char *column, std::map<unsigned int, T>& current)
+{
+    try {
+	mysqlpp::Query query = m_connection->query();
+
+	query << "select sensor, " << column << " value from " << currentTableName
+	      << " where " << column << " is not null";
+
+	mysqlpp::StoreQueryResult res = query.store();
+	for (size_t i = 0; i < res.num_rows(); i++) {
+	    readValue(res[i]["value"], current[(unsigned int) res[i]["sensor"]]);
+	}
+    } catch (const mysqlpp::Exception& e) {
+	/* not fatal, the values just get a new start time */
+	std::cerr << "Could not load current values: " << e.what() << std::endl;
+    }
+}
+
+void
+Database::writeSensorRow(const SensorRegistry::Sensor& sensor)
 {
     mysqlpp::Query query = m_connection->query();
+    bool numeric = sensor.valueType == SensorRegistry::Numeric;
 
-    query << "insert into sensors values (%0q, %1q, %2q, %3q:reading_type, %4q:unit, %5q:precision)";
+    /* names, units etc. of existing sensors may have been edited, keep them */
+    query << "insert into sensors (type, value_type, name, reading_type, unit, `precision`, "
+	  << "ems_type, ems_subtype) values (%0q, %1q, %2q, %3q, %4q, %5q, %6q, %7q) "
+	  << "on duplicate key update ems_type = values(ems_type), "
+	  << "ems_subtype = values(ems_subtype)";
     query.parse();
-    query.template_defaults["unit"] = mysqlpp::null;
-    query.template_defaults["reading_type"] = mysqlpp::null;
-    query.template_defaults["precision"] = mysqlpp::null;
-
-    /* Numeric sensors */
-    query.execute(SensorKesselSollTemp, sensorTypeNumeric,
-		  "Kessel-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorKesselIstTemp, sensorTypeNumeric,
-		  "Kessel-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorWarmwasserSollTemp, sensorTypeNumeric,
-		  "Warmwasser-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorWarmwasserIstTemp, sensorTypeNumeric,
-		  "Warmwasser-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorVorlaufHK1SollTemp, sensorTypeNumeric,
-		  "Vorlauf HK1-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorVorlaufHK1IstTemp, sensorTypeNumeric,
-		  "Vorlauf HK1-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorVorlaufHK2SollTemp, sensorTypeNumeric,
-		  "Vorlauf HK2-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorVorlaufHK2IstTemp, sensorTypeNumeric,
-		  "Vorlauf HK2-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorMischersteuerung, sensorTypeNumeric,
-		  "Mischersteuerung", readingTypeNone, "", 0);
-    query.execute(SensorRuecklaufTemp, sensorTypeNumeric,
-		  "Rücklauftemperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorAussenTemp, sensorTypeNumeric,
-		  "Außentemperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorGedaempfteAussenTemp, sensorTypeNumeric,
-		  "Gedämpfte Außentemperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorRaumSollTemp, sensorTypeNumeric,
-		  "Raum-Soll-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorRaumIstTemp, sensorTypeNumeric,
-		  "Raum-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorMomLeistung, sensorTypeNumeric,
-		  "Momentane Leistung", readingTypePercent, "%", 0);
-    query.execute(SensorMaxLeistung, sensorTypeNumeric,
-		  "Maximale Leistung", readingTypePercent, "%", 0);
-    query.execute(SensorFlammenstrom, sensorTypeNumeric,
-		  "Flammenstrom", readingTypeCurrent, "µA", 1);
-    query.execute(SensorSystemdruck, sensorTypeNumeric,
-		  "Systemdruck", readingTypePressure, "bar", 1);
-    query.execute(SensorBrennerstarts, sensorTypeNumeric,
-		  "Brennerstarts", readingTypeCount, "");
-    query.execute(SensorBetriebszeit, sensorTypeNumeric,
-		  "Betriebszeit", readingTypeTime, "min");
-    query.execute(SensorHeizZeit, sensorTypeNumeric,
-		  "Heizzeit", readingTypeTime, "min");
-    query.execute(SensorWarmwasserbereitungsZeit, sensorTypeNumeric,
-		  "Warmwasserbereitungszeit", readingTypeTime, "min");
-    query.execute(SensorWarmwasserBereitungen, sensorTypeNumeric,
-		  "Warmwasserbereitungen", readingTypeCount, "");
-    query.execute(SensorPumpenModulation, sensorTypeNumeric,
-		  "Kesselpumpenmodulation", readingTypePercent, "%", 0);
-    query.execute(SensorWaermetauscherTemp, sensorTypeNumeric,
-		  "Temperatur Ausgang Waermetauscher", readingTypeTemperature, "°C", 1);
-
-
-    /* Boolean sensors */
-    query.execute(SensorFlamme, sensorTypeBoolean, "Flamme");
-    query.execute(SensorBrenner, sensorTypeBoolean, "Brenner");
-    query.execute(SensorZuendung, sensorTypeBoolean, "Zündung");
-    query.execute(SensorKesselPumpe, sensorTypeBoolean, "Kessel-Pumpe");
-    query.execute(Sensor3WegeVentil, sensorTypeBoolean, "3-Wege-Ventil");
-    query.execute(SensorZirkulation, sensorTypeBoolean, "Zirkulation");
-    query.execute(SensorZirkulationTagbetrieb, sensorTypeBoolean, "Zirkulation-Tagbetrieb");
-    query.execute(SensorWarmwasserBereitung, sensorTypeBoolean, "Warmwasserbereitung");
-    query.execute(SensorWWTagbetrieb, sensorTypeBoolean, "WW-Tagbetrieb");
-    query.execute(SensorSommerbetrieb, sensorTypeBoolean, "Sommerbetrieb");
-    query.execute(SensorWarmwasserTempOK, sensorTypeBoolean, "Warmwassertemperatur OK");
-    query.execute(SensorWWVorrang, sensorTypeBoolean, "Warmwasservorrang");
-    query.execute(SensorHK1Automatik, sensorTypeBoolean, "HK1 Automatikbetrieb");
-    query.execute(SensorHK1Tagbetrieb, sensorTypeBoolean, "HK1 Tagbetrieb");
-    query.execute(SensorHK1Pumpe, sensorTypeBoolean, "HK1 Pumpe");
-    query.execute(SensorHK1Ferien, sensorTypeBoolean, "HK1 Ferien");
-    query.execute(SensorHK1Party, sensorTypeBoolean, "HK1 Party");
-    query.execute(SensorHK2Automatik, sensorTypeBoolean, "HK2 Automatikbetrieb");
-    query.execute(SensorHK2Tagbetrieb, sensorTypeBoolean, "HK2 Tagbetrieb");
-    query.execute(SensorHK2Pumpe, sensorTypeBoolean, "HK2 Pumpe");
-    query.execute(SensorHK2Ferien, sensorTypeBoolean, "HK2 Ferien");
-    query.execute(SensorHK2Party, sensorTypeBoolean, "HK2 Party");
-
-    /* State sensors */
-    query.execute(SensorServiceCode, sensorTypeState, "Servicecode");
-    query.execute(SensorFehlerCode, sensorTypeState, "Fehlercode");
+
+    try {
+	query.execute(sensor.id, (unsigned int) sensor.valueType, sensor.name,
+		      numeric ? mysqlpp::SQLTypeAdapter((unsigned int) sensor.readingType) :
+				mysqlpp::SQLTypeAdapter(mysqlpp::null),
+		      numeric ? mysqlpp::SQLTypeAdapter(sensor.unit) :
+				mysqlpp::SQLTypeAdapter(mysqlpp::null),
+		      sensor.precision >= 0 ? mysqlpp::SQLTypeAdapter(sensor.precision) :
+					      mysqlpp::SQLTypeAdapter(mysqlpp::null),
+		      ValueApi::getTypeName(sensor.type),
+		      sensor.anySubtype ? mysqlpp::SQLTypeAdapter(mysqlpp::null) :
+			      mysqlpp::SQLTypeAdapter(ValueApi::getSubTypeName(sensor.subtype)));
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not store sensor " << sensor.id << ": " << e.what() << std::endl;
+    }
+}
+
+float
+Database::getScale(unsigned int sensor) const
+{
+    std::map<unsigned int, unsigned int>::const_iterator iter = m_scales.find(sensor);
+    return iter != m_scales.end() ? iter->second : 1;
+}
+
+/* the scale of a sensor is the divider of its first value; values
+ * with another divider are rounded to it */
+void
+Database::updateScale(unsigned int sensor, int divider)
+{
+    if (!m_fixedPoint || divider <= 0 || m_scales.find(sensor) != m_scales.end()) {
+	return;
+    }
+
+    m_scales[sensor] = divider;
+
+    mysqlpp::Query query = m_connection->query();
+    query << "update sensors set scale = " << divider << " where type = " << sensor;
+    executeQuery(query);
 }
 
 bool
@@ -315,207 +665,707 @@ Database::executeQuery(mysqlpp::Query& query)
 }
 
 void
-Database::handleValue(const EmsValue& value)
-{
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	NumericSensors sensor;
-    } NUMERICMAPPING[] = {
-	{ EmsValue::SollTemp, EmsValue::Kessel, SensorKesselSollTemp },
-	{ EmsValue::IstTemp, EmsValue::Kessel, SensorKesselIstTemp },
-	{ EmsValue::SollTemp, EmsValue::WW, SensorWarmwasserSollTemp },
-	{ EmsValue::IstTemp, EmsValue::WW, SensorWarmwasserIstTemp },
-	{ EmsValue::SollTemp, EmsValue::HK1, SensorVorlaufHK1SollTemp },
-	{ EmsValue::IstTemp, EmsValue::HK1, SensorVorlaufHK1IstTemp },
-	{ EmsValue::SollTemp, EmsValue::HK2, SensorVorlaufHK2SollTemp },
-	{ EmsValue::IstTemp, EmsValue::HK2, SensorVorlaufHK2IstTemp },
-	{ EmsValue::Mischersteuerung, EmsValue::None, SensorMischersteuerung },
-	{ EmsValue::IstTemp, EmsValue::Ruecklauf, SensorRuecklaufTemp },
-	{ EmsValue::IstTemp, EmsValue::Aussen, SensorAussenTemp },
-	{ EmsValue::GedaempfteTemp, EmsValue::Aussen, SensorGedaempfteAussenTemp },
-	{ EmsValue::SollTemp, EmsValue::Raum, SensorRaumSollTemp },
-	{ EmsValue::IstTemp, EmsValue::Raum, SensorRaumIstTemp },
-	{ EmsValue::IstModulation, EmsValue::Brenner, SensorMomLeistung },
-	{ EmsValue::SollModulation, EmsValue::Brenner, SensorMaxLeistung },
-	{ EmsValue::Flammenstrom, EmsValue::None, SensorFlammenstrom },
-	{ EmsValue::Systemdruck, EmsValue::None, SensorSystemdruck },
-	{ EmsValue::IstModulation, EmsValue::KesselPumpe, SensorPumpenModulation },
-	{ EmsValue::IstTemp, EmsValue::Waermetauscher, SensorWaermetauscherTemp }
-    };
+Database::handleValues(const EmsValueList& values, const EmsValueList& unchanged)
+{
+    time_t now = time(NULL);
 
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	NumericSensors sensor;
-    } INTEGERMAPPING[] = {
-	{ EmsValue::BetriebsZeit, EmsValue::None, SensorBetriebszeit },
-	{ EmsValue::HeizZeit, EmsValue::None, SensorHeizZeit },
-	{ EmsValue::Brennerstarts, EmsValue::None, SensorBrennerstarts },
-	{ EmsValue::WarmwasserbereitungsZeit, EmsValue::None, SensorWarmwasserbereitungsZeit },
-	{ EmsValue::WarmwasserBereitungen, EmsValue::None, SensorWarmwasserBereitungen }
-    };
+    if (m_connecting && !m_ready.load(std::memory_order_acquire)) {
+	bufferValues(now, values, unchanged);
+	return;
+    }
+    if (!m_buffer.empty()) {
+	replayBuffer();
+    }
 
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	BooleanSensors sensor;
-    } BOOLMAPPING[] = {
-	{ EmsValue::FlammeAktiv, EmsValue::None, SensorFlamme },
-	{ EmsValue::BrennerAktiv, EmsValue::None, SensorBrenner },
-	{ EmsValue::ZuendungAktiv, EmsValue::None, SensorZuendung },
-	{ EmsValue::PumpeAktiv, EmsValue::Kessel, SensorKesselPumpe },
-	{ EmsValue::DreiWegeVentilAufWW, EmsValue::None, Sensor3WegeVentil },
-	{ EmsValue::Automatikbetrieb, EmsValue::HK1, SensorHK1Automatik },
-	{ EmsValue::Tagbetrieb, EmsValue::HK1, SensorHK1Tagbetrieb },
-	{ EmsValue::PumpeAktiv, EmsValue::HK1, SensorHK1Pumpe },
-	{ EmsValue::Ferien, EmsValue::HK1, SensorHK1Ferien },
-	{ EmsValue::Party, EmsValue::HK1, SensorHK1Party },
-	{ EmsValue::Automatikbetrieb, EmsValue::HK2, SensorHK2Automatik },
-	{ EmsValue::Tagbetrieb, EmsValue::HK2, SensorHK2Tagbetrieb },
-	{ EmsValue::PumpeAktiv, EmsValue::HK2, SensorHK2Pumpe },
-	{ EmsValue::Ferien, EmsValue::HK2, SensorHK2Ferien },
-	{ EmsValue::Party, EmsValue::HK2, SensorHK2Party },
-	{ EmsValue::WarmwasserBereitung, EmsValue::None, SensorWarmwasserBereitung },
-	{ EmsValue::WarmwasserTempOK, EmsValue::None, SensorWarmwasserTempOK },
-	{ EmsValue::ZirkulationAktiv, EmsValue::None, SensorZirkulation },
-	{ EmsValue::Tagbetrieb, EmsValue::Zirkulation, SensorZirkulationTagbetrieb },
-	{ EmsValue::WWVorrang, EmsValue::None, SensorWWVorrang },
-	{ EmsValue::Tagbetrieb, EmsValue::WW, SensorWWTagbetrieb },
-	{ EmsValue::Sommerbetrieb, EmsValue::None, SensorSommerbetrieb }
-    };
+    writeValues(now, values.data(), values.size(), unchanged.data(), unchanged.size());
+}
+
+void
+Database::bufferValues(time_t now, const EmsValueList& values, const EmsValueList& unchanged)
+{
+    BufferedValues entry;
+
+    entry.time = now;
+    entry.values.assign(values.begin(), values.end());
+    entry.unchanged.assign(unchanged.begin(), unchanged.end());
+    m_bufferedValues += values.size() + unchanged.size();
+    m_buffer.push_back(entry);
+
+    /* the oldest values go first if the DB stays away for long */
+    while (m_bufferedValues > Options::dbBufferSize() && !m_buffer.empty()) {
+	size_t count = m_buffer.front().values.size() + m_buffer.front().unchanged.size();
+	m_bufferedValues -= count;
+	m_droppedValues += count;
+	m_buffer.pop_front();
+    }
+}
+
+void
+Database::replayBuffer()
+{
+    if (m_droppedValues) {
+	std::cerr << "Database buffer overflowed, " << m_droppedValues
+		  << " values were not stored" << std::endl;
+	m_droppedValues = 0;
+    }
+
+    /* with the times they were received at, so intervals come out as
+     * if the DB had been there all along */
+    while (!m_buffer.empty()) {
+	const BufferedValues& entry = m_buffer.front();
+	writeValues(entry.time, entry.values.data(), entry.values.size(),
+		    entry.unchanged.data(), entry.unchanged.size());
+	m_buffer.pop_front();
+    }
+    m_bufferedValues = 0;
+}
+
+void
+Database::writeValues(time_t now, const EmsValue *values, size_t count,
+		      const EmsValue *unchanged, size_t unchangedCount)
+{
+    PendingWrites writes(now);
+
+    for (size_t i = 0; i < count; i++) {
+	handleValue(writes, values[i]);
+    }
+    for (size_t i = 0; i < unchangedCount; i++) {
+	handleValue(writes, unchanged[i]);
+    }
+
+    if (!m_connection) {
+	return;
+    }
+
+    writeTable(numericTableName, writes.timestamp, writes.numericUpdates,
+	       writes.numericRows, m_numericCache, m_numericEndtimes);
+    writeTable(booleanTableName, writes.timestamp, writes.booleanUpdates,
+	       writes.booleanRows, m_booleanCache, m_booleanEndtimes);
+    writeTable(stateTableName, writes.timestamp, writes.stateUpdates,
+	       writes.stateRows, m_stateCache, m_stateEndtimes);
+
+    if (!writes.aggregateRows.empty()) {
+	mysqlpp::Query query = m_connection->query();
+	query.insert(writes.aggregateRows.begin(), writes.aggregateRows.end());
+	executeQuery(query);
+    }
+    writeCurrentValues(writes);
+
+    if (writes.now - m_lastCheckpoint >= (time_t) Options::dbCheckpointInterval()) {
+	flushEndtimes();
+	m_lastCheckpoint = writes.now;
+    }
+    if (writes.now - m_lastPartitionCheck >= PartitionCheckInterval) {
+	extendPartitions(writes.now);
+    }
+}
+
+void
+Database::extendPartitions(time_t now)
+{
+    Schema::extendPartitions(*m_connection, numericTableName, now);
+    Schema::extendPartitions(*m_connection, booleanTableName, now);
+    Schema::extendPartitions(*m_connection, stateTableName, now);
+    if (Options::rateLimitAggregate()) {
+	Schema::extendPartitions(*m_connection, aggregateTableName, now);
+    }
+    m_lastPartitionCheck = now;
+}
 
-    static const struct {
-	EmsValue::Type type;
-	StateSensors sensor;
-    } STATEMAPPING[] = {
-	{ EmsValue::FehlerCode, SensorFehlerCode },
-	{ EmsValue::ServiceCode, SensorServiceCode }
+bool
+Database::migrateSchema(const std::string& server, const std::string& user,
+			const std::string& password)
+{
+    const char *tables[] = {
+	numericTableName, booleanTableName, stateTableName, aggregateTableName
     };
+    mysqlpp::Connection connection;
 
-    EmsValue::Type type = value.getType();
-    EmsValue::SubType subtype = value.getSubType();
+    if (!connection.connect(dbName, server.c_str(), user.c_str(), password.c_str())) {
+	std::cerr << "Could not connect to database: " << connection.error() << std::endl;
+	return false;
+    }
 
-    for (size_t i = 0; i < sizeof(NUMERICMAPPING) / sizeof(NUMERICMAPPING[0]); i++) {
-	if (type == NUMERICMAPPING[i].type && subtype == NUMERICMAPPING[i].subtype) {
-	    float numValue = value.getValue<float>();
-	    if (!std::isnan(numValue)) {
-		addSensorValue(NUMERICMAPPING[i].sensor, numValue);
-	    }
-	    return;
+    for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+	if (!Schema::migrateTable(connection, tables[i], Options::migrateBatchSize())) {
+	    return false;
+	}
+    }
+
+    try {
+	mysqlpp::Query query = connection.query();
+	query << "alter table sensors engine InnoDB";
+	query.execute();
+	addSensorColumns(query);
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not migrate sensors: " << e.what() << std::endl;
+	return false;
+    }
+
+    if (Options::dbFixedPoint()) {
+	return Schema::convertToFixedPoint(connection, numericTableName);
+    }
+
+    return true;
+}
+
+void
+Database::flushEndtimes()
+{
+    if (!m_connection) {
+	return;
+    }
+
+    writeEndtimes(numericTableName, m_numericEndtimes);
+    writeEndtimes(booleanTableName, m_booleanEndtimes);
+    writeEndtimes(stateTableName, m_stateEndtimes);
+}
+
+void
+Database::writeEndtimes(const char *table, std::map<mysqlpp::ulonglong, time_t>& endtimes)
+{
+    if (endtimes.empty()) {
+	return;
+    }
+
+    mysqlpp::Query query = m_connection->query();
+    bool first = true;
+
+    query << "update " << table << " set endtime = case id";
+    for (auto& entry : endtimes) {
+	query << " when " << entry.first << " then '" << mysqlpp::sql_datetime(entry.second) << "'";
+    }
+    query << " end where id in (";
+    for (auto& entry : endtimes) {
+	query << (first ? "" : ",") << entry.first;
+	first = false;
+    }
+    query << ")";
+
+    /* on failure, keep them for the next checkpoint */
+    if (executeQuery(query)) {
+	endtimes.clear();
+    }
+}
+
+bool
+Database::readNumericHistory(time_t from, time_t to,
+			     const std::map<unsigned int, Downsampler>& series,
+			     const HistorySeriesHandler& seriesHandler,
+			     const HistoryDoneHandler& doneHandler)
+{
+    if (!m_ready.load(std::memory_order_acquire)) {
+	return false;
+    }
+    {
+	boost::mutex::scoped_lock lock(m_serviceLock);
+	if (!m_service) {
+	    return false;
 	}
     }
-    for (size_t i = 0; i < sizeof(INTEGERMAPPING) / sizeof(INTEGERMAPPING[0]); i++) {
-	if (type == INTEGERMAPPING[i].type && subtype == INTEGERMAPPING[i].subtype) {
-	    addSensorValue(INTEGERMAPPING[i].sensor, value.getValue<unsigned int>());
+
+    boost::shared_ptr<HistoryQuery> query(new HistoryQuery);
+    query->id = ++m_lastHistoryQuery;
+    query->from = from;
+    query->to = to;
+    query->series = series;
+    /* open intervals may have been extended since the last checkpoint */
+    query->endtimes = m_numericEndtimes;
+    if (m_fixedPoint) {
+	for (auto& entry : series) {
+	    query->scales[entry.first] = getScale(entry.first);
+	}
+    }
+
+    HistoryHandlers& handlers = m_historyHandlers[query->id];
+    handlers.series = seriesHandler;
+    handlers.done = doneHandler;
+
+    if (!m_historyThread.joinable()) {
+	m_historyWork.reset(new boost::asio::io_service::work(m_historyService));
+	m_historyThread = startThread(boost::bind(&Database::historyLoop, this));
+    }
+    m_historyService.post(boost::bind(&Database::runHistoryQuery, this, query));
+
+    return true;
+}
+
+void
+Database::historyLoop()
+{
+    mysqlpp::Connection::thread_start();
+    m_historyService.run();
+
+    delete m_historyConnection;
+    m_historyConnection = NULL;
+    mysqlpp::Connection::thread_end();
+}
+
+/* on the history thread; only the results go back to the IO thread, so
+ * the handlers and what they keep alive are never released here */
+void
+Database::runHistoryQuery(const boost::shared_ptr<HistoryQuery>& history)
+{
+    bool success = false;
+
+    if (!m_historyConnection) {
+	m_historyConnection = new mysqlpp::Connection();
+	m_historyConnection->set_option(new mysqlpp::ReconnectOption(true));
+	m_historyConnection->set_option(new mysqlpp::ConnectTimeoutOption(10));
+	if (!m_historyConnection->connect(dbName, m_server.c_str(),
+					  m_user.c_str(), m_password.c_str())) {
+	    std::cerr << "Could not connect to database for history: "
+		      << m_historyConnection->error() << std::endl;
+	    delete m_historyConnection;
+	    m_historyConnection = NULL;
+	    postHistoryResult(boost::bind(&Database::handleHistoryDone, this, history->id, false));
 	    return;
 	}
     }
-    for (size_t i = 0; i < sizeof(BOOLMAPPING) / sizeof(BOOLMAPPING[0]); i++) {
-	if (type == BOOLMAPPING[i].type) {
-	    if (BOOLMAPPING[i].subtype == EmsValue::None || subtype == BOOLMAPPING[i].subtype) {
-		addSensorValue(BOOLMAPPING[i].sensor, value.getValue<bool>());
-		return;
+
+    mysqlpp::Query query = m_historyConnection->query();
+    std::map<unsigned int, Downsampler>::iterator current = history->series.end();
+    bool first = true;
+
+    /* for the usual ranges up to now, the (sensor, endtime) key limits
+     * the scan to the rows within the range */
+    query << "select id, sensor, value, unix_timestamp(starttime) starttime, "
+	  << "unix_timestamp(endtime) endtime from " << numericTableName
+	  << " where sensor in (";
+    for (auto& entry : history->series) {
+	query << (first ? "" : ",") << entry.first;
+	first = false;
+    }
+    query << ") and endtime >= '" << mysqlpp::sql_datetime(history->from) << "' "
+	  << "and starttime < '" << mysqlpp::sql_datetime(history->to) << "' "
+	  << "order by sensor, starttime, id";
+
+    try {
+	/* the rows are passed on as they arrive instead of being stored,
+	 * and each sensor as soon as its last row is read */
+	mysqlpp::UseQueryResult res = query.use();
+	while (mysqlpp::Row row = res.fetch_row()) {
+	    unsigned int sensor = (unsigned int) row["sensor"];
+	    if (current == history->series.end() || current->first != sensor) {
+		if (current != history->series.end()) {
+		    current->second.finish();
+		    postHistoryResult(boost::bind(&Database::handleHistorySeries, this,
+						  history->id, current->first, current->second));
+		}
+		current = history->series.find(sensor);
+		if (current == history->series.end()) {
+		    continue;
+		}
+	    }
+
+	    mysqlpp::ulonglong id = (mysqlpp::ulonglong) row["id"];
+	    time_t start = (time_t) (unsigned long) row["starttime"];
+	    time_t end = (time_t) (unsigned long) row["endtime"];
+	    float value = (float) row["value"];
+
+	    std::map<mysqlpp::ulonglong, time_t>::const_iterator pending = history->endtimes.find(id);
+	    if (pending != history->endtimes.end()) {
+		end = std::max(end, pending->second);
+	    }
+	    std::map<unsigned int, float>::const_iterator scale = history->scales.find(sensor);
+	    if (scale != history->scales.end()) {
+		value /= scale->second;
+	    }
+
+	    start = std::max(start, history->from);
+	    end = std::min(end, history->to);
+	    current->second.add(start, value);
+	    if (end > start) {
+		current->second.add(end, value);
 	    }
 	}
-    }
-    for (size_t i = 0; i < sizeof(STATEMAPPING) / sizeof(STATEMAPPING[0]); i++) {
-	if (type == STATEMAPPING[i].type) {
-	    addSensorValue(STATEMAPPING[i].sensor, value.getValue<std::string>());
+	if (current != history->series.end()) {
+	    current->second.finish();
+	    postHistoryResult(boost::bind(&Database::handleHistorySeries, this,
+					  history->id, current->first, current->second));
 	}
+	success = true;
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not read history: " << e.what() << std::endl;
     }
+
+    postHistoryResult(boost::bind(&Database::handleHistoryDone, this, history->id, success));
 }
 
 void
-Database::addSensorValue(NumericSensors sensor, float value)
+Database::postHistoryResult(const boost::function<void ()>& handler)
 {
-    time_t now = time(NULL);
-    if (!m_connection || !checkAndUpdateRateLimit(sensor, now)) {
+    boost::mutex::scoped_lock lock(m_serviceLock);
+    if (m_service) {
+	m_service->post(handler);
+    }
+}
+
+void
+Database::handleHistorySeries(unsigned int id, unsigned int sensor, const Downsampler& series)
+{
+    std::map<unsigned int, HistoryHandlers>::iterator iter = m_historyHandlers.find(id);
+    if (iter != m_historyHandlers.end()) {
+	iter->second.series(sensor, series);
+    }
+}
+
+void
+Database::handleHistoryDone(unsigned int id, bool success)
+{
+    std::map<unsigned int, HistoryHandlers>::iterator iter = m_historyHandlers.find(id);
+    if (iter != m_historyHandlers.end()) {
+	HistoryDoneHandler handler = iter->second.done;
+	m_historyHandlers.erase(iter);
+	handler(success);
+    }
+}
+
+void
+Database::writeCurrentValues(const PendingWrites& writes)
+{
+    if (writes.numericCurrent.empty() && writes.booleanCurrent.empty() &&
+	    writes.stateCurrent.empty()) {
 	return;
     }
 
     mysqlpp::Query query = m_connection->query();
+    const char *separator = "";
+
+    /* enough digits to get the same float back */
+    query << std::setprecision(9);
+    query << "insert into " << currentTableName
+	  << " (sensor, numeric_value, boolean_value, state_value, starttime) values ";
+    for (auto& entry : writes.numericCurrent) {
+	query << separator << "(" << entry.first << ", " << entry.second
+	      << ", NULL, NULL, '" << writes.timestamp << "')";
+	separator = ", ";
+    }
+    for (auto& entry : writes.booleanCurrent) {
+	query << separator << "(" << entry.first << ", NULL, " << (entry.second ? 1 : 0)
+	      << ", NULL, '" << writes.timestamp << "')";
+	separator = ", ";
+    }
+    for (auto& entry : writes.stateCurrent) {
+	query << separator << "(" << entry.first << ", NULL, NULL, "
+	      << mysqlpp::quote << entry.second << ", '" << writes.timestamp << "')";
+	separator = ", ";
+    }
+    query << " on duplicate key update numeric_value = values(numeric_value), "
+	  << "boolean_value = values(boolean_value), state_value = values(state_value), "
+	  << "starttime = values(starttime)";
+
+    /* on failure, the values are written with their next change */
+    if (executeQuery(query)) {
+	updateCurrentValues(writes.numericCurrent, m_numericCurrent);
+	updateCurrentValues(writes.booleanCurrent, m_booleanCurrent);
+	updateCurrentValues(writes.stateCurrent, m_stateCurrent);
+    }
+}
+
+/* the windows still open at exit */
+void
+Database::flushAggregates()
+{
+    PendingWrites writes(time(NULL));
+
+    for (auto& entry : m_aggregates) {
+	queueAggregate(writes, entry.first, entry.second);
+    }
+    m_aggregates.clear();
+
+    if (!writes.aggregateRows.empty()) {
+	mysqlpp::Query query = m_connection->query();
+	query.insert(writes.aggregateRows.begin(), writes.aggregateRows.end());
+	executeQuery(query);
+    }
+}
+
+template<typename Row> void
+Database::insertRows(mysqlpp::Query& query, const std::vector<Row>& rows)
+{
+    query.insert(rows.begin(), rows.end());
+}
+
+/* in fixed-point format, values are stored multiplied by their scale */
+template<> void
+Database::insertRows(mysqlpp::Query& query, const std::vector<NumericSensorValue>& rows)
+{
+    if (!m_fixedPoint) {
+	query.insert(rows.begin(), rows.end());
+	return;
+    }
+
+    std::vector<NumericSensorValue> scaled(rows);
+    for (auto& row : scaled) {
+	row.value = std::round(row.value * getScale(row.sensor));
+    }
+    query.insert(scaled.begin(), scaled.end());
+}
+
+template<typename Row, typename T> void
+Database::writeTable(const char *table, const mysqlpp::sql_datetime& timestamp,
+		     const std::vector<mysqlpp::ulonglong>& updates,
+		     const std::vector<Row>& rows, std::map<unsigned int, T>& cache,
+		     std::map<mysqlpp::ulonglong, time_t>& endtimes)
+{
+    mysqlpp::Query query = m_connection->query();
+
+    if (!updates.empty()) {
+	/* the closing update supersedes any end time kept in memory */
+	for (size_t i = 0; i < updates.size(); i++) {
+	    endtimes.erase(updates[i]);
+	}
+	query << "update " << table << " set endtime ='" << timestamp << "' where id in (";
+	for (size_t i = 0; i < updates.size(); i++) {
+	    query << (i > 0 ? "," : "") << updates[i];
+	}
+	query << ")";
+	executeQuery(query);
+    }
+
+    if (!rows.empty()) {
+	insertRows(query, rows);
+	if (!executeQuery(query)) {
+	    return;
+	}
+
+	/* the ids of a multi-row insert need not be consecutive (e.g. with
+	 * innodb_autoinc_lock_mode=2), so they are read back by the key of
+	 * each row; rows of the swinging door start before the timestamp */
+	for (size_t i = 0; i < rows.size(); i++) {
+	    m_lastInsertIds[rows[i].sensor] = 0;
+	    cache[rows[i].sensor] = rows[i].value;
+	}
+	query << "select id, sensor from " << table << " where ";
+	Schema::appendKeyCondition(query, rows);
+	query << " order by id";
+	try {
+	    /* with duplicate start times, the highest id wins */
+	    mysqlpp::StoreQueryResult res = query.store();
+	    for (size_t i = 0; i < res.num_rows(); i++) {
+		m_lastInsertIds[(unsigned int) res[i]["sensor"]] = (mysqlpp::ulonglong) res[i]["id"];
+	    }
+	} catch (const mysqlpp::Exception& e) {
+	    /* the sensors without id start new rows with their next value */
+	    std::cerr << "Could not read back ids from " << table << ": "
+		      << e.what() << std::endl;
+	}
+    }
+}
+
+void
+Database::handleValue(PendingWrites& writes, const EmsValue& value)
+{
+    SensorRegistry::Entry sensor = m_sensors.lookup(value.getType(), value.getSubType());
+
+    if (!sensor.id) {
+	if (!m_connection || !Options::autoRegisterSensors()) {
+	    return;
+	}
+	sensor = m_sensors.addAutomatic(value);
+	if (!sensor.id) {
+	    return;
+	}
+	writeSensorRow(m_sensors.sensors().back());
+    }
+
+    /* the reading type is checked as well, as configured sensors
+     * may not match the values they are mapped to */
+    switch (sensor.valueType) {
+	case SensorRegistry::Numeric:
+	    if (value.getReadingType() == EmsValue::Numeric) {
+		float numValue = value.getValue<float>();
+		if (!std::isnan(numValue)) {
+		    updateScale(sensor.id, value.getDivider());
+		    addSensorValue(writes, sensor.id, numValue);
+		}
+	    } else if (value.getReadingType() == EmsValue::Integer) {
+		updateScale(sensor.id, 1);
+		addSensorValue(writes, sensor.id, (float) value.getValue<unsigned int>());
+	    }
+	    break;
+	case SensorRegistry::Boolean:
+	    if (value.getReadingType() == EmsValue::Boolean) {
+		addSensorValue(writes, sensor.id, value.getValue<bool>());
+	    }
+	    break;
+	case SensorRegistry::State:
+	    if (value.getReadingType() == EmsValue::Formatted) {
+		addSensorValue(writes, sensor.id, value.getValue<std::string>());
+	    }
+	    break;
+    }
+}
+
+void
+Database::addSensorValue(PendingWrites& writes, unsigned int sensor, float value)
+{
+    if (!m_connection) {
+	return;
+    }
+
+    queueCurrentValue(writes.numericCurrent, m_numericCurrent, sensor, value);
+
+    std::map<unsigned int, StoragePolicy>::iterator policyIter = m_policies.find(sensor);
+    if (policyIter != m_policies.end()) {
+	addPolicyValue(writes, sensor, value, policyIter->second);
+	return;
+    }
+
+    bool newWindow = checkAndUpdateRateLimit(sensor, writes.now);
+    if (Options::rateLimitAggregate() && Options::rateLimit() > 0) {
+	addAggregateValue(writes, sensor, value, newWindow);
+    }
+    if (!newWindow) {
+	return;
+    }
+
     std::map<unsigned int, float>::iterator cacheIter = m_numericCache.find(sensor);
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_numericCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
 
-    if (idValid) {
-	query << "update " << numericTableName << " set endtime ='" << timestamp
-	      << "' where id = " << idIter->second;
-	executeQuery(query);
+    if (idValid && valueChanged) {
+	writes.numericUpdates.push_back(idIter->second);
+    } else if (idValid) {
+	/* same interval, written on change, at checkpoints and at exit */
+	m_numericEndtimes[idIter->second] = writes.now;
     }
 
     if (valueChanged || !idValid) {
-	NumericSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
-	if (executeQuery(query)) {
-	    m_lastInsertIds[sensor] = query.insert_id();
-	    m_numericCache[sensor] = value;
-	}
+	queueRow(writes.numericRows, sensor, value, writes.timestamp);
     }
 }
 
+/* a value passing the rate limit closes the window of the previous one
+ * and opens its own; windows with a single value are not stored, as
+ * that value is the one in the data table */
 void
-Database::addSensorValue(BooleanSensors sensor, bool value)
+Database::addAggregateValue(PendingWrites& writes, unsigned int sensor, float value,
+			    bool newWindow)
+{
+    std::map<unsigned int, Aggregate>::iterator iter = m_aggregates.find(sensor);
+
+    if (iter != m_aggregates.end() && !newWindow) {
+	Aggregate& aggregate = iter->second;
+	aggregate.end = writes.now;
+	aggregate.min = std::min(aggregate.min, value);
+	aggregate.max = std::max(aggregate.max, value);
+	aggregate.sum += value;
+	aggregate.count++;
+	return;
+    }
+
+    if (iter != m_aggregates.end()) {
+	queueAggregate(writes, sensor, iter->second);
+    }
+
+    Aggregate& aggregate = m_aggregates[sensor];
+    aggregate.start = aggregate.end = writes.now;
+    aggregate.min = aggregate.max = value;
+    aggregate.sum = value;
+    aggregate.count = 1;
+}
+
+void
+Database::queueAggregate(PendingWrites& writes, unsigned int sensor,
+			 const Aggregate& aggregate)
+{
+    if (aggregate.count > 1) {
+	writes.aggregateRows.push_back(NumericAggregateValue(sensor,
+		mysqlpp::sql_datetime(aggregate.start), mysqlpp::sql_datetime(aggregate.end),
+		aggregate.min, aggregate.max, aggregate.sum / aggregate.count,
+		aggregate.count));
+    }
+}
+
+void
+Database::addPolicyValue(PendingWrites& writes, unsigned int sensor, float value,
+			 StoragePolicy& policy)
+{
+    std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
+    bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
+    float rowValue;
+    time_t rowTime;
+
+    if (!idValid) {
+	queueRow(writes.numericRows, sensor, value, writes.timestamp);
+	policy.reset(value, writes.now);
+	return;
+    }
+    if (!policy.active()) {
+	/* the open row is one recovered on startup */
+	policy.reset(m_numericCache[sensor], writes.now);
+    }
+
+    switch (policy.sample(value, writes.now, rowValue, rowTime)) {
+	case StoragePolicy::Skip:
+	    break;
+	case StoragePolicy::Extend:
+	    m_numericEndtimes[idIter->second] = writes.now;
+	    break;
+	case StoragePolicy::Store:
+	    /* the new row may start at an earlier sample */
+	    if (rowTime == writes.now) {
+		writes.numericUpdates.push_back(idIter->second);
+	    } else {
+		m_numericEndtimes[idIter->second] = rowTime;
+	    }
+	    queueRow(writes.numericRows, sensor, rowValue,
+		     mysqlpp::sql_datetime(rowTime), writes.timestamp);
+	    break;
+    }
+}
+
+void
+Database::addSensorValue(PendingWrites& writes, unsigned int sensor, bool value)
 {
-    time_t now = time(NULL);
     if (!m_connection) {
 	return;
     }
 
-    mysqlpp::Query query = m_connection->query();
+    queueCurrentValue(writes.booleanCurrent, m_booleanCurrent, sensor, value);
+
     std::map<unsigned int, bool>::iterator cacheIter = m_booleanCache.find(sensor);
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_booleanCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
 
-    if (idValid) {
-	query << "update " << booleanTableName << " set endtime ='" << timestamp
-	      << "' where id = " << idIter->second;
-	executeQuery(query);
+    if (idValid && valueChanged) {
+	writes.booleanUpdates.push_back(idIter->second);
+    } else if (idValid) {
+	/* same interval, written on change, at checkpoints and at exit */
+	m_booleanEndtimes[idIter->second] = writes.now;
     }
 
     if (valueChanged || !idValid) {
-	BooleanSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
-	if (executeQuery(query)) {
-	    m_lastInsertIds[sensor] = query.insert_id();
-	    m_booleanCache[sensor] = value;
-	}
+	queueRow(writes.booleanRows, sensor, value, writes.timestamp);
     }
 }
 
 void
-Database::addSensorValue(StateSensors sensor, const std::string& value)
+Database::addSensorValue(PendingWrites& writes, unsigned int sensor, const std::string& value)
 {
-    time_t now = time(NULL);
     if (!m_connection) {
 	return;
     }
 
-    mysqlpp::Query query = m_connection->query();
+    queueCurrentValue(writes.stateCurrent, m_stateCurrent, sensor, value);
+
     std::map<unsigned int, std::string>::iterator cacheIter = m_stateCache.find(sensor);
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_stateCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
 
-    if (idValid) {
-	query << "update " << stateTableName << " set endtime ='" << timestamp
-	      << "' where id = " << idIter->second;
-	executeQuery(query);
+    if (idValid && valueChanged) {
+	writes.stateUpdates.push_back(idIter->second);
+    } else if (idValid) {
+	/* same interval, written on change, at checkpoints and at exit */
+	m_stateEndtimes[idIter->second] = writes.now;
     }
 
     if (valueChanged || !idValid) {
-	StateSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
-	if (executeQuery(query)) {
-	    m_lastInsertIds[sensor] = query.insert_id();
-	    m_stateCache[sensor] = value;
-	}
+	queueRow(writes.stateRows, sensor, value, writes.timestamp);
     }
 }
-
@@ -20,11 +20,23 @@
 #ifndef __DATABASE_H__
 #define __DATABASE_H__
 
+#include <atomic>
+#include <deque>
 #include <map>
+#include <memory>
 #include <queue>
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include <mysql++/connection.h>
 #include <mysql++/query.h>
+#include "Downsampler.h"
 #include "EmsMessage.h"
+#include "SensorRegistry.h"
+#include "StoragePolicy.h"
+
+struct PendingWrites;
 
 class Database {
     public:
@@ -32,82 +44,122 @@ class Database {
 	~Database();
 
     public:
-	bool connect(const std::string& server, const std::string& user, const std::string& password);
+	/* connects and sets up the tables in a background thread, retrying
+	 * until it succeeds; values are buffered meanwhile */
+	void startConnecting(const std::string& server, const std::string& user,
+			     const std::string& password);
+	/* converts the tables of older versions to the current layout */
+	static bool migrateSchema(const std::string& server, const std::string& user,
+				  const std::string& password);
+	/* the io_service values are handled on, NULL while there is none;
+	 * values buffered until the DB is ready are replayed on it as soon
+	 * as it is, not only with the next message */
+	void setService(boost::asio::io_service *service);
 
     public:
-	void handleValue(const EmsValue& value);
+	/* all values of a message are written with one update and one
+	 * insert statement per table; 'unchanged' are values received
+	 * again with the same bytes, for which only the end time is updated */
+	void handleValues(const EmsValueList& values,
+			  const EmsValueList& unchanged = EmsValueList());
+	/* writes the end times of open intervals which were only extended
+	 * in memory since the last checkpoint */
+	void flushEndtimes();
+	/* gets the finished downsampler of one sensor */
+	typedef boost::function<void (unsigned int sensor, const Downsampler& series)> HistorySeriesHandler;
+	/* called after the last series, with false if the query failed */
+	typedef boost::function<void (bool success)> HistoryDoneHandler;
+	/* feeds the numeric values of the sensors in 'series' between 'from'
+	 * and 'to' into their downsamplers, as start and end point of every
+	 * interval. The query runs on a worker thread with its own connection;
+	 * every downsampler with values is passed to 'seriesHandler' on the
+	 * io_service as soon as it is finished. Fails right away while the DB
+	 * is not ready or there is no io_service. */
+	bool readNumericHistory(time_t from, time_t to,
+				const std::map<unsigned int, Downsampler>& series,
+				const HistorySeriesHandler& seriesHandler,
+				const HistoryDoneHandler& doneHandler);
 
     private:
-	typedef enum {
-	    SensorKesselSollTemp = 1,
-	    SensorKesselIstTemp = 2,
-	    SensorWarmwasserSollTemp = 3,
-	    SensorWarmwasserIstTemp = 4,
-	    SensorVorlaufHK1SollTemp = 5,
-	    SensorVorlaufHK1IstTemp = 6,
-	    SensorVorlaufHK2SollTemp = 7,
-	    SensorVorlaufHK2IstTemp = 8,
-	    SensorMischersteuerung = 9,
-	    SensorRuecklaufTemp = 10,
-	    SensorAussenTemp = 11,
-	    SensorGedaempfteAussenTemp = 12,
-	    SensorRaumSollTemp = 13,
-	    SensorRaumIstTemp = 14,
-	    SensorMomLeistung = 15,
-	    SensorMaxLeistung = 16,
-	    SensorFlammenstrom = 17,
-	    SensorSystemdruck = 18,
-	    SensorBetriebszeit = 19,
-	    SensorHeizZeit = 23,
-	    SensorBrennerstarts = 20,
-	    SensorWarmwasserbereitungsZeit = 21,
-	    SensorWarmwasserBereitungen = 22,
-	    SensorPumpenModulation = 24,
-	    SensorWaermetauscherTemp = 25
-	} NumericSensors;
-
-	typedef enum {
-	    SensorFlamme = 100,
-	    SensorBrenner = 101,
-	    SensorZuendung = 102,
-	    SensorKesselPumpe = 103,
-	    /* 0 = HK, 1 = WW */
-	    Sensor3WegeVentil = 106,
-	    SensorHK1Automatik = 122,
-	    SensorHK1Tagbetrieb = 104,
-	    SensorHK1Pumpe = 116,
-	    SensorHK1Ferien = 118,
-	    SensorHK1Party = 119,
-	    SensorHK2Automatik = 123,
-	    SensorHK2Tagbetrieb = 105,
-	    SensorHK2Pumpe = 117,
-	    SensorHK2Ferien = 120,
-	    SensorHK2Party = 121,
-	    SensorWarmwasserBereitung = 110,
-	    SensorWarmwasserTempOK = 114,
-	    SensorZirkulation = 107,
-	    SensorZirkulationTagbetrieb = 124,
-	    SensorWWVorrang = 115,
-	    SensorWWTagbetrieb = 112,
-	    SensorSommerbetrieb = 113,
-	    /* not valid for DB */
-	    BooleanSensorLast = 125
-	} BooleanSensors;
+	/* numeric values of a sensor within one rate limit window */
+	struct Aggregate {
+	    time_t start;
+	    time_t end;
+	    float min;
+	    float max;
+	    double sum;
+	    unsigned int count;
+	};
+	/* a history query with everything the worker needs from the IO thread */
+	struct HistoryQuery {
+	    unsigned int id;
+	    time_t from;
+	    time_t to;
+	    std::map<unsigned int, Downsampler> series;
+	    /* by sensor, empty unless values are stored as fixed point */
+	    std::map<unsigned int, float> scales;
+	    std::map<mysqlpp::ulonglong, time_t> endtimes;
+	};
+	struct HistoryHandlers {
+	    HistorySeriesHandler series;
+	    HistoryDoneHandler done;
+	};
+	/* values of one message received before the DB was ready */
+	struct BufferedValues {
+	    time_t time;
+	    std::vector<EmsValue> values;
+	    std::vector<EmsValue> unchanged;
+	};
 
-	typedef enum {
-	    SensorServiceCode = 200,
-	    SensorFehlerCode = 201,
-	    /* not valid for DB */
-	    StateSensorLast = 202
-	} StateSensors;
+	void connectLoop();
+	void historyLoop();
+	void runHistoryQuery(const boost::shared_ptr<HistoryQuery>& query);
+	void postHistoryResult(const boost::function<void ()>& handler);
+	void handleHistorySeries(unsigned int id, unsigned int sensor, const Downsampler& series);
+	void handleHistoryDone(unsigned int id, bool success);
+	bool connect();
+	void bufferValues(time_t now, const EmsValueList& values,
+			  const EmsValueList& unchanged);
+	void replayBuffer();
+	void writeValues(time_t now, const EmsValue *values, size_t count,
+			 const EmsValue *unchanged, size_t unchangedCount);
 
-	void addSensorValue(NumericSensors sensor, float value);
-	void addSensorValue(BooleanSensors sensor, bool value);
-	void addSensorValue(StateSensors sensor, const std::string& value);
+	void handleValue(PendingWrites& writes, const EmsValue& value);
+	void addSensorValue(PendingWrites& writes, unsigned int sensor, float value);
+	void addAggregateValue(PendingWrites& writes, unsigned int sensor, float value,
+			       bool newWindow);
+	void queueAggregate(PendingWrites& writes, unsigned int sensor,
+			    const Aggregate& aggregate);
+	void addPolicyValue(PendingWrites& writes, unsigned int sensor, float value,
+			    StoragePolicy& policy);
+	void addSensorValue(PendingWrites& writes, unsigned int sensor, bool value);
+	void addSensorValue(PendingWrites& writes, unsigned int sensor, const std::string& value);
+	template<typename Row> void insertRows(mysqlpp::Query& query,
+		const std::vector<Row>& rows);
+	template<typename Row, typename T> void writeTable(const char *table,
+		const mysqlpp::sql_datetime& timestamp,
+		const std::vector<mysqlpp::ulonglong>& updates,
+		const std::vector<Row>& rows, std::map<unsigned int, T>& cache,
+		std::map<mysqlpp::ulonglong, time_t>& endtimes);
+	void writeEndtimes(const char *table, std::map<mysqlpp::ulonglong, time_t>& endtimes);
+	void extendPartitions(time_t now);
+	void flushAggregates();
+	void writeCurrentValues(const PendingWrites& writes);
 
     private:
 	bool createTables();
-	void createSensorRows();
+	bool createAggregateTable();
+	bool createCurrentValuesTable();
+	bool loadSensors();
+	void recoverIntervals();
+	template<typename T> size_t recoverIntervals(const char *table,
+		std::map<unsigned int, T>& cache);
+	void loadCurrentValues();
+	template<typename T> void loadCurrentValues(const char *column,
+		std::map<unsigned int, T>& current);
+	void writeSensorRow(const SensorRegistry::Sensor& sensor);
+	float getScale(unsigned int sensor) const;
+	void updateScale(unsigned int sensor, int divider);
 	bool checkAndUpdateRateLimit(unsigned int sensor, time_t now);
 	bool executeQuery(mysqlpp::Query& query);
 
@@ -116,25 +168,58 @@ class Database {
 	static const char *numericTableName;
 	static const char *booleanTableName;
 	static const char *stateTableName;
-
-	static const unsigned int sensorTypeNumeric = 1;
-	static const unsigned int sensorTypeBoolean = 2;
-	static const unsigned int sensorTypeState = 3;
-
-	static const unsigned int readingTypeNone = 0;
-	static const unsigned int readingTypeTemperature = 1;
-	static const unsigned int readingTypePercent = 2;
-	static const unsigned int readingTypeCurrent = 3;
-	static const unsigned int readingTypePressure = 4;
-	static const unsigned int readingTypeTime = 5;
-	static const unsigned int readingTypeCount = 6;
+	static const char *aggregateTableName;
+	static const char *currentTableName;
+	static const time_t PartitionCheckInterval = 86400;
 
 	std::map<unsigned int, time_t> m_lastWrites;
 	std::map<unsigned int, float> m_numericCache;
 	std::map<unsigned int, bool> m_booleanCache;
 	std::map<unsigned int, std::string> m_stateCache;
 	std::map<unsigned int, mysqlpp::ulonglong> m_lastInsertIds;
+	/* values last written into the current values table */
+	std::map<unsigned int, float> m_numericCurrent;
+	std::map<unsigned int, bool> m_booleanCurrent;
+	std::map<unsigned int, std::string> m_stateCurrent;
+	/* open rate limit windows, by sensor */
+	std::map<unsigned int, Aggregate> m_aggregates;
+	/* numeric values are stored as integers multiplied by the scale of
+	 * their sensor */
+	bool m_fixedPoint;
+	std::map<unsigned int, unsigned int> m_scales;
+	/* numeric sensors not subject to the global rate limit */
+	std::map<unsigned int, StoragePolicy> m_policies;
+	/* end times of open intervals (by row id) not yet written to the DB */
+	std::map<mysqlpp::ulonglong, time_t> m_numericEndtimes;
+	std::map<mysqlpp::ulonglong, time_t> m_booleanEndtimes;
+	std::map<mysqlpp::ulonglong, time_t> m_stateEndtimes;
+	time_t m_lastCheckpoint;
+	time_t m_lastPartitionCheck;
+	SensorRegistry m_sensors;
 	mysqlpp::Connection *m_connection;
+
+	std::string m_server;
+	std::string m_user;
+	std::string m_password;
+	/* until m_ready is set, the connect thread owns the connection,
+	 * the sensors and the state loaded with them */
+	boost::thread m_connectThread;
+	/* guards m_service against the connect thread */
+	boost::mutex m_serviceLock;
+	boost::asio::io_service *m_service;
+	bool m_connecting;
+	std::atomic<bool> m_ready;
+	/* the worker reading the history, with its own connection */
+	boost::asio::io_service m_historyService;
+	std::unique_ptr<boost::asio::io_service::work> m_historyWork;
+	boost::thread m_historyThread;
+	mysqlpp::Connection *m_historyConnection;
+	/* of the queries in progress, only used on the IO thread */
+	std::map<unsigned int, HistoryHandlers> m_historyHandlers;
+	unsigned int m_lastHistoryQuery;
+	std::deque<BufferedValues> m_buffer;
+	size_t m_bufferedValues;
+	size_t m_droppedValues;
 };
 
 #endif /* __DATABASE_H__ */
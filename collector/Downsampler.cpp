@@ -0,0 +1,143 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "Downsampler.h"
+
+Downsampler::Downsampler(time_t from, time_t to, unsigned int maxPoints) :
+    m_from(from),
+    m_span(std::max(to - from, (time_t) 1)),
+    m_buckets(maxPoints - 2),
+    m_currentBucket(0),
+    m_nextBucket(0)
+{
+}
+
+size_t
+Downsampler::bucketOf(time_t time) const
+{
+    if (time <= m_from) {
+	return 0;
+    }
+
+    size_t bucket = (double) (time - m_from) * m_buckets / m_span;
+    return std::min(bucket, m_buckets - 1);
+}
+
+void
+Downsampler::add(time_t time, float value)
+{
+    Point point = { time, value };
+
+    if (m_points.empty()) {
+	m_points.push_back(point);
+	return;
+    }
+
+    size_t bucket = bucketOf(time);
+
+    if (m_current.empty()) {
+	m_currentBucket = bucket;
+	m_current.push_back(point);
+    } else if (m_next.empty() && bucket <= m_currentBucket) {
+	m_current.push_back(point);
+    } else if (m_next.empty() || bucket <= m_nextBucket) {
+	if (m_next.empty()) {
+	    m_nextBucket = bucket;
+	}
+	m_next.push_back(point);
+    } else {
+	/* the next bucket is complete, so the current one can be decided */
+	selectBeforeNext();
+	m_current.swap(m_next);
+	m_currentBucket = m_nextBucket;
+	m_next.clear();
+	m_next.push_back(point);
+	m_nextBucket = bucket;
+    }
+}
+
+void
+Downsampler::finish()
+{
+    if (m_current.empty()) {
+	return;
+    }
+
+    /* the last point is kept as is and closes the last bucket */
+    Point last;
+    if (!m_next.empty()) {
+	last = m_next.back();
+	m_next.pop_back();
+    } else {
+	last = m_current.back();
+	m_current.pop_back();
+    }
+
+    if (!m_current.empty()) {
+	if (!m_next.empty()) {
+	    selectBeforeNext();
+	} else {
+	    select(m_current, last.time, last.value);
+	}
+    }
+    if (!m_next.empty()) {
+	select(m_next, last.time, last.value);
+    }
+    m_points.push_back(last);
+
+    m_current.clear();
+    m_next.clear();
+}
+
+void
+Downsampler::selectBeforeNext()
+{
+    double time = 0, value = 0;
+
+    for (size_t i = 0; i < m_next.size(); i++) {
+	time += m_next[i].time - m_next[0].time;
+	value += m_next[i].value;
+    }
+    select(m_current, m_next[0].time + time / m_next.size(), value / m_next.size());
+}
+
+void
+Downsampler::select(const std::vector<Point>& bucket, double nextTime, double nextValue)
+{
+    const Point& previous = m_points.back();
+    double nextX = nextTime - previous.time;
+    double nextY = nextValue - previous.value;
+    double maxArea = -1;
+    size_t selected = 0;
+
+    /* twice the triangle area, with the kept point as origin */
+    for (size_t i = 0; i < bucket.size(); i++) {
+	double x = bucket[i].time - previous.time;
+	double y = bucket[i].value - previous.value;
+	double area = std::fabs(x * nextY - nextX * y);
+	if (area > maxArea) {
+	    maxArea = area;
+	    selected = i;
+	}
+    }
+
+    m_points.push_back(bucket[selected]);
+}
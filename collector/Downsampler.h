@@ -0,0 +1,71 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DOWNSAMPLER_H__
+#define __DOWNSAMPLER_H__
+
+#include <ctime>
+#include <vector>
+
+/*
+ * Reduces a time series to at most a given number of points with
+ * Largest-Triangle-Three-Buckets: the first and last point are kept, the
+ * points in between are split into buckets of equal time span over the
+ * requested range, and of each bucket the point spanning the largest
+ * triangle with the point kept before and the mean of the next bucket is
+ * kept. The points must be added in time order; only the points of two
+ * buckets are held until they are decided on.
+ */
+class Downsampler
+{
+    public:
+	struct Point {
+	    time_t time;
+	    float value;
+	};
+
+    public:
+	/* maxPoints must be at least 3 */
+	Downsampler(time_t from, time_t to, unsigned int maxPoints);
+
+	void add(time_t time, float value);
+	/* decides on the remaining buckets, after which points() is complete */
+	void finish();
+	const std::vector<Point>& points() const {
+	    return m_points;
+	}
+
+    private:
+	size_t bucketOf(time_t time) const;
+	void select(const std::vector<Point>& bucket, double nextTime, double nextValue);
+	void selectBeforeNext();
+
+    private:
+	time_t m_from;
+	time_t m_span;
+	size_t m_buckets;
+	std::vector<Point> m_points;
+	/* the bucket to be decided on once the next one is complete */
+	std::vector<Point> m_current;
+	size_t m_currentBucket;
+	std::vector<Point> m_next;
+	size_t m_nextBucket;
+};
+
+#endif /* __DOWNSAMPLER_H__ */
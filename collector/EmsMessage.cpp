@@ -29,7 +29,8 @@
 EmsValue::EmsValue(Type type, SubType subType, const uint8_t *data, size_t len, int divider) :
     m_type(type),
     m_subType(subType),
-    m_readingType(Numeric)
+    m_readingType(Numeric),
+    m_divider(divider)
 {
     int value = 0;
     for (size_t i = 0; i < len; i++) {
@@ -61,6 +62,7 @@ EmsValue::EmsValue(Type type, SubType subType, uint8_t value, uint8_t bit) :
     m_type(type),
     m_subType(subType),
     m_readingType(Boolean),
+    m_divider(0),
     m_value((value & (1 << bit)) != 0)
 {
 }
@@ -69,6 +71,7 @@ EmsValue::EmsValue(Type type, SubType subType, uint8_t low, uint8_t medium, uint
     m_type(type),
     m_subType(subType),
     m_readingType(Kennlinie),
+    m_divider(0),
     m_value(std::vector<uint8_t>({ low, medium, high }))
 {
 }
@@ -77,6 +80,7 @@ EmsValue::EmsValue(Type type, SubType subType, uint8_t value) :
     m_type(type),
     m_subType(subType),
     m_readingType(Enumeration),
+    m_divider(0),
     m_value(value)
 {
 }
@@ -85,6 +89,7 @@ EmsValue::EmsValue(Type type, SubType subType, const ErrorEntry& error) :
     m_type(type),
     m_subType(subType),
     m_readingType(Error),
+    m_divider(0),
     m_value(error)
 {
 }
@@ -93,6 +98,7 @@ EmsValue::EmsValue(Type type, SubType subType, const EmsProto::DateRecord& recor
     m_type(type),
     m_subType(subType),
     m_readingType(Date),
+    m_divider(0),
     m_value(record)
 {
 }
@@ -101,6 +107,7 @@ EmsValue::EmsValue(Type type, SubType subType, const EmsProto::SystemTimeRecord&
     m_type(type),
     m_subType(subType),
     m_readingType(SystemTime),
+    m_divider(0),
     m_value(record)
 {
 }
@@ -109,12 +116,23 @@ EmsValue::EmsValue(Type type, SubType subType, const std::string& value) :
     m_type(type),
     m_subType(subType),
     m_readingType(Formatted),
+    m_divider(0),
+    m_value(value)
+{
+}
+
+EmsValue::EmsValue(Type type, SubType subType, ReadingType readingType, const Reading& value) :
+    m_type(type),
+    m_subType(subType),
+    m_readingType(readingType),
+    m_divider(0),
     m_value(value)
 {
 }
 
 EmsMessage::EmsMessage(ValueHandler& valueHandler, const std::vector<uint8_t>& data) :
     m_valueHandler(valueHandler),
+    m_previousData(NULL),
     m_data(data)
 {
     if (m_data.size() >= 4) {
@@ -135,6 +153,7 @@ EmsMessage::EmsMessage(uint8_t dest, uint8_t type, uint8_t offset,
 		       const std::vector<uint8_t>& data,
 		       bool expectResponse) :
     m_valueHandler(),
+    m_previousData(NULL),
     m_data(data),
     m_source(EmsProto::addressPC),
     m_dest(dest | (expectResponse ? 0x80 : 0)),
@@ -269,6 +288,8 @@ EmsMessage::handle()
 	    break;
     }
 
+    flushValues();
+
     if (!handled) {
 	DebugStream& dataDebug = Options::dataDebug();
 	if (dataDebug) {
@@ -280,12 +301,21 @@ EmsMessage::handle()
     }
 }
 
+void
+EmsMessage::flushValues()
+{
+    if (!m_values.empty() || !m_unchanged.empty()) {
+	m_valueHandler(m_values, m_unchanged);
+	m_values.clear();
+	m_unchanged.clear();
+    }
+}
+
 void
 EmsMessage::parseEnum(size_t offset, EmsValue::Type type, EmsValue::SubType subtype)
 {
-    if (canAccess(offset, 1)) {
-	EmsValue value(type, subtype, m_data[offset - m_offset]);
-	m_valueHandler(value);
+    if (needsDecoding(offset, 1, type, subtype)) {
+	addValue(type, subtype, m_data[offset - m_offset]);
     }
 }
 
@@ -300,9 +330,8 @@ void
 EmsMessage::parseNumeric(size_t offset, size_t size, int divider,
 			 EmsValue::Type type, EmsValue::SubType subtype)
 {
-    if (canAccess(offset, size)) {
-	EmsValue value(type, subtype, &m_data.at(offset - m_offset), size, divider);
-	m_valueHandler(value);
+    if (needsDecoding(offset, size, type, subtype)) {
+	addValue(type, subtype, &m_data.at(offset - m_offset), size, divider);
     }
 }
 
@@ -310,9 +339,8 @@ void
 EmsMessage::parseBool(size_t offset, uint8_t bit,
 		      EmsValue::Type type, EmsValue::SubType subtype)
 {
-    if (canAccess(offset, 1)) {
-	EmsValue value(type, subtype, m_data.at(offset - m_offset), bit);
-	m_valueHandler(value);
+    if (needsDecoding(offset, 1, type, subtype)) {
+	addValue(type, subtype, m_data.at(offset - m_offset), bit);
     }
 }
 
@@ -328,15 +356,15 @@ EmsMessage::parseUBAMonitorFastMessage()
     parseNumeric(15, 2, 10, EmsValue::Flammenstrom, EmsValue::None);
     parseNumeric(17, 1, 10, EmsValue::Systemdruck, EmsValue::None);
 
-    if (canAccess(18, 2)) {
+    if (needsDecoding(18, 2, EmsValue::ServiceCode, EmsValue::None)) {
 	std::ostringstream ss;
 	ss << m_data[18] << m_data[19];
-	m_valueHandler(EmsValue(EmsValue::ServiceCode, EmsValue::None, ss.str()));
+	addValue(EmsValue::ServiceCode, EmsValue::None, ss.str());
     }
-    if (canAccess(20, 2)) {
+    if (needsDecoding(20, 2, EmsValue::FehlerCode, EmsValue::None)) {
 	std::ostringstream ss;
 	ss << std::dec << (m_data[20] << 8 | m_data[21]);
-	m_valueHandler(EmsValue(EmsValue::FehlerCode, EmsValue::None, ss.str()));
+	addValue(EmsValue::FehlerCode, EmsValue::None, ss.str());
     }
 
     parseBool(7, 0, EmsValue::FlammeAktiv, EmsValue::None);
@@ -358,9 +386,9 @@ EmsMessage::parseUBAMaintenanceSettingsMessage()
 {
     parseEnum(0,EmsValue::Wartungsmeldungen, EmsValue::Kessel);
     parseInteger(1, 1, EmsValue::HektoStundenVorWartung, EmsValue::Kessel);
-    if (canAccess(2, sizeof(EmsProto::DateRecord))) {
+    if (needsDecoding(2, sizeof(EmsProto::DateRecord), EmsValue::Wartungstermin, EmsValue::Kessel)) {
 	EmsProto::DateRecord *record = (EmsProto::DateRecord *) &m_data.at(2 - m_offset);
-	m_valueHandler(EmsValue(EmsValue::Wartungstermin, EmsValue::Kessel, *record));
+	addValue(EmsValue::Wartungstermin, EmsValue::Kessel, *record);
     }
 }
 
@@ -427,7 +455,7 @@ EmsMessage::parseUBAErrorMessage()
 	unsigned int index = start / sizeof(EmsProto::ErrorRecord);
 	EmsValue::ErrorEntry entry = { m_type, index, *record };
 
-	m_valueHandler(EmsValue(EmsValue::Fehler, EmsValue::None, entry));
+	addValue(EmsValue::Fehler, EmsValue::None, entry);
 	start += sizeof(EmsProto::ErrorRecord);
     }
 }
@@ -450,10 +478,9 @@ EmsMessage::parseUBAParametersMessage()
 void
 EmsMessage::parseRCTimeMessage()
 {
-    if (canAccess(0, sizeof(EmsProto::SystemTimeRecord))) {
+    if (needsDecoding(0, sizeof(EmsProto::SystemTimeRecord), EmsValue::SystemZeit, EmsValue::None)) {
 	EmsProto::SystemTimeRecord *record = (EmsProto::SystemTimeRecord *) &m_data.at(0);
-	EmsValue value(EmsValue::SystemZeit, EmsValue::None, *record);
-	m_valueHandler(value);
+	addValue(EmsValue::SystemZeit, EmsValue::None, *record);
     }
 }
 
@@ -527,10 +554,9 @@ EmsMessage::parseRCHKMonitorMessage(EmsValue::SubType subtype)
     parseNumeric(2, 1, 2, EmsValue::SollTemp, EmsValue::Raum);
     parseNumeric(3, 2, 10, EmsValue::IstTemp, EmsValue::Raum);
 
-    if (canAccess(7, 3)) {
-	EmsValue value(EmsValue::HKKennlinie, subtype, m_data[7 - m_offset],
-		m_data[8 - m_offset], m_data[9 - m_offset]);
-	m_valueHandler(value);
+    if (needsDecoding(7, 3, EmsValue::HKKennlinie, subtype)) {
+	addValue(EmsValue::HKKennlinie, subtype, m_data[7 - m_offset],
+		 m_data[8 - m_offset], m_data[9 - m_offset]);
     }
 
     parseNumeric(14, 1, 1, EmsValue::SollTemp, subtype);
@@ -538,7 +564,15 @@ EmsMessage::parseRCHKMonitorMessage(EmsValue::SubType subtype)
     parseInteger(6, 1, EmsValue::AusschaltoptimierungsZeit, subtype);
 
     if (canAccess(15, 1) && (m_data[15 - m_offset] & 1) == 0) {
-	parseNumeric(10, 2, 100, EmsValue::TemperaturAenderung, EmsValue::Raum);
+	if (fieldChanged(15, 1)) {
+	    /* value wasn't sent before, so decode it regardless */
+	    if (canAccess(10, 2)) {
+		addValue(EmsValue::TemperaturAenderung, EmsValue::Raum,
+			 &m_data.at(10 - m_offset), 2, 100);
+	    }
+	} else {
+	    parseNumeric(10, 2, 100, EmsValue::TemperaturAenderung, EmsValue::Raum);
+	}
     }
 
     parseBool(0, 2, EmsValue::Automatikbetrieb, subtype);
@@ -20,8 +20,10 @@
 #ifndef __EMSMESSAGE_H__
 #define __EMSMESSAGE_H__
 
+#include <cstring>
 #include <vector>
 #include <ostream>
+#include <boost/container/static_vector.hpp>
 #include <boost/function.hpp>
 #include <boost/variant.hpp>
 
@@ -213,6 +215,10 @@ class EmsValue {
 	    Abgas
 	};
 
+	/* number of entries in Type and SubType, keep in sync */
+	static const unsigned int TypeCount = FehlerCode + 1;
+	static const unsigned int SubTypeCount = Abgas + 1;
+
 	enum ReadingType {
 	    Numeric,
 	    Integer,
@@ -252,6 +258,8 @@ class EmsValue {
 	EmsValue(Type type, SubType subType, const EmsProto::DateRecord& date);
 	EmsValue(Type type, SubType subType, const EmsProto::SystemTimeRecord& time);
 	EmsValue(Type type, SubType subType, const std::string& value);
+	/* for values restored from a snapshot */
+	EmsValue(Type type, SubType subType, ReadingType readingType, const Reading& value);
 
 	Type getType() const {
 	    return m_type;
@@ -262,6 +270,11 @@ class EmsValue {
 	ReadingType getReadingType() const {
 	    return m_readingType;
 	}
+	/* divider of numeric values as decoded, 0 for all others and for
+	 * values restored from a snapshot */
+	int getDivider() const {
+	    return m_divider;
+	}
 	template<typename T> const T& getValue() const {
 	    return boost::get<T>(m_value);
 	}
@@ -270,19 +283,34 @@ class EmsValue {
 	Type m_type;
 	SubType m_subType;
 	ReadingType m_readingType;
+	uint8_t m_divider;
 	Reading m_value;
 };
 
+/* values decoded from a single message; messages decoding to more values
+ * than fit are handed out in multiple lists */
+typedef boost::container::static_vector<EmsValue, 32> EmsValueList;
+/* type and subtype of values which were not decoded because their bytes
+ * did not change since the previous message */
+typedef std::pair<EmsValue::Type, EmsValue::SubType> EmsValueKey;
+typedef boost::container::static_vector<EmsValueKey, 32> EmsValueKeyList;
+
 class EmsMessage
 {
     public:
-	typedef boost::function<void (const EmsValue& value)> ValueHandler;
+	typedef boost::function<void (const EmsValueList& values,
+				      const EmsValueKeyList& unchanged)> ValueHandler;
 
 	EmsMessage(ValueHandler& valueHandler, const std::vector<uint8_t>& data);
 	EmsMessage(uint8_t dest, uint8_t type, uint8_t offset,
 		   const std::vector<uint8_t>& data, bool expectResponse);
 
 	void handle();
+	/* payload of the previous message with the same source, type and
+	 * offset; fields whose bytes are unchanged are not decoded again */
+	void setPreviousData(const std::vector<uint8_t> *data) {
+	    m_previousData = data;
+	}
 
     public:
 	uint8_t getSource() const {
@@ -328,6 +356,22 @@ class EmsMessage
 	void parseMMTempMessage();
 
     private:
+	/* constructs the value in place, arguments are those of EmsValue's
+	 * constructors */
+	template<typename... Args> void addValue(Args&&... args) {
+	    if (m_values.size() == m_values.capacity()) {
+		flushValues();
+	    }
+	    m_values.emplace_back(std::forward<Args>(args)...);
+	}
+	void addUnchanged(EmsValue::Type type, EmsValue::SubType subtype) {
+	    if (m_unchanged.size() == m_unchanged.capacity()) {
+		flushValues();
+	    }
+	    m_unchanged.push_back(EmsValueKey(type, subtype));
+	}
+	void flushValues();
+
 	void parseNumeric(size_t offset, size_t size, int divider,
 			  EmsValue::Type type, EmsValue::SubType subtype);
 	void parseInteger(size_t offset, size_t size,
@@ -340,9 +384,33 @@ class EmsMessage
 	bool canAccess(size_t offset, size_t size) {
 	    return offset >= m_offset && offset + size <= m_offset + m_data.size();
 	}
+	/* field must be accessible */
+	bool fieldChanged(size_t offset, size_t size) {
+	    if (!m_previousData || offset + size > m_offset + m_previousData->size()) {
+		return true;
+	    }
+	    return memcmp(&m_data[offset - m_offset],
+			  &m_previousData->at(offset - m_offset), size) != 0;
+	}
+	/* true if the field is present and changed, records it as
+	 * unchanged if it is present, but did not change */
+	bool needsDecoding(size_t offset, size_t size,
+			   EmsValue::Type type, EmsValue::SubType subtype) {
+	    if (!canAccess(offset, size)) {
+		return false;
+	    }
+	    if (!fieldChanged(offset, size)) {
+		addUnchanged(type, subtype);
+		return false;
+	    }
+	    return true;
+	}
 
     private:
 	ValueHandler m_valueHandler;
+	EmsValueList m_values;
+	EmsValueKeyList m_unchanged;
+	const std::vector<uint8_t> *m_previousData;
 	std::vector<unsigned char> m_data;
 	uint8_t m_source;
 	uint8_t m_dest;
@@ -0,0 +1,115 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "FrameParser.h"
+
+FrameParser::FrameParser(const FrameHandler& handler) :
+    m_handler(handler),
+    m_state(Syncing),
+    m_sawSyncStart(false),
+    m_length(0),
+    m_checkSum(0),
+    m_frameStart(0)
+{
+    /* pre-alloc buffer to avoid reallocations */
+    m_data.reserve(256);
+}
+
+uint8_t
+FrameParser::xorChecksum(const uint8_t *data, size_t length)
+{
+    uint64_t wide = 0;
+    uint8_t result = 0;
+    size_t i = 0;
+
+    /* XOR is associative, so reduce 8 bytes at a time and fold the
+     * accumulator afterwards; the compiler vectorizes this loop */
+    for (; i + sizeof(wide) <= length; i += sizeof(wide)) {
+	uint64_t word;
+	memcpy(&word, data + i, sizeof(word));
+	wide ^= word;
+    }
+    wide ^= wide >> 32;
+    wide ^= wide >> 16;
+    wide ^= wide >> 8;
+    result = wide & 0xff;
+
+    for (; i < length; i++) {
+	result ^= data[i];
+    }
+
+    return result;
+}
+
+void
+FrameParser::feed(const uint8_t *data, size_t length, uint64_t now)
+{
+    const uint8_t *pos = data;
+    const uint8_t *end = data + length;
+
+    while (pos < end) {
+	switch (m_state) {
+	    case Syncing: {
+		if (m_sawSyncStart) {
+		    m_sawSyncStart = false;
+		    if (*pos == 0x55) {
+			pos++;
+			m_state = Length;
+			m_frameStart = now;
+			break;
+		    }
+		    /* not consumed, it may start the next sync word */
+		}
+		const uint8_t *sync = (const uint8_t *) memchr(pos, 0xaa, end - pos);
+		if (!sync) {
+		    pos = end;
+		} else {
+		    pos = sync + 1;
+		    m_sawSyncStart = true;
+		}
+		break;
+	    }
+	    case Length:
+		m_length = *pos++;
+		m_data.clear();
+		m_checkSum = 0;
+		m_state = m_length > 0 ? Data : Checksum;
+		break;
+	    case Data: {
+		size_t count = std::min(m_length - m_data.size(), (size_t) (end - pos));
+		m_data.insert(m_data.end(), pos, pos + count);
+		m_checkSum ^= xorChecksum(pos, count);
+		pos += count;
+		if (m_data.size() == m_length) {
+		    m_state = Checksum;
+		}
+		break;
+	    }
+	    case Checksum:
+		if (m_checkSum == *pos) {
+		    m_handler(m_data, m_frameStart);
+		}
+		pos++;
+		m_state = Syncing;
+		break;
+	}
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRAMEPARSER_H__
+#define __FRAMEPARSER_H__
+
+#include <vector>
+#include <stdint.h>
+#include <boost/function.hpp>
+
+/*
+ * Splits the byte stream delivered by the framer into packets of the form
+ * 0xaa 0x55 <len> <len bytes of data> <XOR checksum of data>. State of
+ * partially received packets is kept across calls to feed().
+ */
+class FrameParser
+{
+    public:
+	typedef boost::function<void (const std::vector<uint8_t>& data,
+				      uint64_t rxTime)> FrameHandler;
+
+	FrameParser(const FrameHandler& handler);
+
+	/* 'now' is the arrival time of the bytes, it is passed to the
+	 * frame handler for the frame whose sync word was in them */
+	void feed(const uint8_t *data, size_t length, uint64_t now);
+
+	static uint8_t xorChecksum(const uint8_t *data, size_t length);
+
+    private:
+	typedef enum {
+	    Syncing,
+	    Length,
+	    Data,
+	    Checksum
+	} State;
+
+	FrameHandler m_handler;
+	State m_state;
+	bool m_sawSyncStart;
+	size_t m_length;
+	uint8_t m_checkSum;
+	uint64_t m_frameStart;
+	std::vector<uint8_t> m_data;
+};
+
+#endif /* __FRAMEPARSER_H__ */
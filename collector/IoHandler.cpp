@@ -19,35 +19,55 @@
 
 #include <iostream>
 #include <iomanip>
+#include <cstring>
 #include <asm/byteorder.h>
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include "IoHandler.h"
 #include "Options.h"
+#include "ValueApi.h"
 
 IoHandler::IoHandler(Database& db, ValueCache& cache) :
     boost::asio::io_service(),
     m_active(true),
+    m_timers(*this),
     m_db(db),
     m_cache(cache),
-    m_state(Syncing),
-    m_pos(0)
+    m_parser(boost::bind(&IoHandler::handleFrame, this, _1, _2)),
+    m_frameStart(0),
+    m_messageKey(0),
+    m_decodedMessages(0),
+    m_decodedValues(0),
+    m_unchangedValues(0)
 {
-    /* pre-alloc buffer to avoid reallocations */
-    m_data.reserve(256);
+    m_valueCb = boost::bind(&IoHandler::handleValues, this, _1, _2);
+
+    if (Options::useIoUring()) {
+	m_uring.reset(new IoUring(*this));
+	if (!m_uring->valid()) {
+	    std::cerr << "io_uring not available (" << strerror(m_uring->setupError())
+		      << "), using asio backend" << std::endl;
+	    m_uring.reset();
+	} else if (!m_uring->registerBuffer(m_recvBuffer, sizeof(m_recvBuffer)) &&
+		   Options::ioDebug()) {
+	    /* reads still work, only without the registered buffer */
+	    Options::ioDebug() << "IO: Could not register receive buffer" << std::endl;
+	}
+    }
 
-    m_valueCb = boost::bind(&IoHandler::handleValue, this, _1);
+    m_db.setService(this);
 }
 
 IoHandler::~IoHandler()
 {
+    m_db.setService(NULL);
 }
 
 void
 IoHandler::readComplete(const boost::system::error_code& error,
 			size_t bytesTransferred)
 {
-    size_t pos = 0;
+    uint64_t now = LatencyStats::now();
     DebugStream& debug = Options::ioDebug();
 
     if (error) {
@@ -65,50 +85,70 @@ IoHandler::readComplete(const boost::system::error_code& error,
 	debug << std::endl;
     }
 
-    while (pos < bytesTransferred) {
-	unsigned char dataByte = m_recvBuffer[pos++];
+    parseData(m_recvBuffer, bytesTransferred, now);
 
-	switch (m_state) {
-	    case Syncing:
-		if (m_pos == 0 && dataByte == 0xaa) {
-		    m_pos = 1;
-		} else if (m_pos == 1 && dataByte == 0x55) {
-		    m_state = Length;
-		    m_pos = 0;
-		} else {
-		    m_pos = 0;
-		}
-		break;
-	    case Length:
-		m_state = Data;
-		m_pos = 0;
-		m_length = dataByte;
-		m_checkSum = 0;
-		break;
-	    case Data:
-		m_data.push_back(dataByte);
-		m_checkSum ^= dataByte;
-		m_pos++;
-		if (m_pos == m_length) {
-		    m_state = Checksum;
-		}
-		break;
-	    case Checksum:
-		if (m_checkSum == dataByte) {
-		    EmsMessage message(m_valueCb, m_data);
-		    message.handle();
-		    if (message.getDestination() == EmsProto::addressPC && m_pcMessageCallback) {
-			m_pcMessageCallback(message);
-		    }
-		}
-		m_data.clear();
-		m_state = Syncing;
-		m_pos = 0;
-		break;
-	}
+    readStart();
+}
+
+void
+IoHandler::uringReadComplete(int result)
+{
+    if (result < 0) {
+	readComplete(IoUring::toError(result), 0);
+    } else if (result == 0) {
+	readComplete(boost::asio::error::eof, 0);
+    } else {
+	readComplete(boost::system::error_code(), result);
     }
+}
 
-    readStart();
+void
+IoHandler::handleFrame(const std::vector<uint8_t>& data, uint64_t rxTime)
+{
+    m_frameStart = rxTime;
+
+    EmsMessage message(m_valueCb, data);
+    std::vector<uint8_t> *previous = NULL;
+
+    m_messageKey = message.getSource() << 16 | message.getType() << 8 | message.getOffset();
+
+    /* answers to our own requests are always decoded in full */
+    if (!Options::decodeUnchanged() && message.getDestination() != EmsProto::addressPC) {
+	previous = &m_lastPayloads[m_messageKey];
+	message.setPreviousData(previous);
+    }
+
+    m_decodedMessages++;
+    message.handle();
+    if (previous) {
+	previous->assign(message.getData().begin(), message.getData().end());
+    }
+
+    if (message.getDestination() == EmsProto::addressPC && m_pcMessageCallback) {
+	m_pcMessageCallback(message);
+    }
+}
+
+void
+IoHandler::outputDecodeStats(std::ostream& stream)
+{
+    uint64_t total = m_decodedValues + m_unchangedValues;
+
+    stream << "messages: " << m_decodedMessages << std::endl;
+    stream << "values decoded: " << m_decodedValues << std::endl;
+    stream << "values unchanged: " << m_unchangedValues;
+    if (total) {
+	stream << boost::format(" (%.1f%%)") % (100.0 * m_unchangedValues / total);
+    }
+    stream << std::endl;
+}
+
+void
+IoHandler::resetDecodeStats()
+{
+    m_decodedMessages = 0;
+    m_decodedValues = 0;
+    m_unchangedValues = 0;
 }
 
 void
@@ -118,6 +158,12 @@ IoHandler::doClose(const boost::system::error_code& error)
 	std::cerr << "Error: " << error.message() << std::endl;
     }
 
+    if (Options::statsDebug()) {
+	Options::statsDebug() << "STATS: latencies since start" << std::endl;
+	LatencyStats::output(Options::statsDebug());
+	outputDecodeStats(Options::statsDebug());
+    }
+
     doCloseImpl();
     m_active = false;
     stop();
@@ -126,264 +172,31 @@ IoHandler::doClose(const boost::system::error_code& error)
 static void
 printDescriptive(std::ostream& stream, const EmsValue& value)
 {
-    static const std::map<EmsValue::Type, const char *> TYPEMAPPING = {
-	{ EmsValue::SollTemp, "Solltemperatur" },
-	{ EmsValue::IstTemp, "Isttemperatur" },
-	{ EmsValue::SetTemp, "Temperatureinstellung" },
-	{ EmsValue::MinTemp, "Minimale Temperatur" },
-	{ EmsValue::MaxTemp, "Maximale Temperatur" },
-	{ EmsValue::TagTemp, "Tagtemperatur" },
-	{ EmsValue::NachtTemp, "Nachttemperatur" },
-	{ EmsValue::UrlaubTemp, "Urlaubstemperatur" },
-	{ EmsValue::RaumEinfluss, "Max. Raumeinfluss" },
-	{ EmsValue::RaumOffset, "Raumoffset" },
-	{ EmsValue::SchwelleSommerWinter, "Schwelle Sommer/Winter" },
-	{ EmsValue::FrostSchutzTemp, "Frostschutztemperatur" },
-	{ EmsValue::AuslegungsTemp, "Auslegungstemperatur" },
-	{ EmsValue::RaumUebersteuerTemp, "Temporäre Raumtemperaturübersteuerung" },
-	{ EmsValue::AbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb" },
-	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb Urlaub" },
-	{ EmsValue::AbsenkungsAbbruchTemp, "Nachtabsenkung abbrechen unterhalb" },
-	{ EmsValue::GedaempfteTemp, "Temperatur (gedämpft)" },
-	{ EmsValue::DesinfektionsTemp, "Desinfektionstemperatur" },
-	{ EmsValue::TemperaturAenderung, "Temperaturänderung" },
-	{ EmsValue::Mischersteuerung, "Mischersteuerung" },
-	{ EmsValue::Flammenstrom, "Flammenstrom" },
-	{ EmsValue::Systemdruck, "Systemdruck" },
-	{ EmsValue::BetriebsZeit, "Betriebszeit" },
-	{ EmsValue::SollModulation, "Sollwert Modulation" },
-	{ EmsValue::IstModulation, "Istwert Modulation" },
-	{ EmsValue::MinModulation, "Min. Modulation" },
-	{ EmsValue::MaxModulation, "Max. Modulation" },
-	{ EmsValue::EinschaltHysterese, "Einschalthysterese" },
-	{ EmsValue::AusschaltHysterese, "Abschalthysterese" },
-
-	{ EmsValue::HeizZeit, "Heizzeit" },
-	{ EmsValue::WarmwasserbereitungsZeit, "WW-Bereitungszeit" },
-	{ EmsValue::Brennerstarts, "Brennerstarts" },
-	{ EmsValue::WarmwasserBereitungen, "WW-Bereitungen " },
-	{ EmsValue::EinschaltoptimierungsZeit, "Einschaltoptimierungszeit" },
-	{ EmsValue::AusschaltoptimierungsZeit, "Abschaltoptimierungszeit" },
-	{ EmsValue::AntipendelZeit, "Antipendelzeit" },
-	{ EmsValue::NachlaufZeit, "Nachlaufzeit" },
-	{ EmsValue::DesinfektionStunde, "Thermische Desinfektion Stunde" },
-	{ EmsValue::HektoStundenVorWartung, "Wartungsintervall in 100h" },
-	{ EmsValue::PausenZeit, "restl. Pausenzeit" },
-	{ EmsValue::PartyZeit, "restl. Partyzeit" },
-
-	{ EmsValue::FlammeAktiv, "Flamme" },
-	{ EmsValue::BrennerAktiv, "Brenner" },
-	{ EmsValue::ZuendungAktiv, "Zündung" },
-	{ EmsValue::PumpeAktiv, "Pumpe" },
-	{ EmsValue::ZirkulationAktiv, "Zirkulation" },
-	{ EmsValue::DreiWegeVentilAufWW, "3-Wege-Ventil auf WW" },
-	{ EmsValue::EinmalLadungAktiv, "Einmalladung" },
-	{ EmsValue::DesinfektionAktiv, "Therm. Desinfektion" },
-	{ EmsValue::NachladungAktiv, "Nachladung" },
-	{ EmsValue::WarmwasserBereitung, "WW-Bereitung" },
-	{ EmsValue::WarmwasserTempOK, "WW-Temperatur OK" },
-	{ EmsValue::Automatikbetrieb, "Automatikbetrieb" },
-	{ EmsValue::Tagbetrieb, "Tagbetrieb" },
-	{ EmsValue::Sommerbetrieb, "Sommerbetrieb" },
-	{ EmsValue::Ausschaltoptimierung, "Ausschaltoptimierung" },
-	{ EmsValue::Einschaltoptimierung, "Einschaltoptimierung" },
-	{ EmsValue::Estrichtrocknung, "Estrichtrocknung" },
-	{ EmsValue::WWVorrang, "WW-Vorrang" },
-	{ EmsValue::Ferien, "Ferienbetrieb" },
-	{ EmsValue::Urlaub, "Urlaubsbetrieb" },
-	{ EmsValue::Party, "Partybetrieb" },
-	{ EmsValue::Pause, "Pausebetrieb" },
-	{ EmsValue::Frostschutzbetrieb, "Frostschutzbetrieb" },
-	{ EmsValue::SchaltuhrEin, "Schaltuhr aktiv" },
-	{ EmsValue::KesselSchalter, "per Kesselschalter freigegeben" },
-	{ EmsValue::EigenesProgrammAktiv, "Eigenes Programm aktiv" },
-	{ EmsValue::EinmalLadungsLED, "Einmalladungs-LED" },
-	{ EmsValue::Desinfektion, "Thermische Desinfektion" },
-	{ EmsValue::ATDaempfung, "Dämpfung Außentemperatur" },
-	{ EmsValue::SchaltzeitOptimierung, "Schaltzeitoptimierung" },
-
-	{ EmsValue::WWSystemType, "WW-System-Typ" },
-	{ EmsValue::Betriebsart, "Betriebsart" },
-	{ EmsValue::Wartungsmeldungen, "Wartungsmeldungen" },
-	{ EmsValue::WartungFaellig, "Wartung fällig?" },
-	{ EmsValue::DesinfektionTag, "Thermische Desinfektion Tag" },
-	{ EmsValue::Schaltpunkte, "Schaltpunkte" },
-	{ EmsValue::GebaeudeArt, "Gebäudeart" },
-	{ EmsValue::HeizArt, "Heizart" },
-	{ EmsValue::RegelungsArt, "Regelungsart" },
-	{ EmsValue::HeizSystem, "Heizsystem" },
-	{ EmsValue::FuehrungsGroesse, "Führungsgröße" },
-	{ EmsValue::Frostschutz, "Frostschutz" },
-	{ EmsValue::UrlaubAbsenkungsArt, "Urlaubsabsenkungsart" },
-
-	{ EmsValue::HKKennlinie, "Kennlinie" },
-	{ EmsValue::Fehler, "Fehler" },
-	{ EmsValue::SystemZeit, "Systemzeit" },
-	{ EmsValue::Wartungstermin, "Wartungstermin" },
-
-	{ EmsValue::ServiceCode, "Servicecode" },
-	{ EmsValue::FehlerCode, "Fehlercode" }
-    };
-    static const std::map<EmsValue::SubType, const char *> SUBTYPEMAPPING = {
-	{ EmsValue::HK1, "HK1" },
-	{ EmsValue::HK2, "HK2" },
-	{ EmsValue::HK3, "HK3" },
-	{ EmsValue::HK4, "HK4" },
-	{ EmsValue::Kessel, "Kessel" },
-	{ EmsValue::Brenner, "Brenner" },
-	{ EmsValue::KesselPumpe, "Kesselpumpe" },
-	{ EmsValue::Ruecklauf, "Rücklauf" },
-	{ EmsValue::Waermetauscher, "Wärmetauscher" },
-	{ EmsValue::WW, "Warmwasser" },
-	{ EmsValue::Zirkulation, "Zirkulation" },
-	{ EmsValue::Raum, "Raum" },
-	{ EmsValue::Aussen, "Außen" },
-	{ EmsValue::Abgas, "Abgas" },
-    };
-    static const std::map<EmsValue::Type, const char *> UNITMAPPING = {
-	{ EmsValue::SollTemp, "°C" },
-	{ EmsValue::IstTemp, "°C" },
-	{ EmsValue::SetTemp, "°C" },
-	{ EmsValue::MinTemp, "°C" },
-	{ EmsValue::MaxTemp, "°C" },
-	{ EmsValue::TagTemp, "°C" },
-	{ EmsValue::NachtTemp, "°C" },
-	{ EmsValue::UrlaubTemp, "°C" },
-	{ EmsValue::RaumEinfluss, "K" },
-	{ EmsValue::RaumOffset, "K" },
-	{ EmsValue::SchwelleSommerWinter, "°C" },
-	{ EmsValue::FrostSchutzTemp, "°C" },
-	{ EmsValue::AuslegungsTemp, "°C" },
-	{ EmsValue::RaumUebersteuerTemp, "°C" },
-	{ EmsValue::AbsenkungsSchwellenTemp, "°C" },
-	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "°C" },
-	{ EmsValue::AbsenkungsAbbruchTemp, "°C" },
-	{ EmsValue::GedaempfteTemp, "°C" },
-	{ EmsValue::DesinfektionsTemp, "°C" },
-	{ EmsValue::TemperaturAenderung, "K/min" },
-	{ EmsValue::EinschaltHysterese, "K" },
-	{ EmsValue::AusschaltHysterese, "K" },
-	{ EmsValue::IstModulation, "%" },
-	{ EmsValue::SollModulation, "%" },
-	{ EmsValue::MinModulation, "%" },
-	{ EmsValue::MaxModulation, "%" },
-	{ EmsValue::Flammenstrom, "µA" },
-	{ EmsValue::Systemdruck, "bar" },
-	{ EmsValue::BetriebsZeit, "min" },
-	{ EmsValue::HeizZeit, "min" },
-	{ EmsValue::WarmwasserbereitungsZeit, "min" },
-	{ EmsValue::EinschaltoptimierungsZeit, "min" },
-	{ EmsValue::AusschaltoptimierungsZeit, "min" },
-	{ EmsValue::AntipendelZeit, "min" },
-	{ EmsValue::NachlaufZeit, "min" },
-	{ EmsValue::DesinfektionStunde, "h" },
-	{ EmsValue::PausenZeit, "h" },
-	{ EmsValue::PartyZeit, "h" }
-    };
-
-    static const std::map<uint8_t, const char *> WWSYSTEMMAPPING = {
-	{ EmsProto::WWSystemNone, "keins" },
-	{ EmsProto::WWSystemDurchlauf, "Durchlauferhitzer" },
-	{ EmsProto::WWSystemKlein, "klein" },
-	{ EmsProto::WWSystemGross, "groß" },
-	{ EmsProto::WWSystemSpeicherlade, "Speicherladesystem" }
-    };
-
-    static const std::map<uint8_t, const char *> ZIRKSPMAPPING = {
-	{ 0, "aus" },
-	{ 1, "1x 3min" }, { 2, "2x 3min" }, { 3, "3x 3min" },
-	{ 4, "4x 3min" }, { 5, "5x 3min" }, { 6, "6x 3min" },
-	{ 7, "dauerhaft an" }
-    };
-
-    static const std::map<uint8_t, const char *> MAINTENANCEMESSAGESMAPPING = {
-	{ 0, "keine" },
-	{ 1, "nach Betriebsstunden" },
-	{ 2, "nach Datum" }
-    };
-
-    static const std::map<uint8_t, const char *> MAINTENANCENEEDEDMAPPING = {
-	{ 0, "nein" },
-	{ 3, "ja, wegen Betriebsstunden" },
-	{ 8, "ja, wegen Datum" }
-    };
-
-    static const std::map<uint8_t, const char *> ERRORTYPEMAPPING = {
-	{ 0x10, "Verriegelnder Fehler" },
-	{ 0x11, "Blockierender Fehler" },
-	{ 0x12, "Anlagenfehler" },
-	{ 0x13, "Zurückgesetzter Anlagenfehler" }
-    };
-
-    static const std::map<uint8_t, const char *> WEEKDAYMAPPING = {
-	{ 0, "Montag" }, { 1, "Dienstag" }, { 2, "Mittwoch" }, { 3, "Donnerstag" },
-	{ 4, "Freitag" }, { 5, "Samstag" }, { 6, "Sonntag" }
-    };
-
-    static const std::map<uint8_t, const char *> OPMODEMAPPING = {
-	{ 0, "ständig aus" }, { 1, "ständig an" }, { 2, "Automatik" }
-    };
-
-
-    static const std::map<uint8_t, const char *> BUILDINGTYPEMAPPING = {
-	{ 0, "leicht" }, { 1, "mittel" }, { 2, "schwer" }
-    };
-
-    static const std::map<uint8_t, const char *> HEATINGTYPEMAPPING = {
-	{ 1, "Heizkörper" }, { 2, "Konvektor" }, { 3, "Fußboden" }, { 4, "Raumvorlauf" }
-    };
-
-    static const std::map<uint8_t, const char *> CONTROLTYPEMAPPING = {
-	{ 0, "Abschalt" }, { 1, "Reduziert" }, { 2, "Raumhalt" }, { 3, "Außenhalt" }
-    };
-
-    static const std::map<uint8_t, const char *> FROSTPROTECTMAPPING = {
-	{ 0, "kein" }, { 1, "Außentemperatur" }, { 2, "Raumtemperatur 5 Grad" }
-    };
-
-    static const std::map<uint8_t, const char *> RELEVANTVALUEMAPPING = {
-	{ 0, "außentemperaturgeführt" }, { 1, "raumtemperaturgeführt" }
-    };
-
-    static const std::map<uint8_t, const char *> VACATIONREDUCTIONMAPPING = {
-	{ 3, "Außenhalt" }, { 2, "Raumhalt" }
-    };
-
-    auto typeIter = TYPEMAPPING.find(value.getType());
-    const char *type = typeIter != TYPEMAPPING.end() ? typeIter->second : NULL;
-    auto subtypeIter = SUBTYPEMAPPING.find(value.getSubType());
-    const char *subtype = subtypeIter != SUBTYPEMAPPING.end() ? subtypeIter->second : NULL;
-
-    if (subtype) {
-	stream << subtype;
-	if (type) {
-	    stream << "-";
-	}
-    }
-    if (type) {
-	stream << type;
-    } else {
-	stream << "???";
+    const char *type = ValueApi::getTypeDescription(value.getType());
+    const char *subtype = ValueApi::getSubTypeDescription(value.getSubType());
+
+    if (*subtype) {
+	stream << subtype << "-";
     }
-    stream << " = ";
+    stream << type << " = ";
 
     switch (value.getReadingType()) {
 	case EmsValue::Numeric:
 	case EmsValue::Integer: {
-	    auto unitIter = UNITMAPPING.find(value.getType());
+	    const char *unit = ValueApi::getUnit(value.getType());
 	    if (value.getReadingType() == EmsValue::Numeric) {
 		float numValue = value.getValue<float>();
 		if (std::isnan(numValue)) {
 		    stream << "nicht verfügbar";
-		    unitIter = UNITMAPPING.end();
+		    unit = "";
 		} else {
 		    stream << numValue;
 		}
 	    } else {
 		stream << value.getValue<unsigned int>();
 	    }
-	    if (unitIter != UNITMAPPING.end()) {
-		stream << " " << unitIter->second;
+	    if (*unit) {
+		stream << " " << unit;
 	    }
 	    break;
 	}
@@ -391,33 +204,17 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	    stream << (value.getValue<bool>() ? "AN" : "AUS");
 	    break;
 	case EmsValue::Enumeration: {
-	    const std::map<uint8_t, const char *> *map = NULL;
 	    uint8_t enumValue = value.getValue<uint8_t>();
-	    switch (value.getType()) {
-		case EmsValue::WWSystemType: map = &WWSYSTEMMAPPING; break;
-		case EmsValue::Schaltpunkte: map = &ZIRKSPMAPPING; break;
-		case EmsValue::Wartungsmeldungen: map = &MAINTENANCEMESSAGESMAPPING; break;
-		case EmsValue::WartungFaellig: map = &MAINTENANCENEEDEDMAPPING; break;
-		case EmsValue::Betriebsart: map = &OPMODEMAPPING; break;
-		case EmsValue::DesinfektionTag: map = &WEEKDAYMAPPING; break;
-		case EmsValue::GebaeudeArt: map = &BUILDINGTYPEMAPPING; break;
-		case EmsValue::HeizArt:
-		case EmsValue::HeizSystem: map = &HEATINGTYPEMAPPING; break;
-		case EmsValue::RegelungsArt: map = &CONTROLTYPEMAPPING; break;
-		case EmsValue::Frostschutz: map = &FROSTPROTECTMAPPING; break;
-		case EmsValue::FuehrungsGroesse: map = &RELEVANTVALUEMAPPING; break;
-		case EmsValue::UrlaubAbsenkungsArt: map = &VACATIONREDUCTIONMAPPING; break;
-		default: break;
-	    }
-	    if (map && map->find(enumValue) != map->end()) {
-		stream << map->at(enumValue);
+	    const char *label = ValueApi::getEnumLabel(value.getType(), enumValue, true);
+	    if (label) {
+		stream << label;
 	    } else {
 		stream << "??? (" << (unsigned int) enumValue << ")";
 	    }
 	    break;
 	}
 	case EmsValue::Kennlinie: {
-	    std::vector<uint8_t> kennlinie = value.getValue<std::vector<uint8_t> >();
+	    const std::vector<uint8_t>& kennlinie = value.getValue<std::vector<uint8_t> >();
 	    stream << boost::format("-10 °C: %d °C / 0 °C: %d °C / 10 °C: %d °C")
 		    % (unsigned int) kennlinie[0] % (unsigned int) kennlinie[1]
 		    % (unsigned int) kennlinie[2];
@@ -426,7 +223,8 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	case EmsValue::Error: {
 	    EmsValue::ErrorEntry entry = value.getValue<EmsValue::ErrorEntry>();
 	    EmsProto::ErrorRecord& record = entry.record;
-	    stream << ERRORTYPEMAPPING.at(entry.type) << " " << entry.index << ": ";
+	    const char *errorType = ValueApi::getErrorTypeLabel(entry.type, true);
+	    stream << (errorType ? errorType : "???") << " " << entry.index << ": ";
 	    if (record.errorAscii[0] == 0) {
 		stream << "Leer" << std::endl;
 	    } else {
@@ -455,14 +253,16 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	}
 	case EmsValue::SystemTime: {
 	    EmsProto::SystemTimeRecord record = value.getValue<EmsProto::SystemTimeRecord>();
-	    auto dayIter = WEEKDAYMAPPING.find(record.dayOfWeek);
+	    /* the weekday labels are shared with the desinfection day */
+	    const char *day = ValueApi::getEnumLabel(EmsValue::DesinfektionTag,
+						     record.dayOfWeek, true);
 
 	    stream << boost::format("%d.%d.%d")
 		    % (unsigned int) record.common.day % (unsigned int) record.common.month
 		    % (2000 + record.common.year);
 
-	    if (dayIter != WEEKDAYMAPPING.end()) {
-		stream << " (" << dayIter->second << ")";
+	    if (day) {
+		stream << " (" << day << ")";
 	    }
 	    stream << ", " << boost::format("%d:%02d:%02d")
 		    % (unsigned int) record.common.hour % (unsigned int) record.common.minute
@@ -495,16 +295,33 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 }
 
 void
-IoHandler::handleValue(const EmsValue& value)
+IoHandler::handleValues(const EmsValueList& values, const EmsValueKeyList& unchanged)
 {
+    EmsValueList refreshed;
+
+    m_decodedValues += values.size();
+    m_unchangedValues += unchanged.size();
+
     if (Options::dataDebug()) {
-	Options::dataDebug() << "DATA: ";
-	printDescriptive(Options::dataDebug(), value);
-	Options::dataDebug() << std::endl;
+	for (size_t i = 0; i < values.size(); i++) {
+	    Options::dataDebug() << "DATA: ";
+	    printDescriptive(Options::dataDebug(), values[i]);
+	    Options::dataDebug() << std::endl;
+	}
     }
+    LatencyStats::record(LatencyStats::Decode, m_frameStart);
     if (m_valueCallback) {
-	m_valueCallback(value);
+	m_valueCallback(values, m_frameStart);
+    }
+    m_cache.streamValues(values);
+    for (size_t i = 0; i < unchanged.size(); i++) {
+	const EmsValue *value = m_cache.refreshValue(unchanged[i], m_messageKey);
+	if (value) {
+	    refreshed.push_back(*value);
+	}
     }
-    m_db.handleValue(value);
-    m_cache.handleValue(value);
+    m_db.handleValues(values, refreshed);
+    LatencyStats::record(LatencyStats::DatabaseCommit, m_frameStart);
+    m_cache.handleValues(values, m_messageKey);
+    LatencyStats::record(LatencyStats::CacheUpdate, m_frameStart);
 }
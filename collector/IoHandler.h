@@ -23,9 +23,14 @@
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <fstream>
 #include "Database.h"
 #include "EmsMessage.h"
+#include "FrameParser.h"
+#include "IoUring.h"
+#include "LatencyStats.h"
+#include "TimerWheel.h"
 #include "ValueCache.h"
 
 class IoHandler : public boost::asio::io_service
@@ -42,9 +47,21 @@ class IoHandler : public boost::asio::io_service
 	bool active() {
 	    return m_active;
 	}
+	Database& getDatabase() {
+	    return m_db;
+	}
 	ValueCache& getCache() {
 	    return m_cache;
 	}
+	TimerWheel& getTimers() {
+	    return m_timers;
+	}
+	/* NULL unless the io_uring backend is in use */
+	IoUring * getUring() {
+	    return m_uring.get();
+	}
+	void outputDecodeStats(std::ostream& stream);
+	void resetDecodeStats();
 
     protected:
 	/* maximum amount of data to read in one operation */
@@ -54,29 +71,43 @@ class IoHandler : public boost::asio::io_service
 	virtual void doCloseImpl() = 0;
 
 	virtual void readComplete(const boost::system::error_code& error, size_t bytesTransferred);
+	/* readStart() for the io_uring backend, reads fd into m_recvBuffer */
+	void readStartUring(int fd) {
+	    m_uring->read(fd, m_recvBuffer, maxReadLength,
+			  boost::bind(&IoHandler::uringReadComplete, this, _1));
+	}
+	/* splits received bytes into frames passed to handleFrame() */
+	virtual void parseData(const uint8_t *data, size_t length, uint64_t now) {
+	    m_parser.feed(data, length, now);
+	}
 	void doClose(const boost::system::error_code& error);
-	void handleValue(const EmsValue& value);
+	void handleFrame(const std::vector<uint8_t>& data, uint64_t rxTime);
+	void handleValues(const EmsValueList& values, const EmsValueKeyList& unchanged);
 
 	bool m_active;
+	TimerWheel m_timers;
 	unsigned char m_recvBuffer[maxReadLength];
+	/* after the receive buffer, as it must go away first */
+	boost::scoped_ptr<IoUring> m_uring;
 	boost::function<void (const EmsMessage& message)> m_pcMessageCallback;
-	boost::function<void (const EmsValue& value)> m_valueCallback;
+	boost::function<void (const EmsValueList& values, uint64_t rxTime)> m_valueCallback;
 
     private:
-	typedef enum {
-	    Syncing,
-	    Length,
-	    Data,
-	    Checksum
-	} State;
+	void uringReadComplete(int result);
 
+    private:
 	Database& m_db;
 	ValueCache& m_cache;
 
-	State m_state;
-	size_t m_pos, m_length;
-	uint8_t m_checkSum;
-	std::vector<uint8_t> m_data;
+	FrameParser m_parser;
+	uint64_t m_frameStart;
+	/* source << 16 | type << 8 | offset of the message being handled */
+	uint32_t m_messageKey;
+	/* last payload per message key */
+	std::map<uint32_t, std::vector<uint8_t> > m_lastPayloads;
+	uint64_t m_decodedMessages;
+	uint64_t m_decodedValues;
+	uint64_t m_unchangedValues;
 	EmsMessage::ValueHandler m_valueCb;
 };
 
@@ -0,0 +1,490 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <boost/bind.hpp>
+#include "IoUring.h"
+
+static int
+uringSetup(unsigned int entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int
+uringRegister(int fd, unsigned int opcode, const void *arg, unsigned int count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+IoUring::IoUring(boost::asio::io_service& service, unsigned int entries) :
+    m_service(service),
+    m_eventDescriptor(service),
+    m_fd(-1),
+    m_setupError(0),
+    m_sqRing(MAP_FAILED),
+    m_sqRingSize(0),
+    m_cqRing(MAP_FAILED),
+    m_cqRingSize(0),
+    m_sqes(NULL),
+    m_sqesSize(0),
+    m_unsubmitted(0),
+    m_submitScheduled(false),
+    m_processing(false),
+    m_submitCalls(0),
+    m_buffer(NULL),
+    m_bufferLength(0),
+    m_nextId(1)
+{
+    struct io_uring_params params;
+    int eventFd;
+
+    memset(&params, 0, sizeof(params));
+    m_fd = uringSetup(entries, &params);
+    if (m_fd < 0) {
+	m_setupError = errno;
+	return;
+    }
+
+    if (!probeOperations()) {
+	m_setupError = EOPNOTSUPP;
+	close(m_fd);
+	m_fd = -1;
+	return;
+    }
+
+    if (!mapRings(params)) {
+	m_setupError = errno;
+	unmapRings();
+	close(m_fd);
+	m_fd = -1;
+	return;
+    }
+
+    eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (eventFd < 0 || uringRegister(m_fd, IORING_REGISTER_EVENTFD, &eventFd, 1) < 0) {
+	m_setupError = errno;
+	if (eventFd >= 0) {
+	    close(eventFd);
+	}
+	unmapRings();
+	close(m_fd);
+	m_fd = -1;
+	return;
+    }
+
+    m_eventDescriptor.assign(eventFd);
+    waitForCompletions();
+}
+
+IoUring::~IoUring()
+{
+    if (m_fd >= 0) {
+	m_eventDescriptor.close();
+	unmapRings();
+	/* the kernel cancels whatever is still pending; handlers (and the
+	 * buffers they keep alive) are dropped only after that */
+	close(m_fd);
+    }
+    m_operations.clear();
+}
+
+/* the ring works on kernels from 5.1 on, but multishot accept and
+ * cancelling by descriptor need 5.19; as these are flags rather than
+ * operations of their own, an operation added in that version stands in
+ * for them */
+bool
+IoUring::probeOperations()
+{
+    static const uint8_t required[] = {
+	IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_SEND,
+	IORING_OP_ACCEPT, IORING_OP_ASYNC_CANCEL, IORING_OP_SOCKET
+    };
+    static const unsigned int maxOps = 256;
+    std::vector<uint8_t> buffer(sizeof(struct io_uring_probe) +
+				maxOps * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(&buffer[0]);
+
+    /* fails before 5.6, which lacks IORING_OP_READ and IORING_OP_SEND anyway */
+    if (uringRegister(m_fd, IORING_REGISTER_PROBE, probe, maxOps) < 0) {
+	return false;
+    }
+
+    for (size_t i = 0; i < sizeof(required) / sizeof(required[0]); i++) {
+	uint8_t op = required[i];
+	if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+bool
+IoUring::mapRings(const struct io_uring_params& params)
+{
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+	return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	m_cqRing = m_sqRing;
+    } else {
+	m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	if (m_cqRing == MAP_FAILED) {
+	    return false;
+	}
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+	return false;
+    }
+    m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    uint8_t *sq = static_cast<uint8_t *>(m_sqRing);
+    uint8_t *cq = static_cast<uint8_t *>(m_cqRing);
+
+    m_sqHead = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_cqHead = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    /* SQEs are always used in ring order, so the index array is fixed */
+    unsigned int *array = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+    for (unsigned int i = 0; i < m_sqEntries; i++) {
+	array[i] = i;
+    }
+
+    return true;
+}
+
+void
+IoUring::unmapRings()
+{
+    if (m_sqes) {
+	munmap(m_sqes, m_sqesSize);
+	m_sqes = NULL;
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+	munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing != MAP_FAILED) {
+	munmap(m_sqRing, m_sqRingSize);
+    }
+    m_sqRing = m_cqRing = MAP_FAILED;
+}
+
+bool
+IoUring::registerBuffer(void *data, size_t length)
+{
+    struct iovec iov;
+
+    if (m_buffer) {
+	return false;
+    }
+
+    iov.iov_base = data;
+    iov.iov_len = length;
+    if (uringRegister(m_fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+	return false;
+    }
+
+    m_buffer = static_cast<uint8_t *>(data);
+    m_bufferLength = length;
+    return true;
+}
+
+struct io_uring_sqe *
+IoUring::getSqe()
+{
+    unsigned int tail = *m_sqTail;
+
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+	submit();
+	if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+	    return NULL;
+	}
+    }
+
+    struct io_uring_sqe *sqe = &m_sqes[tail & m_sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+struct io_uring_sqe *
+IoUring::prepare(uint8_t opcode, int fd, const Handler& handler)
+{
+    struct io_uring_sqe *sqe = getSqe();
+
+    if (!sqe) {
+	/* the kernel is not taking any more work; fail like a full socket */
+	m_service.post(boost::bind(handler, -EBUSY, 0));
+	return NULL;
+    }
+
+    uint64_t id = m_nextId++;
+    Operation& op = m_operations[id];
+
+    op.handler = handler;
+    op.fd = fd;
+    op.cancelled = false;
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = id;
+    return sqe;
+}
+
+void
+IoUring::read(int fd, void *data, size_t length, const Handler& handler)
+{
+    uint8_t *start = static_cast<uint8_t *>(data);
+    bool fixed = m_buffer && start >= m_buffer &&
+		 start + length <= m_buffer + m_bufferLength;
+    struct io_uring_sqe *sqe = prepare(fixed ? IORING_OP_READ_FIXED : IORING_OP_READ,
+				       fd, handler);
+
+    if (sqe) {
+	sqe->addr = reinterpret_cast<uint64_t>(data);
+	sqe->len = length;
+	/* read from the current position, sockets and ttys have none */
+	sqe->off = (uint64_t) -1;
+	sqe->buf_index = 0;
+	scheduleSubmit();
+    }
+}
+
+void
+IoUring::send(int fd, const void *data, size_t length, const Handler& handler)
+{
+    struct io_uring_sqe *sqe = prepare(IORING_OP_SEND, fd, handler);
+
+    if (sqe) {
+	sqe->addr = reinterpret_cast<uint64_t>(data);
+	sqe->len = length;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	scheduleSubmit();
+    }
+}
+
+void
+IoUring::acceptMultishot(int fd, const Handler& handler)
+{
+    struct io_uring_sqe *sqe = prepare(IORING_OP_ACCEPT, fd, handler);
+
+    if (sqe) {
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	scheduleSubmit();
+    }
+}
+
+void
+IoUring::cancel(int fd)
+{
+    std::map<uint64_t, Operation>::iterator iter;
+    bool found = false;
+
+    for (iter = m_operations.begin(); iter != m_operations.end(); ++iter) {
+	if (iter->second.fd == fd && !iter->second.cancelled) {
+	    iter->second.cancelled = true;
+	    found = true;
+	}
+    }
+
+    if (!found) {
+	return;
+    }
+
+    /* unlike a failed read or send, a lost cancel keeps fd open. The
+     * kernel refuses new SQEs while completions wait for room in the CQ
+     * ring, so these are handled (which submits again) until it succeeds */
+    struct io_uring_sqe *sqe = getSqe();
+    for (unsigned int i = 0; !sqe && i < MaxFlushRetries; i++) {
+	processCompletions();
+	sqe = getSqe();
+    }
+    if (!sqe) {
+	std::cerr << "io_uring: could not cancel operations on fd " << fd << std::endl;
+	return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+    __atomic_store_n(m_sqTail, *m_sqTail + 1, __ATOMIC_RELEASE);
+    m_unsubmitted++;
+
+    /* the descriptor is looked up on submission, so it can't wait until
+     * the caller has closed it */
+    submit();
+    for (unsigned int i = 0; m_unsubmitted > 0 && i < MaxFlushRetries; i++) {
+	processCompletions();
+    }
+    if (m_unsubmitted > 0) {
+	std::cerr << "io_uring: could not cancel operations on fd " << fd << std::endl;
+    }
+}
+
+void
+IoUring::scheduleSubmit()
+{
+    __atomic_store_n(m_sqTail, *m_sqTail + 1, __ATOMIC_RELEASE);
+    m_unsubmitted++;
+
+    /* while processing completions, submission happens afterwards */
+    if (!m_processing && !m_submitScheduled) {
+	m_submitScheduled = true;
+	m_service.post(boost::bind(&IoUring::submit, this));
+    }
+}
+
+void
+IoUring::submit()
+{
+    m_submitScheduled = false;
+
+    while (m_unsubmitted > 0) {
+	int submitted = uringEnter(m_fd, m_unsubmitted, 0, 0);
+	m_submitCalls++;
+	if (submitted < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    /* EAGAIN/EBUSY: the SQEs stay queued for the next attempt */
+	    break;
+	}
+	m_unsubmitted -= std::min<unsigned int>(submitted, m_unsubmitted);
+	if (submitted == 0) {
+	    break;
+	}
+    }
+}
+
+void
+IoUring::waitForCompletions()
+{
+    m_eventDescriptor.async_read_some(boost::asio::null_buffers(),
+				      boost::bind(&IoUring::handleEvent, this,
+						  boost::asio::placeholders::error));
+}
+
+void
+IoUring::handleEvent(const boost::system::error_code& error)
+{
+    uint64_t count;
+
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    }
+
+    if (::read(m_eventDescriptor.native_handle(), &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN) {
+	return;
+    }
+
+    processCompletions();
+    waitForCompletions();
+}
+
+void
+IoUring::processCompletions()
+{
+    bool nested = m_processing;
+
+    /* the head is read again for every entry, as a handler may process
+     * completions itself when it cancels operations */
+    m_processing = true;
+    while (*m_cqHead != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+	unsigned int head = *m_cqHead;
+	const struct io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+	uint64_t id = cqe.user_data;
+	int result = cqe.res;
+	unsigned int flags = cqe.flags;
+
+	/* release the entry first, the handler may queue new work */
+	__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+	complete(id, result, flags);
+    }
+    m_processing = nested;
+
+    /* everything the handlers queued goes out in one call */
+    submit();
+}
+
+void
+IoUring::complete(uint64_t id, int result, unsigned int flags)
+{
+    std::map<uint64_t, Operation>::iterator iter = m_operations.find(id);
+
+    if (iter == m_operations.end()) {
+	return;
+    }
+
+    /* copy, the handler may cancel or start operations */
+    Handler handler;
+    bool cancelled = iter->second.cancelled;
+
+    if (flags & IORING_CQE_F_MORE) {
+	if (!cancelled) {
+	    handler = iter->second.handler;
+	}
+    } else {
+	handler.swap(iter->second.handler);
+	m_operations.erase(iter);
+    }
+
+    if (!cancelled && handler) {
+	handler(result, flags);
+    }
+}
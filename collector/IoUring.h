@@ -0,0 +1,139 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IOURING_H__
+#define __IOURING_H__
+
+#include <map>
+#include <linux/io_uring.h>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+/*
+ * Minimal io_uring driven from an io_service, using the raw system calls.
+ * Completions are signalled through an eventfd the io_service waits on,
+ * so all handlers run on the io_service thread like asio handlers do.
+ * Operations are only queued when started; everything queued while
+ * handling one batch of completions (or one io_service handler) goes to
+ * the kernel with a single io_uring_enter() call.
+ */
+class IoUring : private boost::noncopyable
+{
+    public:
+	/* result is the CQE result (byte count, file descriptor or -errno),
+	 * flags are the CQE flags (IORING_CQE_F_MORE for multishot ops) */
+	typedef boost::function<void (int result, unsigned int flags)> Handler;
+
+	IoUring(boost::asio::io_service& service, unsigned int entries = DefaultEntries);
+	~IoUring();
+
+	/* false if the kernel lacks io_uring or any of the operations used
+	 * here, or the ring could not be set up */
+	bool valid() const {
+	    return m_fd >= 0;
+	}
+	int setupError() const {
+	    return m_setupError;
+	}
+
+	/* registers the buffer reads are done into; reads within it use
+	 * IORING_OP_READ_FIXED, which saves pinning the pages on each read */
+	bool registerBuffer(void *data, size_t length);
+
+	void read(int fd, void *data, size_t length, const Handler& handler);
+	void send(int fd, const void *data, size_t length, const Handler& handler);
+	/* the handler is called for every accepted connection until it is
+	 * called without IORING_CQE_F_MORE */
+	void acceptMultishot(int fd, const Handler& handler);
+
+	/* cancels all operations on fd; their handlers are dropped without
+	 * being called. Must be done before closing fd, as pending operations
+	 * keep the file open. */
+	void cancel(int fd);
+	/* passes all queued operations to the kernel */
+	void submit();
+
+	static boost::system::error_code toError(int result) {
+	    return boost::system::error_code(-result, boost::system::system_category());
+	}
+
+	uint64_t submitCalls() const {
+	    return m_submitCalls;
+	}
+
+    private:
+	static const unsigned int DefaultEntries = 256;
+	/* attempts to make room in a full submission queue */
+	static const unsigned int MaxFlushRetries = 8;
+
+	struct Operation {
+	    Handler handler;
+	    int fd;
+	    bool cancelled;
+	};
+
+	bool probeOperations();
+	bool mapRings(const struct io_uring_params& params);
+	void unmapRings();
+	struct io_uring_sqe * getSqe();
+	struct io_uring_sqe * prepare(uint8_t opcode, int fd, const Handler& handler);
+	void scheduleSubmit();
+	void waitForCompletions();
+	void handleEvent(const boost::system::error_code& error);
+	void processCompletions();
+	void complete(uint64_t id, int result, unsigned int flags);
+
+    private:
+	boost::asio::io_service& m_service;
+	boost::asio::posix::stream_descriptor m_eventDescriptor;
+	int m_fd;
+	int m_setupError;
+
+	void *m_sqRing;
+	size_t m_sqRingSize;
+	void *m_cqRing;
+	size_t m_cqRingSize;
+	struct io_uring_sqe *m_sqes;
+	size_t m_sqesSize;
+
+	unsigned int *m_sqHead;
+	unsigned int *m_sqTail;
+	unsigned int m_sqMask;
+	unsigned int m_sqEntries;
+	unsigned int *m_cqHead;
+	unsigned int *m_cqTail;
+	unsigned int m_cqMask;
+	struct io_uring_cqe *m_cqes;
+
+	/* SQEs filled in, but not yet passed to io_uring_enter() */
+	unsigned int m_unsubmitted;
+	bool m_submitScheduled;
+	bool m_processing;
+	uint64_t m_submitCalls;
+
+	uint8_t *m_buffer;
+	size_t m_bufferLength;
+
+	/* keyed by user_data; 0 is used for operations without handler */
+	std::map<uint64_t, Operation> m_operations;
+	uint64_t m_nextId;
+};
+
+#endif /* __IOURING_H__ */
@@ -0,0 +1,126 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <boost/format.hpp>
+#include "LatencyStats.h"
+
+LatencyHistogram LatencyStats::m_histograms[StageCount];
+
+unsigned int
+LatencyHistogram::bucketIndex(uint64_t value)
+{
+    if (value < SubBuckets) {
+	return value;
+    }
+
+    unsigned int msb = 63 - __builtin_clzll(value);
+    unsigned int sub = (value >> (msb - SubBucketBits)) & (SubBuckets - 1);
+
+    return (msb - SubBucketBits + 1) * SubBuckets + sub;
+}
+
+uint64_t
+LatencyHistogram::bucketUpperBound(unsigned int index)
+{
+    if (index < SubBuckets) {
+	return index;
+    }
+
+    unsigned int shift = index / SubBuckets - 1;
+    uint64_t sub = index % SubBuckets;
+
+    return ((SubBuckets + sub + 1) << shift) - 1;
+}
+
+void
+LatencyHistogram::add(uint64_t nanoseconds)
+{
+    m_buckets[bucketIndex(nanoseconds)]++;
+    m_count++;
+    if (nanoseconds > m_max) {
+	m_max = nanoseconds;
+    }
+}
+
+void
+LatencyHistogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_max = 0;
+}
+
+uint64_t
+LatencyHistogram::percentile(double fraction) const
+{
+    uint64_t threshold = (uint64_t) (fraction * m_count + 0.5);
+    uint64_t seen = 0;
+
+    if (threshold == 0) {
+	threshold = 1;
+    }
+
+    for (unsigned int i = 0; i < BucketCount; i++) {
+	seen += m_buckets[i];
+	if (seen >= threshold) {
+	    return std::min(bucketUpperBound(i), m_max);
+	}
+    }
+
+    return m_max;
+}
+
+uint64_t
+LatencyStats::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+LatencyStats::output(std::ostream& stream)
+{
+    static const char * stageNames[] = {
+	"decode", "dbcommit", "cacheupdate", "clientdelivery", "buswrite"
+    };
+
+    for (unsigned int i = 0; i < StageCount; i++) {
+	const LatencyHistogram& histogram = m_histograms[i];
+	boost::format f("%s: count %d p50 %.1fus p99 %.1fus max %.1fus\n");
+
+	f % stageNames[i] % histogram.count();
+	f % (histogram.percentile(0.5) / 1000.0);
+	f % (histogram.percentile(0.99) / 1000.0);
+	f % (histogram.max() / 1000.0);
+	stream << f;
+    }
+}
+
+void
+LatencyStats::reset()
+{
+    for (unsigned int i = 0; i < StageCount; i++) {
+	m_histograms[i].reset();
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LATENCYSTATS_H__
+#define __LATENCYSTATS_H__
+
+#include <ostream>
+#include <stdint.h>
+
+class LatencyHistogram
+{
+    public:
+	LatencyHistogram() {
+	    reset();
+	}
+
+	void add(uint64_t nanoseconds);
+	void reset();
+
+	uint64_t count() const {
+	    return m_count;
+	}
+	uint64_t max() const {
+	    return m_max;
+	}
+	/* upper bound of the bucket the given fraction (0..1) falls into */
+	uint64_t percentile(double fraction) const;
+
+    private:
+	/* log-linear buckets: 4 sub buckets per power of two, so the
+	 * reported percentiles are at most 25% above the actual value */
+	static const unsigned int SubBucketBits = 2;
+	static const unsigned int SubBuckets = 1 << SubBucketBits;
+	static const unsigned int BucketCount = 64 * SubBuckets;
+
+	static unsigned int bucketIndex(uint64_t value);
+	static uint64_t bucketUpperBound(unsigned int index);
+
+	uint64_t m_buckets[BucketCount];
+	uint64_t m_count;
+	uint64_t m_max;
+};
+
+class LatencyStats
+{
+    public:
+	/* all stages are measured from the arrival of the first frame
+	 * byte, so the latency of a stage includes all stages before it;
+	 * BusWrite is measured from queueing a message for the bus */
+	typedef enum {
+	    Decode,
+	    DatabaseCommit,
+	    CacheUpdate,
+	    ClientDelivery,
+	    BusWrite,
+	    StageCount
+	} Stage;
+
+	/* monotonic time in nanoseconds */
+	static uint64_t now();
+
+	static void record(Stage stage, uint64_t since) {
+	    if (since) {
+		m_histograms[stage].add(now() - since);
+	    }
+	}
+
+	static void output(std::ostream& stream);
+	static void reset();
+
+    private:
+	static LatencyHistogram m_histograms[StageCount];
+};
+
+#endif /* __LATENCYSTATS_H__ */
@@ -0,0 +1,236 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <grp.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include "Listener.h"
+#include "IoHandler.h"
+#include "Options.h"
+
+Listener::EndpointList
+Listener::endpoints(unsigned int port, const std::string& socketPath)
+{
+    EndpointList endpoints;
+
+    if (port != 0) {
+	endpoints.push_back(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+    }
+    if (!socketPath.empty()) {
+	std::string path = socketPath;
+	if (path[0] == '@') {
+	    path[0] = '\0';
+	}
+	endpoints.push_back(boost::asio::local::stream_protocol::endpoint(path));
+    }
+
+    return endpoints;
+}
+
+Listener::Listener(IoHandler& handler, const Endpoint& endpoint,
+		   const AcceptHandler& acceptHandler) :
+    m_handler(handler),
+    m_endpoint(endpoint),
+    m_acceptor(handler),
+    m_socket(handler),
+    m_acceptHandler(acceptHandler),
+    m_local(endpoint.protocol().family() == AF_UNIX),
+    m_allowedGroup((gid_t) -1),
+    m_retryTimer(handler.getTimers())
+{
+    if (m_local) {
+	const struct sockaddr_un *addr =
+		reinterpret_cast<const struct sockaddr_un *>(endpoint.data());
+	size_t length = endpoint.size() - offsetof(struct sockaddr_un, sun_path);
+	const std::string& group = Options::socketGroup();
+	struct stat st;
+
+	if (length > 0 && addr->sun_path[0] != '\0') {
+	    m_socketPath.assign(addr->sun_path, strnlen(addr->sun_path, length));
+	    /* left over from an unclean shutdown */
+	    if (lstat(m_socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(m_socketPath.c_str());
+	    }
+	}
+
+	if (!group.empty()) {
+	    struct group *entry = getgrnam(group.c_str());
+	    if (entry) {
+		m_allowedGroup = entry->gr_gid;
+	    } else {
+		std::cerr << "Unknown socket group " << group << std::endl;
+	    }
+	}
+    }
+
+    m_acceptor.open(endpoint.protocol());
+    if (!m_local) {
+	m_acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    }
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
+
+    if (!m_socketPath.empty()) {
+	bool groupAccess = m_allowedGroup != (gid_t) -1;
+	if (chmod(m_socketPath.c_str(), groupAccess ? 0660 : 0600) != 0 ||
+		(groupAccess && chown(m_socketPath.c_str(), -1, m_allowedGroup) != 0)) {
+	    std::cerr << "Could not set permissions of " << m_socketPath
+		      << ": " << strerror(errno) << std::endl;
+	}
+    }
+
+    startAccepting();
+}
+
+Listener::~Listener()
+{
+    m_retryTimer.cancel();
+    if (m_handler.getUring()) {
+	m_handler.getUring()->cancel(m_acceptor.native_handle());
+    }
+    m_acceptor.close();
+    if (!m_socketPath.empty()) {
+	unlink(m_socketPath.c_str());
+    }
+}
+
+void
+Listener::startAccepting()
+{
+    IoUring *uring = m_handler.getUring();
+
+    if (uring) {
+	uring->acceptMultishot(m_acceptor.native_handle(),
+			       boost::bind(&Listener::handleUringAccept, this, _1, _2));
+	return;
+    }
+
+    m_acceptor.async_accept(m_socket,
+			    boost::bind(&Listener::handleAccept, this,
+					boost::asio::placeholders::error));
+}
+
+void
+Listener::handleAccept(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    }
+    if (error) {
+	/* mostly running out of descriptors or memory, which passes; the
+	 * delay keeps the error from spinning */
+	std::cerr << "Accept error: " << error.message() << ", retrying in "
+		  << AcceptRetryDelay << "ms" << std::endl;
+	m_retryTimer.start(AcceptRetryDelay, boost::bind(&Listener::startAccepting, this));
+	return;
+    }
+
+    acceptConnection();
+    startAccepting();
+}
+
+void
+Listener::handleUringAccept(int result, unsigned int flags)
+{
+    if (result < 0) {
+	if (flags & IORING_CQE_F_MORE) {
+	    /* a single connection failed, the accept goes on */
+	    std::cerr << "Accept error: " << IoUring::toError(result).message() << std::endl;
+	} else {
+	    handleAccept(IoUring::toError(result));
+	}
+	return;
+    }
+
+    boost::system::error_code error;
+
+    m_socket.assign(m_endpoint.protocol(), result, error);
+    if (error) {
+	std::cerr << "Accept error: " << error.message() << std::endl;
+	::close(result);
+    } else {
+	acceptConnection();
+    }
+
+    /* the kernel may end a multishot accept, e.g. on memory shortage */
+    if (!(flags & IORING_CQE_F_MORE)) {
+	startAccepting();
+    }
+}
+
+void
+Listener::acceptConnection()
+{
+    if (!m_local || checkCredentials()) {
+	m_acceptHandler(m_socket);
+    }
+    /* rejected, or not taken over by the handler */
+    if (m_socket.is_open()) {
+	m_socket.close();
+    }
+}
+
+bool
+Listener::checkCredentials()
+{
+    int fd = m_socket.native_handle();
+    struct ucred cred;
+    socklen_t length = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+	return false;
+    }
+    if (cred.uid == 0 || cred.uid == geteuid()) {
+	return true;
+    }
+
+    if (m_allowedGroup != (gid_t) -1) {
+	std::vector<gid_t> groups(32);
+
+	if (cred.gid == m_allowedGroup) {
+	    return true;
+	}
+
+	/* supplementary groups of the peer */
+	length = groups.size() * sizeof(gid_t);
+	int result = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, &groups[0], &length);
+	if (result != 0 && errno == ERANGE) {
+	    groups.resize(length / sizeof(gid_t));
+	    result = getsockopt(fd, SOL_SOCKET, SO_PEERGROUPS, &groups[0], &length);
+	}
+	if (result == 0) {
+	    groups.resize(length / sizeof(gid_t));
+	    if (std::find(groups.begin(), groups.end(), m_allowedGroup) != groups.end()) {
+		return true;
+	    }
+	}
+    }
+
+    std::cerr << boost::format("Rejected connection from uid %d (pid %d)")
+	    % cred.uid % cred.pid << std::endl;
+    return false;
+}
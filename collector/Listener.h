@@ -0,0 +1,83 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LISTENER_H__
+#define __LISTENER_H__
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include "TimerWheel.h"
+
+class IoHandler;
+
+/*
+ * Accepts the connections of the command or data interface on either a
+ * TCP port or a unix domain socket, through asio or io_uring. Unix socket
+ * peers are only accepted if they run as root, as the collector's user or
+ * (with --socket-group) as a member of the configured group.
+ */
+class Listener : private boost::noncopyable
+{
+    public:
+	typedef boost::asio::generic::stream_protocol::endpoint Endpoint;
+	typedef boost::asio::generic::stream_protocol::socket Socket;
+	typedef std::vector<Endpoint> EndpointList;
+	/* the handler takes over the socket by moving from it */
+	typedef boost::function<void (Socket& socket)> AcceptHandler;
+
+	/* the TCP port if not 0 and the unix socket if the path is not
+	 * empty; a path starting with '@' is in the abstract namespace */
+	static EndpointList endpoints(unsigned int port, const std::string& socketPath);
+
+	/* throws boost::system::system_error if binding fails */
+	Listener(IoHandler& handler, const Endpoint& endpoint,
+		 const AcceptHandler& acceptHandler);
+	~Listener();
+
+    private:
+	typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> Acceptor;
+
+	/* delay before accepting again after an error like EMFILE */
+	static const unsigned int AcceptRetryDelay = 1000; /* ms */
+
+	void startAccepting();
+	void handleAccept(const boost::system::error_code& error);
+	void handleUringAccept(int result, unsigned int flags);
+	void acceptConnection();
+	bool checkCredentials();
+
+    private:
+	IoHandler& m_handler;
+	Endpoint m_endpoint;
+	Acceptor m_acceptor;
+	/* the socket the next connection is accepted into */
+	Socket m_socket;
+	AcceptHandler m_acceptHandler;
+	bool m_local;
+	/* socket file to remove on close, empty for TCP and abstract sockets */
+	std::string m_socketPath;
+	gid_t m_allowedGroup;
+	TimerWheel::Timer m_retryTimer;
+};
+
+#endif /* __LISTENER_H__ */
@@ -23,11 +23,24 @@
 #include <boost/tokenizer.hpp>
 #include <boost/program_options.hpp>
 #include "Options.h"
+#include "client/ems_stream.h"
+#include "client/ems_values.h"
 
 namespace bpo = boost::program_options;
 
 std::string Options::m_target;
 unsigned int Options::m_rateLimit = 0;
+bool Options::m_rateLimitAggregate = false;
+unsigned int Options::m_dbCheckpointInterval = 0;
+unsigned int Options::m_dbRecoveryLimit = 0;
+unsigned int Options::m_dbBufferSize = 0;
+bool Options::m_decodeUnchanged = false;
+std::vector<std::string> Options::m_sensorDefinitions;
+std::vector<std::string> Options::m_storagePolicies;
+bool Options::m_autoRegisterSensors = false;
+bool Options::m_migrateSchema = false;
+bool Options::m_dbFixedPoint = false;
+unsigned int Options::m_migrateBatchSize = 0;
 DebugStream Options::m_debugStreams[DebugCount];
 std::string Options::m_pidFilePath;
 bool Options::m_daemonize = true;
@@ -36,6 +49,15 @@ std::string Options::m_dbUser;
 std::string Options::m_dbPass;
 unsigned int Options::m_commandPort = 0;
 unsigned int Options::m_dataPort = 0;
+std::string Options::m_commandSocket;
+std::string Options::m_dataSocket;
+std::string Options::m_socketGroup;
+bool Options::m_useIoUring = false;
+std::string Options::m_cacheFile;
+unsigned int Options::m_cacheSaveInterval = 0;
+std::string Options::m_valueTableName;
+std::string Options::m_valueStreamName;
+unsigned int Options::m_valueStreamSize = 0;
 
 static void
 usage(std::ostream& stream, const char *programName,
@@ -60,9 +82,24 @@ Options::parse(int argc, char *argv[])
 	("help,h", "Show this help message")
 	("ratelimit,r", bpo::value<unsigned int>(&m_rateLimit)->default_value(60),
 	 "Rate limit (in s) for writing numeric sensor values into DB")
+	("ratelimit-aggregate", bpo::bool_switch(&m_rateLimitAggregate),
+	 "Keep minimum, maximum and mean of the numeric values dropped by the rate limit "
+	 "and store them per rate limit window in the numeric_aggregates table")
+	("decode-unchanged", bpo::bool_switch(&m_decodeUnchanged),
+	 "Decode all fields of repeated messages, not only those whose bytes changed. "
+	 "Without this, unchanged values are not sent to data port clients again.")
 	("debug,d", bpo::value<std::string>()->default_value("none"),
 	 "Comma separated list of debug flags (all, io, message, data, stats, none) "
-	 " and their files, e.g. message=/tmp/messages.txt");
+	 " and their files, e.g. message=/tmp/messages.txt")
+	("io-backend", bpo::value<std::string>()->default_value("asio"),
+	 "IO backend for the bus and client connections (asio or uring). "
+	 "uring falls back to asio if the kernel does not support it.")
+	("cache-file", bpo::value<std::string>(&m_cacheFile),
+	 "File to save the value cache to, so 'cache fetch' has all values "
+	 "with their original times again right after a restart")
+	("cache-save-interval",
+	 bpo::value<unsigned int>(&m_cacheSaveInterval)->default_value(300),
+	 "Interval (in s) for saving the value cache besides at exit (0 for exit only)");
 
     bpo::options_description daemon("Daemon options");
     daemon.add_options()
@@ -80,18 +117,72 @@ Options::parse(int argc, char *argv[])
 	("db-user,u", bpo::value<std::string>(&m_dbUser)->composing(),
 	 "Database user name")
 	("db-pass,p", bpo::value<std::string>(&m_dbPass)->composing(),
-	 "Database password");
+	 "Database password")
+	("sensor", bpo::value<std::vector<std::string> >(&m_sensorDefinitions)->composing(),
+	 "Additional sensor to store in the DB, as <id>,<numeric|boolean|state>,"
+	 "<subtype|none|any>,<type>,<name>[,<reading type>,<unit>,<precision>], "
+	 "e.g. 26,numeric,hk3,currenttemperature,Vorlauf HK3-Ist-Temperatur")
+	("storage-policy", bpo::value<std::vector<std::string> >(&m_storagePolicies)->composing(),
+	 "Storage policy replacing the rate limit for a numeric sensor, as <id>,onchange, "
+	 "<id>,ratelimit,<s>, <id>,deadband,<delta>[%] or "
+	 "<id>,swingingdoor,<max error>[,<max row length in s>], "
+	 "e.g. 26,swingingdoor,0.5")
+	("auto-register-sensors", bpo::bool_switch(&m_autoRegisterSensors),
+	 "Store values without a sensor definition as new sensors")
+	("db-checkpoint-interval",
+	 bpo::value<unsigned int>(&m_dbCheckpointInterval)->default_value(300),
+	 "Interval (in s) for writing the end times of unchanged values into the DB; "
+	 "they are written on change and at exit as well (0 to write them immediately)")
+	("db-recovery-limit",
+	 bpo::value<unsigned int>(&m_dbRecoveryLimit)->default_value(900),
+	 "Maximum age (in s) of the last DB row of a sensor to be continued after "
+	 "a restart if the value is unchanged (0 to always start new rows)")
+	("db-buffer-size",
+	 bpo::value<unsigned int>(&m_dbBufferSize)->default_value(100000),
+	 "Number of values kept in memory while the DB is not yet reachable; "
+	 "they are stored with their original times once it is")
+	("migrate-schema", bpo::bool_switch(&m_migrateSchema),
+	 "Convert the tables of older versions to InnoDB, clustered by sensor and start "
+	 "time and partitioned by month, and exit. A running collector keeps writing "
+	 "meanwhile; the old tables are kept as <table>_myisam.")
+	("db-fixed-point", bpo::bool_switch(&m_dbFixedPoint),
+	 "Store numeric values as integers multiplied by the divider of their sensor, "
+	 "which is recorded in the sensors table. Applies to new tables; with "
+	 "--migrate-schema, existing ones are converted (stop the collector first).")
+	("migrate-batch-size",
+	 bpo::value<unsigned int>(&m_migrateBatchSize)->default_value(10000),
+	 "Number of rows copied per statement when migrating the tables");
 
-    bpo::options_description tcp("TCP options");
+    bpo::options_description tcp("Client interface options");
     tcp.add_options()
 	("command-port,C", bpo::value<unsigned int>(&m_commandPort)->composing(),
 	 "TCP port for remote command interface (0 to disable)")
 	("data-port,D", bpo::value<unsigned int>(&m_dataPort)->composing(),
-	 "TCP port for broadcasting live sensor data (0 to disable)");
+	 "TCP port for broadcasting live sensor data (0 to disable)")
+	("command-socket", bpo::value<std::string>(&m_commandSocket)->composing(),
+	 "Unix domain socket for the command interface, "
+	 "@<name> for the abstract namespace")
+	("data-socket", bpo::value<std::string>(&m_dataSocket)->composing(),
+	 "Unix domain socket for broadcasting live sensor data, "
+	 "@<name> for the abstract namespace")
+	("socket-group", bpo::value<std::string>(&m_socketGroup)->composing(),
+	 "Group allowed to connect to the unix domain sockets besides root "
+	 "and the collector's user")
+	("value-table",
+	 bpo::value<std::string>(&m_valueTableName)->implicit_value(EMS_VALUES_DEFAULT_NAME),
+	 "Publish the current values in a shared memory table of this name "
+	 "(default " EMS_VALUES_DEFAULT_NAME ") for local readers, see client/ems_values.h")
+	("value-stream",
+	 bpo::value<std::string>(&m_valueStreamName)->implicit_value(EMS_STREAM_DEFAULT_NAME),
+	 "Publish all decoded values in a shared memory ring of this name "
+	 "(default " EMS_STREAM_DEFAULT_NAME ") for local readers, see client/ems_stream.h")
+	("value-stream-size",
+	 bpo::value<unsigned int>(&m_valueStreamSize)->default_value(16384),
+	 "Number of values kept in the shared memory ring (rounded up to a power of two)");
 
     bpo::options_description hidden("Hidden options");
     hidden.add_options()
-	("target", bpo::value<std::string>(&m_target), "Connection target (serial:<device> or tcp:<host>:<port>)");
+	("target", bpo::value<std::string>(&m_target), "Connection target (serial:<device>, rawserial:<device> or tcp:<host>:<port>)");
 
     bpo::options_description options;
     options.add(general);
@@ -139,7 +230,7 @@ Options::parse(int argc, char *argv[])
     }
 
     /* check for missing variables */
-    if (!variables.count("target")) {
+    if (!variables.count("target") && !m_migrateSchema) {
 	usage(std::cerr, argv[0], visible);
 	return ParseFailure;
     }
@@ -148,6 +239,15 @@ Options::parse(int argc, char *argv[])
 	m_daemonize = false;
     }
 
+    std::string backend = variables["io-backend"].as<std::string>();
+    if (backend == "uring") {
+	m_useIoUring = true;
+    } else if (backend != "asio") {
+	std::cerr << "Invalid IO backend " << backend << std::endl;
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+
     if (variables.count("debug")) {
 	std::string flags = variables["debug"].as<std::string>();
 	if (flags == "none") {
@@ -22,6 +22,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
 
 class DebugStream : public std::ostream
 {
@@ -69,6 +71,39 @@ class Options
 	static unsigned int rateLimit() {
 	    return m_rateLimit;
 	}
+	static bool rateLimitAggregate() {
+	    return m_rateLimitAggregate;
+	}
+	static unsigned int dbCheckpointInterval() {
+	    return m_dbCheckpointInterval;
+	}
+	static unsigned int dbRecoveryLimit() {
+	    return m_dbRecoveryLimit;
+	}
+	static unsigned int dbBufferSize() {
+	    return m_dbBufferSize;
+	}
+	static bool decodeUnchanged() {
+	    return m_decodeUnchanged;
+	}
+	static const std::vector<std::string>& sensorDefinitions() {
+	    return m_sensorDefinitions;
+	}
+	static const std::vector<std::string>& storagePolicies() {
+	    return m_storagePolicies;
+	}
+	static bool autoRegisterSensors() {
+	    return m_autoRegisterSensors;
+	}
+	static bool dbFixedPoint() {
+	    return m_dbFixedPoint;
+	}
+	static bool migrateSchema() {
+	    return m_migrateSchema;
+	}
+	static unsigned int migrateBatchSize() {
+	    return m_migrateBatchSize;
+	}
 
 	static const std::string& target() {
 	    return m_target;
@@ -94,6 +129,36 @@ class Options
 	static unsigned int dataPort() {
 	    return m_dataPort;
 	}
+	static const std::string& commandSocket() {
+	    return m_commandSocket;
+	}
+	static const std::string& dataSocket() {
+	    return m_dataSocket;
+	}
+	static const std::string& socketGroup() {
+	    return m_socketGroup;
+	}
+	static bool useIoUring() {
+	    return m_useIoUring;
+	}
+	/* empty if the value cache is not to be persisted */
+	static const std::string& cacheFile() {
+	    return m_cacheFile;
+	}
+	static unsigned int cacheSaveInterval() {
+	    return m_cacheSaveInterval;
+	}
+	/* empty if no shared memory value table is to be published */
+	static const std::string& valueTableName() {
+	    return m_valueTableName;
+	}
+	/* empty if no shared memory value stream is to be published */
+	static const std::string& valueStreamName() {
+	    return m_valueStreamName;
+	}
+	static unsigned int valueStreamSize() {
+	    return m_valueStreamSize;
+	}
 
 	static ParseResult parse(int argc, char *argv[]);
 
@@ -122,13 +187,33 @@ class Options
     private:
 	static std::string m_target;
 	static unsigned int m_rateLimit;
+	static bool m_rateLimitAggregate;
+	static unsigned int m_dbCheckpointInterval;
+	static unsigned int m_dbRecoveryLimit;
+	static unsigned int m_dbBufferSize;
+	static bool m_decodeUnchanged;
 	static std::string m_pidFilePath;
 	static bool m_daemonize;
 	static std::string m_dbPath;
 	static std::string m_dbUser;
 	static std::string m_dbPass;
+	static std::vector<std::string> m_sensorDefinitions;
+	static std::vector<std::string> m_storagePolicies;
+	static bool m_autoRegisterSensors;
+	static bool m_migrateSchema;
+	static bool m_dbFixedPoint;
+	static unsigned int m_migrateBatchSize;
 	static unsigned int m_commandPort;
 	static unsigned int m_dataPort;
+	static std::string m_commandSocket;
+	static std::string m_dataSocket;
+	static std::string m_socketGroup;
+	static bool m_useIoUring;
+	static std::string m_cacheFile;
+	static unsigned int m_cacheSaveInterval;
+	static std::string m_valueTableName;
+	static std::string m_valueStreamName;
+	static unsigned int m_valueStreamSize;
 };
 
 #endif /* __OPTIONS_H__ */
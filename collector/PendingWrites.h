@@ -0,0 +1,102 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PENDINGWRITES_H__
+#define __PENDINGWRITES_H__
+
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+#include <mysql++/ssqls.h>
+
+/*
+ * The rows Database writes for the values of one message. Database.cpp
+ * defines the static members of the row types; other users define
+ * MYSQLPP_SSQLS_NO_STATICS before including this.
+ */
+sql_create_4(NumericSensorValue, 1, 4,
+	     mysqlpp::sql_smallint, sensor,
+	     mysqlpp::sql_float, value,
+	     mysqlpp::sql_datetime, starttime,
+	     mysqlpp::sql_datetime, endtime);
+sql_create_4(BooleanSensorValue, 1, 4,
+	     mysqlpp::sql_smallint, sensor,
+	     mysqlpp::sql_bool, value,
+	     mysqlpp::sql_datetime, starttime,
+	     mysqlpp::sql_datetime, endtime);
+sql_create_4(StateSensorValue, 1, 4,
+	     mysqlpp::sql_smallint, sensor,
+	     mysqlpp::sql_varchar, value,
+	     mysqlpp::sql_datetime, starttime,
+	     mysqlpp::sql_datetime, endtime);
+sql_create_7(NumericAggregateValue, 1, 7,
+	     mysqlpp::sql_smallint, sensor,
+	     mysqlpp::sql_datetime, starttime,
+	     mysqlpp::sql_datetime, endtime,
+	     mysqlpp::sql_float, min_value,
+	     mysqlpp::sql_float, max_value,
+	     mysqlpp::sql_float, mean_value,
+	     mysqlpp::sql_int_unsigned, samples);
+
+/* database changes collected while handling the values of one message */
+struct PendingWrites {
+    PendingWrites(time_t time) : now(time), timestamp(time) { }
+
+    time_t now;
+    mysqlpp::sql_datetime timestamp;
+    /* ids of rows closed by a changed value, whose end time is to be
+     * set to 'timestamp' */
+    std::vector<mysqlpp::ulonglong> numericUpdates;
+    std::vector<mysqlpp::ulonglong> booleanUpdates;
+    std::vector<mysqlpp::ulonglong> stateUpdates;
+    std::vector<NumericSensorValue> numericRows;
+    std::vector<BooleanSensorValue> booleanRows;
+    std::vector<StateSensorValue> stateRows;
+    /* rate limit windows closed by this message */
+    std::vector<NumericAggregateValue> aggregateRows;
+    /* values differing from the ones in the current values table */
+    std::vector<std::pair<unsigned int, float> > numericCurrent;
+    std::vector<std::pair<unsigned int, bool> > booleanCurrent;
+    std::vector<std::pair<unsigned int, std::string> > stateCurrent;
+};
+
+/* if the message contains the sensor multiple times, the last value wins */
+template<typename Row, typename T> void
+queueRow(std::vector<Row>& rows, unsigned int sensor, const T& value,
+	 const mysqlpp::sql_datetime& start, const mysqlpp::sql_datetime& end)
+{
+    for (size_t i = 0; i < rows.size(); i++) {
+	if ((unsigned int) rows[i].sensor == sensor) {
+	    rows[i].value = value;
+	    rows[i].starttime = start;
+	    return;
+	}
+    }
+    rows.push_back(Row(sensor, value, start, end));
+}
+
+template<typename Row, typename T> void
+queueRow(std::vector<Row>& rows, unsigned int sensor,
+	 const T& value, const mysqlpp::sql_datetime& timestamp)
+{
+    queueRow(rows, sensor, value, timestamp, timestamp);
+}
+
+#endif /* __PENDINGWRITES_H__ */
@@ -0,0 +1,119 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RawFrameParser.h"
+
+RawFrameParser::RawFrameParser(const FrameHandler& handler) :
+    m_handler(handler),
+    m_state(Normal),
+    m_synced(false),
+    m_overflow(false),
+    m_frameStart(0),
+    m_crcErrors(0)
+{
+    m_data.reserve(MaxFrameLength);
+}
+
+uint8_t
+RawFrameParser::crc(const uint8_t *data, size_t length)
+{
+    /* same as calc_checksum() of the AVR framer */
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < length; i++) {
+	uint8_t d = 0;
+	if (crc & 0x80) {
+	    crc ^= 0xc;
+	    d = 1;
+	}
+	crc <<= 1;
+	crc |= d;
+	crc ^= data[i];
+    }
+
+    return crc;
+}
+
+void
+RawFrameParser::feed(const uint8_t *data, size_t length, uint64_t now)
+{
+    for (size_t i = 0; i < length; i++) {
+	uint8_t byte = data[i];
+
+	switch (m_state) {
+	    case Normal:
+		if (byte == 0xff) {
+		    m_state = Marker;
+		} else {
+		    addByte(byte, now);
+		}
+		break;
+	    case Marker:
+		if (byte == 0xff) {
+		    /* escaped 0xff data byte */
+		    addByte(byte, now);
+		    m_state = Normal;
+		} else {
+		    m_state = ErrorMarker;
+		}
+		break;
+	    case ErrorMarker:
+		/* the byte with framing error or a break, both end the frame */
+		endFrame();
+		m_state = Normal;
+		break;
+	}
+    }
+}
+
+void
+RawFrameParser::addByte(uint8_t byte, uint64_t now)
+{
+    if (!m_synced) {
+	return;
+    }
+    if (m_data.empty()) {
+	m_frameStart = now;
+    }
+    if (m_data.size() < MaxFrameLength) {
+	m_data.push_back(byte);
+    } else {
+	m_overflow = true;
+    }
+}
+
+void
+RawFrameParser::endFrame()
+{
+    /* single bytes are polls or poll replies, they carry no data */
+    if (m_synced && !m_overflow && m_data.size() > 1) {
+	uint8_t expected = m_data.back();
+
+	m_data.pop_back();
+	if (crc(&m_data[0], m_data.size()) == expected) {
+	    m_handler(m_data, m_frameStart);
+	} else {
+	    m_crcErrors++;
+	}
+    }
+
+    m_synced = true;
+    m_overflow = false;
+    m_data.clear();
+}
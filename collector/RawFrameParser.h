@@ -0,0 +1,73 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RAWFRAMEPARSER_H__
+#define __RAWFRAMEPARSER_H__
+
+#include <vector>
+#include <stdint.h>
+#include <boost/function.hpp>
+
+/*
+ * Splits the byte stream of a UART attached directly to the EMS bus into
+ * frames. Frames end with a break (a zero byte with framing error), which
+ * the tty reports as 0xff 0x00 <byte> with PARMRK set; literal 0xff bytes
+ * arrive doubled. The last byte of each frame is a CRC, which is checked
+ * and stripped, so the handler gets the same data as with the AVR framer.
+ */
+class RawFrameParser
+{
+    public:
+	typedef boost::function<void (const std::vector<uint8_t>& data,
+				      uint64_t rxTime)> FrameHandler;
+
+	RawFrameParser(const FrameHandler& handler);
+
+	void feed(const uint8_t *data, size_t length, uint64_t now);
+
+	static uint8_t crc(const uint8_t *data, size_t length);
+
+	uint64_t crcErrors() const {
+	    return m_crcErrors;
+	}
+
+    private:
+	/* longest frame the AVR framer accepts as well */
+	static const size_t MaxFrameLength = 64;
+
+	typedef enum {
+	    Normal,
+	    Marker,	/* got 0xff */
+	    ErrorMarker	/* got 0xff 0x00 */
+	} State;
+
+	void addByte(uint8_t byte, uint64_t now);
+	void endFrame();
+
+	FrameHandler m_handler;
+	State m_state;
+	/* data before the first break may start mid-frame */
+	bool m_synced;
+	bool m_overflow;
+	uint64_t m_frameStart;
+	uint64_t m_crcErrors;
+	std::vector<uint8_t> m_data;
+};
+
+#endif /* __RAWFRAMEPARSER_H__ */
@@ -0,0 +1,48 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RequestPacer.h"
+
+long
+RequestPacer::reserve(uint8_t dest, const boost::posix_time::ptime& now)
+{
+    std::map<uint8_t, boost::posix_time::ptime>::iterator iter = m_nextSlots.find(dest);
+    boost::posix_time::ptime slot = now;
+
+    if (iter != m_nextSlots.end() && iter->second > now) {
+	slot = iter->second;
+    }
+    m_nextSlots[dest] = slot + m_minDistance;
+
+    return (slot - now).total_milliseconds();
+}
+
+void
+RequestPacer::handleActivity(uint8_t source, const boost::posix_time::ptime& now)
+{
+    boost::posix_time::ptime next = now + m_minDistance;
+    std::map<uint8_t, boost::posix_time::ptime>::iterator iter = m_nextSlots.find(source);
+
+    /* keeps the slots already handed out */
+    if (iter == m_nextSlots.end()) {
+	m_nextSlots[source] = next;
+    } else if (iter->second < next) {
+	iter->second = next;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REQUESTPACER_H__
+#define __REQUESTPACER_H__
+
+#include <map>
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/*
+ * Spaces the messages sent to a bus device by a minimum distance. Every
+ * message gets its own slot: the first free one at least the distance
+ * after the previous message to or from that device, so messages queued
+ * at once go out one after another instead of all at the same time.
+ */
+class RequestPacer
+{
+    public:
+	RequestPacer(long minDistance /* ms */) :
+	    m_minDistance(boost::posix_time::milliseconds(minDistance)) { }
+
+	/* reserves the next free slot for a message to 'dest' and returns
+	 * the time until it in ms, 0 if it may be sent right away */
+	long reserve(uint8_t dest, const boost::posix_time::ptime& now);
+	/* 'source' sent a message at 'now' */
+	void handleActivity(uint8_t source, const boost::posix_time::ptime& now);
+
+    private:
+	boost::posix_time::time_duration m_minDistance;
+	/* per device, the earliest time the next message may be sent */
+	std::map<uint8_t, boost::posix_time::ptime> m_nextSlots;
+};
+
+#endif /* __REQUESTPACER_H__ */
@@ -0,0 +1,366 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <mysql++/exceptions.h>
+#include <mysql++/query.h>
+#include "Schema.h"
+
+/* ids left free for the rows the collector writes into the old table
+ * while the tables are swapped. That is a few rows per second during the
+ * catch-up copy, which only takes seconds, so this is plenty; it is
+ * checked after the swap nevertheless. */
+static const mysqlpp::ulonglong SwapReserve = 100000;
+/* end times written into the old table this long before the migration
+ * started are synced as well, as they are only written at checkpoints */
+static const time_t EndtimeSyncMargin = 86400;
+
+/* months since year 0, in local time like the DATETIME columns */
+static unsigned int
+monthIndex(time_t time)
+{
+    struct tm tm;
+
+    localtime_r(&time, &tm);
+    return (tm.tm_year + 1900) * 12 + tm.tm_mon;
+}
+
+/* the first partition holds all rows before its end, the last one all
+ * rows after the end of the month 'last' */
+static std::string
+partitionList(unsigned int first, unsigned int last)
+{
+    std::ostringstream list;
+    char buffer[80];
+
+    for (unsigned int month = first; month <= last; month++) {
+	unsigned int next = month + 1;
+	snprintf(buffer, sizeof(buffer),
+		 "PARTITION p%04u%02u VALUES LESS THAN (TO_DAYS('%04u-%02u-01')), ",
+		 month / 12, month % 12 + 1, next / 12, next % 12 + 1);
+	list << buffer;
+    }
+    list << "PARTITION pmax VALUES LESS THAN MAXVALUE";
+
+    return list.str();
+}
+
+std::string
+Schema::tableOptions(time_t first, time_t now)
+{
+    return "ENGINE InnoDB ROW_FORMAT DYNAMIC PARTITION BY RANGE (TO_DAYS(starttime)) (" +
+	    partitionList(monthIndex(first), monthIndex(now) + PartitionsAhead) + ")";
+}
+
+bool
+Schema::extendPartitions(mysqlpp::Connection& connection, const std::string& table,
+			 time_t now)
+{
+    unsigned int last = monthIndex(now) + PartitionsAhead;
+
+    try {
+	mysqlpp::Query query = connection.query();
+
+	query << "select year(from_days(partition_description)) year, "
+	      << "month(from_days(partition_description)) month "
+	      << "from information_schema.partitions "
+	      << "where table_schema = database() and table_name = %0q "
+	      << "and partition_description != 'MAXVALUE' "
+	      << "order by partition_ordinal_position desc limit 1";
+	query.parse();
+
+	mysqlpp::StoreQueryResult res = query.store(table);
+	if (res.num_rows() == 0) {
+	    /* not partitioned */
+	    return true;
+	}
+
+	/* the newest monthly partition ends at the first of this month */
+	unsigned int next = (unsigned int) res[0]["year"] * 12 + (unsigned int) res[0]["month"] - 1;
+	if (next > last) {
+	    return true;
+	}
+
+	/* pmax is empty unless the collector was down for months, so
+	 * splitting it is cheap */
+	query.reset();
+	query << "alter table " << table << " reorganize partition pmax into ("
+	      << partitionList(next, last) << ")";
+	query.execute();
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not add partitions to " << table << ": " << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+static bool
+getTableInfo(mysqlpp::Connection& connection, const std::string& table,
+	     std::string& engine, time_t& created)
+{
+    mysqlpp::Query query = connection.query();
+
+    query << "select engine, unix_timestamp(create_time) created from information_schema.tables "
+	  << "where table_schema = database() and table_name = %0q";
+    query.parse();
+
+    mysqlpp::StoreQueryResult res = query.store(table);
+    if (res.num_rows() == 0) {
+	return false;
+    }
+
+    engine = res[0]["engine"].c_str();
+    created = (time_t) (unsigned long) res[0]["created"];
+    return true;
+}
+
+/* data and index size in bytes, after updating the statistics they are
+ * estimated from */
+static void
+getTableSize(mysqlpp::Connection& connection, const std::string& table,
+	     mysqlpp::ulonglong& data, mysqlpp::ulonglong& index)
+{
+    mysqlpp::Query query = connection.query();
+
+    query << "analyze table " << table;
+    query.store();
+
+    query << "select data_length, index_length from information_schema.tables "
+	  << "where table_schema = database() and table_name = %0q";
+    query.parse();
+
+    mysqlpp::StoreQueryResult res = query.store(table);
+    data = res.num_rows() > 0 ? (mysqlpp::ulonglong) res[0]["data_length"] : 0;
+    index = res.num_rows() > 0 ? (mysqlpp::ulonglong) res[0]["index_length"] : 0;
+}
+
+/* the open intervals are recovered on startup by the newest row of each
+ * sensor, which the primary key is to serve without reading the table */
+static void
+checkRecoveryPlan(mysqlpp::Connection& connection, const std::string& table)
+{
+    mysqlpp::Query query = connection.query();
+
+    query << "explain select sensor, max(starttime) starttime from " << table
+	  << " group by sensor";
+    mysqlpp::StoreQueryResult res = query.store();
+    if (res.num_rows() == 0 ||
+	    std::string(res[0]["Extra"].c_str()).find("Using index for group-by") == std::string::npos) {
+	std::cerr << "The newest rows of " << table << " are not found by an index scan, "
+		  << "restarts will read the whole table" << std::endl;
+    }
+}
+
+static mysqlpp::ulonglong
+getMaxId(mysqlpp::Connection& connection, const std::string& table)
+{
+    mysqlpp::Query query = connection.query();
+
+    query << "select coalesce(max(id), 0) id from " << table;
+    mysqlpp::StoreQueryResult res = query.store();
+    return (mysqlpp::ulonglong) res[0]["id"];
+}
+
+bool
+Schema::migrateTable(mysqlpp::Connection& connection, const std::string& table,
+		     unsigned int batchSize)
+{
+    std::string target = table + "_innodb";
+    std::string backup = table + "_myisam";
+    std::string engine, targetEngine;
+    time_t now = time(NULL), created = now;
+    bool overrun = false;
+
+    try {
+	mysqlpp::Query query = connection.query();
+
+	if (!getTableInfo(connection, table, engine, created)) {
+	    std::cout << "Table " << table << " does not exist, skipping" << std::endl;
+	    return true;
+	}
+	if (engine == "InnoDB") {
+	    std::cout << "Table " << table << " is already migrated" << std::endl;
+	    return true;
+	}
+
+	if (!getTableInfo(connection, target, targetEngine, created)) {
+	    time_t first = now;
+
+	    /* ids grow with the start time, so this is about the oldest row */
+	    query << "select unix_timestamp(starttime) starttime from " << table
+		  << " order by id limit 1";
+	    mysqlpp::StoreQueryResult res = query.store();
+	    if (res.num_rows() > 0) {
+		first = (time_t) (unsigned long) res[0]["starttime"];
+	    }
+
+	    query << "create table " << target << " like " << table;
+	    query.execute();
+	    query << "alter table " << target << " "
+		  << "modify id BIGINT UNSIGNED NOT NULL AUTO_INCREMENT, "
+		  << "drop primary key, add primary key (sensor, starttime, id), "
+		  << "add key id (id), drop key sensor_starttime, "
+		  << tableOptions(first, now);
+	    query.execute();
+	    created = now;
+	}
+
+	mysqlpp::ulonglong copied = getMaxId(connection, target);
+	if (copied > 0) {
+	    std::cout << "Resuming migration of " << table << " after id " << copied << std::endl;
+	}
+
+	/* each batch is a range scan of the MyISAM primary key; the table
+	 * lock it takes delays the inserts of the collector only briefly */
+	for (unsigned int batches = 1; ; batches++) {
+	    mysqlpp::ulonglong last = getMaxId(connection, table);
+	    if (last <= copied + batchSize) {
+		break;
+	    }
+
+	    query << "insert into " << target << " select * from " << table
+		  << " where id > " << copied << " and id <= " << copied + batchSize;
+	    query.execute();
+	    copied += batchSize;
+
+	    if (batches % 100 == 0) {
+		std::cout << "Copied " << table << " up to id " << copied
+			  << " of " << last << std::endl;
+	    }
+	}
+
+	/* the collector's inserts after the swap get ids from reserved on,
+	 * above the ones of the rows it writes into the old table until then */
+	mysqlpp::ulonglong reserved = getMaxId(connection, table) + SwapReserve;
+	query << "alter table " << target << " auto_increment = " << reserved;
+	query.execute();
+	query << "insert into " << target << " select * from " << table
+	      << " where id > " << copied;
+	query.execute();
+	copied = getMaxId(connection, target);
+
+	query << "rename table " << table << " to " << backup << ", "
+	      << target << " to " << table;
+	query.execute();
+
+	/* rows written after they were copied */
+	mysqlpp::ulonglong last = getMaxId(connection, backup);
+	overrun = last >= reserved;
+	if (overrun) {
+	    std::cerr << "Rows up to id " << last << " were written into " << backup
+		      << " during the swap, but only ids below " << reserved << " were "
+		      << "reserved for them; rows from id " << reserved << " on must be "
+		      << "copied by hand, with new ids" << std::endl;
+	    last = reserved - 1;
+	}
+	query << "insert into " << table << " select * from " << backup
+	      << " where id > " << copied << " and id <= " << last;
+	query.execute();
+
+	/* end times extended after the rows were copied, in batches like the
+	 * copy, as a single statement would lock the whole old table */
+	for (mysqlpp::ulonglong start = 0; start < copied; start += batchSize) {
+	    query << "update " << table << " n inner join " << backup << " o on n.id = o.id "
+		  << "set n.endtime = o.endtime where o.id > " << start
+		  << " and o.id <= " << std::min<mysqlpp::ulonglong>(start + batchSize, copied)
+		  << " and o.endtime > n.endtime and o.endtime >= '"
+		  << mysqlpp::DateTime(created - EndtimeSyncMargin) << "'";
+	    query.execute();
+	}
+
+	checkRecoveryPlan(connection, table);
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not migrate " << table << ": " << e.what() << std::endl;
+	return false;
+    }
+
+    if (overrun) {
+	return false;
+    }
+
+    std::cout << "Migrated " << table << " in " << time(NULL) - now << "s, "
+	      << "the old table is kept as " << backup << std::endl;
+    return true;
+}
+
+bool
+Schema::convertToFixedPoint(mysqlpp::Connection& connection, const std::string& table)
+{
+    time_t start = time(NULL);
+    mysqlpp::ulonglong dataBefore, indexBefore, dataAfter, indexAfter;
+
+    try {
+	mysqlpp::Query query = connection.query();
+
+	query << "show columns from " << table << " like 'value'";
+	mysqlpp::StoreQueryResult res = query.store();
+	if (res.num_rows() == 0) {
+	    std::cout << "Table " << table << " does not exist, skipping" << std::endl;
+	    return true;
+	}
+	if (std::string(res[0]["Type"].c_str()).compare(0, 3, "int") == 0) {
+	    std::cout << "Table " << table << " is already converted" << std::endl;
+	    return true;
+	}
+	getTableSize(connection, table, dataBefore, indexBefore);
+
+	/* the smallest of the decoder's dividers which makes all values of
+	 * a sensor integral, with some slack for the float rounding */
+	query << "update sensors s inner join (select sensor, case "
+	      << "when max(abs(value - round(value))) < 0.01 then 1 "
+	      << "when max(abs(value * 2 - round(value * 2))) < 0.01 then 2 "
+	      << "when max(abs(value * 10 - round(value * 10))) < 0.01 then 10 "
+	      << "else 100 end scale from " << table << " group by sensor) d "
+	      << "on s.type = d.sensor set s.scale = d.scale where s.scale is null";
+	query.execute();
+
+	/* the values are converted into a new column which replaces the old
+	 * one in a single statement, so the conversion can be resumed. INT
+	 * keeps the size of FLOAT, but counters and energy totals keep
+	 * growing, so a type sized by the values seen so far would overflow */
+	query << "show columns from " << table << " like 'value_fixed'";
+	res = query.store();
+	if (res.num_rows() == 0) {
+	    query << "alter table " << table << " add value_fixed INT";
+	    query.execute();
+	}
+	query << "update " << table << " d left join sensors s on d.sensor = s.type "
+	      << "set d.value_fixed = round(d.value * coalesce(s.scale, 1)) "
+	      << "where d.value_fixed is null";
+	query.execute();
+	query << "alter table " << table << " drop value, "
+	      << "change value_fixed value INT NOT NULL after sensor";
+	query.execute();
+
+	getTableSize(connection, table, dataAfter, indexAfter);
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not convert " << table << ": " << e.what() << std::endl;
+	return false;
+    }
+
+    std::cout << "Converted " << table << " to fixed-point values in "
+	      << time(NULL) - start << "s; data " << dataBefore / 1024 << " -> "
+	      << dataAfter / 1024 << " KiB, indexes " << indexBefore / 1024 << " -> "
+	      << indexAfter / 1024 << " KiB" << std::endl;
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCHEMA_H__
+#define __SCHEMA_H__
+
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <mysql++/connection.h>
+
+/*
+ * Layout of the data tables: InnoDB, clustered by (sensor, starttime, id)
+ * and partitioned by month of the start time. The id is kept as secondary
+ * key, as open rows are updated by it. Tables of older versions are MyISAM
+ * with id as primary key and are converted by migrateTable().
+ */
+namespace Schema {
+    /* monthly partitions are created up to this many months ahead */
+    static const unsigned int PartitionsAhead = 2;
+
+    /* engine and partitioning of a data table created now, whose oldest
+     * row starts at 'first' */
+    std::string tableOptions(time_t first, time_t now);
+    /* adds the partitions up to PartitionsAhead months after 'now';
+     * tables which are not partitioned are left alone */
+    bool extendPartitions(mysqlpp::Connection& connection, const std::string& table,
+			  time_t now);
+
+    /* copies the table into the new layout in batches of 'batchSize' rows
+     * while the collector keeps writing into it, then swaps both tables and
+     * copies what was written meanwhile; the old table is kept renamed to
+     * <table>_myisam. An interrupted migration is resumed. */
+    bool migrateTable(mysqlpp::Connection& connection, const std::string& table,
+		      unsigned int batchSize);
+    /* converts the float values of a numeric table into integers scaled by
+     * sensors.scale, determining the scales missing there from the data;
+     * the collector must not be running meanwhile. An interrupted
+     * conversion is resumed. */
+    bool convertToFixedPoint(mysqlpp::Connection& connection, const std::string& table);
+
+    /* appends a condition matching the rows by their own (sensor,
+     * starttime), the leading columns of the primary key */
+    template<typename Row> void
+    appendKeyCondition(std::ostream& query, const std::vector<Row>& rows)
+    {
+	for (size_t i = 0; i < rows.size(); i++) {
+	    query << (i > 0 ? " or " : "") << "(sensor = " << rows[i].sensor
+		  << " and starttime = '" << rows[i].starttime << "')";
+	}
+    }
+}
+
+#endif /* __SCHEMA_H__ */
@@ -0,0 +1,318 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include "SensorRegistry.h"
+#include "ValueApi.h"
+
+static const struct {
+    unsigned int id;
+    SensorRegistry::ValueType valueType;
+    EmsValue::Type type;
+    EmsValue::SubType subtype;
+    bool anySubtype;
+    const char *name;
+    SensorRegistry::ReadingType readingType;
+    const char *unit;
+    int precision;
+} BUILTINSENSORS[] = {
+    /* Numeric sensors */
+    { 1, SensorRegistry::Numeric, EmsValue::SollTemp, EmsValue::Kessel, false,
+      "Kessel-Soll-Temperatur", SensorRegistry::ReadingTemperature, "°C", 0 },
+    { 2, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::Kessel, false,
+      "Kessel-Ist-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 3, SensorRegistry::Numeric, EmsValue::SollTemp, EmsValue::WW, false,
+      "Warmwasser-Soll-Temperatur", SensorRegistry::ReadingTemperature, "°C", 0 },
+    { 4, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::WW, false,
+      "Warmwasser-Ist-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 5, SensorRegistry::Numeric, EmsValue::SollTemp, EmsValue::HK1, false,
+      "Vorlauf HK1-Soll-Temperatur", SensorRegistry::ReadingTemperature, "°C", 0 },
+    { 6, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::HK1, false,
+      "Vorlauf HK1-Ist-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 7, SensorRegistry::Numeric, EmsValue::SollTemp, EmsValue::HK2, false,
+      "Vorlauf HK2-Soll-Temperatur", SensorRegistry::ReadingTemperature, "°C", 0 },
+    { 8, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::HK2, false,
+      "Vorlauf HK2-Ist-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 9, SensorRegistry::Numeric, EmsValue::Mischersteuerung, EmsValue::None, false,
+      "Mischersteuerung", SensorRegistry::ReadingNone, "", 0 },
+    { 10, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::Ruecklauf, false,
+      "Rücklauftemperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 11, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::Aussen, false,
+      "Außentemperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 12, SensorRegistry::Numeric, EmsValue::GedaempfteTemp, EmsValue::Aussen, false,
+      "Gedämpfte Außentemperatur", SensorRegistry::ReadingTemperature, "°C", 0 },
+    { 13, SensorRegistry::Numeric, EmsValue::SollTemp, EmsValue::Raum, false,
+      "Raum-Soll-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 14, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::Raum, false,
+      "Raum-Ist-Temperatur", SensorRegistry::ReadingTemperature, "°C", 1 },
+    { 15, SensorRegistry::Numeric, EmsValue::IstModulation, EmsValue::Brenner, false,
+      "Momentane Leistung", SensorRegistry::ReadingPercent, "%", 0 },
+    { 16, SensorRegistry::Numeric, EmsValue::SollModulation, EmsValue::Brenner, false,
+      "Maximale Leistung", SensorRegistry::ReadingPercent, "%", 0 },
+    { 17, SensorRegistry::Numeric, EmsValue::Flammenstrom, EmsValue::None, false,
+      "Flammenstrom", SensorRegistry::ReadingCurrent, "µA", 1 },
+    { 18, SensorRegistry::Numeric, EmsValue::Systemdruck, EmsValue::None, false,
+      "Systemdruck", SensorRegistry::ReadingPressure, "bar", 1 },
+    { 19, SensorRegistry::Numeric, EmsValue::BetriebsZeit, EmsValue::None, false,
+      "Betriebszeit", SensorRegistry::ReadingTime, "min", -1 },
+    { 20, SensorRegistry::Numeric, EmsValue::Brennerstarts, EmsValue::None, false,
+      "Brennerstarts", SensorRegistry::ReadingCount, "", -1 },
+    { 21, SensorRegistry::Numeric, EmsValue::WarmwasserbereitungsZeit, EmsValue::None, false,
+      "Warmwasserbereitungszeit", SensorRegistry::ReadingTime, "min", -1 },
+    { 22, SensorRegistry::Numeric, EmsValue::WarmwasserBereitungen, EmsValue::None, false,
+      "Warmwasserbereitungen", SensorRegistry::ReadingCount, "", -1 },
+    { 23, SensorRegistry::Numeric, EmsValue::HeizZeit, EmsValue::None, false,
+      "Heizzeit", SensorRegistry::ReadingTime, "min", -1 },
+    { 24, SensorRegistry::Numeric, EmsValue::IstModulation, EmsValue::KesselPumpe, false,
+      "Kesselpumpenmodulation", SensorRegistry::ReadingPercent, "%", 0 },
+    { 25, SensorRegistry::Numeric, EmsValue::IstTemp, EmsValue::Waermetauscher, false,
+      "Temperatur Ausgang Waermetauscher", SensorRegistry::ReadingTemperature, "°C", 1 },
+
+    /* Boolean sensors */
+    { 100, SensorRegistry::Boolean, EmsValue::FlammeAktiv, EmsValue::None, true,
+      "Flamme", SensorRegistry::ReadingNone, NULL, -1 },
+    { 101, SensorRegistry::Boolean, EmsValue::BrennerAktiv, EmsValue::None, true,
+      "Brenner", SensorRegistry::ReadingNone, NULL, -1 },
+    { 102, SensorRegistry::Boolean, EmsValue::ZuendungAktiv, EmsValue::None, true,
+      "Zündung", SensorRegistry::ReadingNone, NULL, -1 },
+    { 103, SensorRegistry::Boolean, EmsValue::PumpeAktiv, EmsValue::Kessel, false,
+      "Kessel-Pumpe", SensorRegistry::ReadingNone, NULL, -1 },
+    /* 0 = HK, 1 = WW */
+    { 106, SensorRegistry::Boolean, EmsValue::DreiWegeVentilAufWW, EmsValue::None, true,
+      "3-Wege-Ventil", SensorRegistry::ReadingNone, NULL, -1 },
+    { 107, SensorRegistry::Boolean, EmsValue::ZirkulationAktiv, EmsValue::None, true,
+      "Zirkulation", SensorRegistry::ReadingNone, NULL, -1 },
+    { 124, SensorRegistry::Boolean, EmsValue::Tagbetrieb, EmsValue::Zirkulation, false,
+      "Zirkulation-Tagbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 110, SensorRegistry::Boolean, EmsValue::WarmwasserBereitung, EmsValue::None, true,
+      "Warmwasserbereitung", SensorRegistry::ReadingNone, NULL, -1 },
+    { 112, SensorRegistry::Boolean, EmsValue::Tagbetrieb, EmsValue::WW, false,
+      "WW-Tagbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 113, SensorRegistry::Boolean, EmsValue::Sommerbetrieb, EmsValue::None, true,
+      "Sommerbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 114, SensorRegistry::Boolean, EmsValue::WarmwasserTempOK, EmsValue::None, true,
+      "Warmwassertemperatur OK", SensorRegistry::ReadingNone, NULL, -1 },
+    { 115, SensorRegistry::Boolean, EmsValue::WWVorrang, EmsValue::None, true,
+      "Warmwasservorrang", SensorRegistry::ReadingNone, NULL, -1 },
+    { 122, SensorRegistry::Boolean, EmsValue::Automatikbetrieb, EmsValue::HK1, false,
+      "HK1 Automatikbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 104, SensorRegistry::Boolean, EmsValue::Tagbetrieb, EmsValue::HK1, false,
+      "HK1 Tagbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 116, SensorRegistry::Boolean, EmsValue::PumpeAktiv, EmsValue::HK1, false,
+      "HK1 Pumpe", SensorRegistry::ReadingNone, NULL, -1 },
+    { 118, SensorRegistry::Boolean, EmsValue::Ferien, EmsValue::HK1, false,
+      "HK1 Ferien", SensorRegistry::ReadingNone, NULL, -1 },
+    { 119, SensorRegistry::Boolean, EmsValue::Party, EmsValue::HK1, false,
+      "HK1 Party", SensorRegistry::ReadingNone, NULL, -1 },
+    { 123, SensorRegistry::Boolean, EmsValue::Automatikbetrieb, EmsValue::HK2, false,
+      "HK2 Automatikbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 105, SensorRegistry::Boolean, EmsValue::Tagbetrieb, EmsValue::HK2, false,
+      "HK2 Tagbetrieb", SensorRegistry::ReadingNone, NULL, -1 },
+    { 117, SensorRegistry::Boolean, EmsValue::PumpeAktiv, EmsValue::HK2, false,
+      "HK2 Pumpe", SensorRegistry::ReadingNone, NULL, -1 },
+    { 120, SensorRegistry::Boolean, EmsValue::Ferien, EmsValue::HK2, false,
+      "HK2 Ferien", SensorRegistry::ReadingNone, NULL, -1 },
+    { 121, SensorRegistry::Boolean, EmsValue::Party, EmsValue::HK2, false,
+      "HK2 Party", SensorRegistry::ReadingNone, NULL, -1 },
+
+    /* State sensors */
+    { 200, SensorRegistry::State, EmsValue::ServiceCode, EmsValue::None, true,
+      "Servicecode", SensorRegistry::ReadingNone, NULL, -1 },
+    { 201, SensorRegistry::State, EmsValue::FehlerCode, EmsValue::None, true,
+      "Fehlercode", SensorRegistry::ReadingNone, NULL, -1 }
+};
+
+SensorRegistry::SensorRegistry()
+{
+    for (size_t i = 0; i < sizeof(BUILTINSENSORS) / sizeof(BUILTINSENSORS[0]); i++) {
+	Sensor sensor;
+
+	sensor.id = BUILTINSENSORS[i].id;
+	sensor.valueType = BUILTINSENSORS[i].valueType;
+	sensor.type = BUILTINSENSORS[i].type;
+	sensor.subtype = BUILTINSENSORS[i].subtype;
+	sensor.anySubtype = BUILTINSENSORS[i].anySubtype;
+	sensor.name = BUILTINSENSORS[i].name;
+	sensor.readingType = BUILTINSENSORS[i].readingType;
+	if (BUILTINSENSORS[i].unit) {
+	    sensor.unit = BUILTINSENSORS[i].unit;
+	}
+	sensor.precision = BUILTINSENSORS[i].precision;
+	m_sensors.push_back(sensor);
+    }
+
+    compile();
+}
+
+void
+SensorRegistry::add(const Sensor& sensor)
+{
+    std::vector<Sensor>::iterator iter = m_sensors.begin();
+
+    while (iter != m_sensors.end()) {
+	bool sameKey = iter->type == sensor.type && iter->anySubtype == sensor.anySubtype &&
+		(sensor.anySubtype || iter->subtype == sensor.subtype);
+	if (iter->id == sensor.id || sameKey) {
+	    iter = m_sensors.erase(iter);
+	} else {
+	    ++iter;
+	}
+    }
+
+    m_sensors.push_back(sensor);
+}
+
+bool
+SensorRegistry::addDefinition(const std::string& definition)
+{
+    static const char * VALUETYPES[] = {
+	NULL, "numeric", "boolean", "state"
+    };
+    static const char * READINGTYPES[] = {
+	"none", "temperature", "percent", "current", "pressure", "time", "count"
+    };
+    std::vector<std::string> fields;
+    Sensor sensor;
+    char *end;
+
+    boost::algorithm::split(fields, definition, boost::algorithm::is_any_of(","));
+    if (fields.size() != 5 && fields.size() != 8) {
+	return false;
+    }
+
+    sensor.id = strtoul(fields[0].c_str(), &end, 10);
+    if (*end || sensor.id == 0 || sensor.id > 65535) {
+	return false;
+    }
+
+    sensor.valueType = (ValueType) 0;
+    for (unsigned int i = Numeric; i <= State; i++) {
+	if (fields[1] == VALUETYPES[i]) {
+	    sensor.valueType = (ValueType) i;
+	}
+    }
+    if (sensor.valueType == 0) {
+	return false;
+    }
+
+    sensor.anySubtype = fields[2] == "any";
+    sensor.subtype = EmsValue::None;
+    if (!sensor.anySubtype && fields[2] != "none" &&
+	    !ValueApi::parseSubTypeName(fields[2], sensor.subtype)) {
+	return false;
+    }
+    if (!ValueApi::parseTypeName(fields[3], sensor.type)) {
+	return false;
+    }
+    sensor.name = fields[4];
+
+    sensor.readingType = ReadingNone;
+    sensor.precision = -1;
+    if (fields.size() == 8) {
+	bool found = false;
+	for (unsigned int i = 0; i < sizeof(READINGTYPES) / sizeof(READINGTYPES[0]); i++) {
+	    if (fields[5] == READINGTYPES[i]) {
+		sensor.readingType = (ReadingType) i;
+		found = true;
+	    }
+	}
+	if (!found) {
+	    return false;
+	}
+	sensor.unit = fields[6];
+	if (!fields[7].empty()) {
+	    sensor.precision = strtol(fields[7].c_str(), &end, 10);
+	    if (*end) {
+		return false;
+	    }
+	}
+    }
+
+    add(sensor);
+    return true;
+}
+
+SensorRegistry::Entry
+SensorRegistry::addAutomatic(const EmsValue& value)
+{
+    Entry entry = { 0, 0 };
+    Sensor sensor;
+    std::string type = ValueApi::getTypeName(value.getType());
+    std::string subtype = ValueApi::getSubTypeName(value.getSubType());
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	case EmsValue::Integer: sensor.valueType = Numeric; break;
+	case EmsValue::Boolean: sensor.valueType = Boolean; break;
+	case EmsValue::Formatted: sensor.valueType = State; break;
+	default: return entry;
+    }
+
+    sensor.id = FirstAutomaticId;
+    for (size_t i = 0; i < m_sensors.size(); i++) {
+	if (m_sensors[i].id >= sensor.id) {
+	    sensor.id = m_sensors[i].id + 1;
+	}
+    }
+    if (sensor.id > 65535) {
+	return entry;
+    }
+
+    sensor.type = value.getType();
+    sensor.subtype = value.getSubType();
+    sensor.anySubtype = false;
+    sensor.name = subtype.empty() ? type : subtype + " " + type;
+    sensor.readingType = ReadingNone;
+    sensor.precision = -1;
+    m_sensors.push_back(sensor);
+
+    entry.id = sensor.id;
+    entry.valueType = sensor.valueType;
+    m_lookup[sensor.type * EmsValue::SubTypeCount + sensor.subtype] = entry;
+
+    return entry;
+}
+
+void
+SensorRegistry::compile()
+{
+    memset(m_lookup, 0, sizeof(m_lookup));
+
+    /* sensors for any subtype first, so specific ones override them */
+    for (unsigned int pass = 0; pass < 2; pass++) {
+	for (size_t i = 0; i < m_sensors.size(); i++) {
+	    const Sensor& sensor = m_sensors[i];
+	    Entry entry = { (uint16_t) sensor.id, (uint8_t) sensor.valueType };
+
+	    if (sensor.anySubtype != (pass == 0)) {
+		continue;
+	    }
+	    if (sensor.anySubtype) {
+		for (unsigned int subtype = 0; subtype < EmsValue::SubTypeCount; subtype++) {
+		    m_lookup[sensor.type * EmsValue::SubTypeCount + subtype] = entry;
+		}
+	    } else {
+		m_lookup[sensor.type * EmsValue::SubTypeCount + sensor.subtype] = entry;
+	    }
+	}
+    }
+}
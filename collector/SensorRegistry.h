@@ -0,0 +1,101 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SENSORREGISTRY_H__
+#define __SENSORREGISTRY_H__
+
+#include <string>
+#include <vector>
+#include "EmsMessage.h"
+
+/*
+ * Maps (type, subtype) of decoded values to the sensors stored in the DB.
+ * Starts out with the built-in sensors; definitions from the sensors table,
+ * the configuration and auto registration are added on top of it.
+ */
+class SensorRegistry
+{
+    public:
+	/* values of the sensors.value_type column */
+	typedef enum {
+	    Numeric = 1,
+	    Boolean = 2,
+	    State = 3
+	} ValueType;
+
+	/* values of the sensors.reading_type column */
+	typedef enum {
+	    ReadingNone = 0,
+	    ReadingTemperature = 1,
+	    ReadingPercent = 2,
+	    ReadingCurrent = 3,
+	    ReadingPressure = 4,
+	    ReadingTime = 5,
+	    ReadingCount = 6
+	} ReadingType;
+
+	struct Sensor {
+	    unsigned int id;
+	    ValueType valueType;
+	    EmsValue::Type type;
+	    EmsValue::SubType subtype;
+	    /* matches all subtypes not mapped by another sensor */
+	    bool anySubtype;
+	    std::string name;
+	    ReadingType readingType;
+	    std::string unit;
+	    /* -1 if not set */
+	    int precision;
+	};
+
+	struct Entry {
+	    /* 0 if not mapped */
+	    uint16_t id;
+	    uint8_t valueType;
+	};
+
+    public:
+	SensorRegistry();
+
+	/* replaces sensors with the same id or the same type and subtype;
+	 * lookups only see the change after compile() */
+	void add(const Sensor& sensor);
+	/* <id>,<numeric|boolean|state>,<subtype|none|any>,<type>,<name>
+	 * [,<reading type>,<unit>,<precision>] with ValueApi type names */
+	bool addDefinition(const std::string& definition);
+	/* adds a sensor for an unmapped value, if the value can be stored */
+	Entry addAutomatic(const EmsValue& value);
+	void compile();
+
+	Entry lookup(EmsValue::Type type, EmsValue::SubType subtype) const {
+	    return m_lookup[type * EmsValue::SubTypeCount + subtype];
+	}
+	const std::vector<Sensor>& sensors() const {
+	    return m_sensors;
+	}
+
+    private:
+	/* auto registered sensors get ids starting from here */
+	static const unsigned int FirstAutomaticId = 1000;
+
+	std::vector<Sensor> m_sensors;
+	Entry m_lookup[EmsValue::TypeCount * EmsValue::SubTypeCount];
+};
+
+#endif /* __SENSORREGISTRY_H__ */
@@ -19,14 +19,20 @@
 
 #include <iostream>
 #include <iomanip>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include "SerialHandler.h"
 #include "Options.h"
 
 SerialHandler::SerialHandler(const std::string& device,
 			     Database& db,
-			     ValueCache& cache) :
+			     ValueCache& cache,
+			     bool raw) :
     IoHandler(db, cache),
-    m_serialPort(*this, device)
+    m_serialPort(*this, device),
+    m_raw(raw),
+    m_rawParser(boost::bind(&SerialHandler::handleFrame, this, _1, _2))
 {
     if (!m_serialPort.is_open()) {
 	std::cerr << "Failed to open serial port." << std::endl;
@@ -37,6 +43,13 @@ SerialHandler::SerialHandler(const std::string& device,
     boost::asio::serial_port_base::baud_rate baudOption(9600);
     m_serialPort.set_option(baudOption);
 
+    if (m_raw && !setupRawMode()) {
+	std::cerr << "Failed to set up serial port for break detection." << std::endl;
+	m_serialPort.close();
+	m_active = false;
+	return;
+    }
+
     readStart();
 }
 
@@ -47,8 +60,52 @@ SerialHandler::~SerialHandler()
     }
 }
 
+bool
+SerialHandler::setupRawMode()
+{
+    int fd = m_serialPort.native_handle();
+    struct termios tio;
+    struct stat st;
+
+    /* there is no line to break on pseudo terminals; for testing, the
+     * writer sends the markers PARMRK would produce itself */
+    if (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) &&
+	    major(st.st_rdev) >= UnixPtySlaveMajor &&
+	    major(st.st_rdev) < UnixPtySlaveMajor + 8) {
+	return true;
+    }
+
+    if (tcgetattr(fd, &tio) != 0) {
+	return false;
+    }
+
+    /* report breaks and framing errors in-band as 0xff 0x00 <byte>
+     * instead of dropping them or sending SIGINT */
+    tio.c_iflag &= ~(IGNBRK | BRKINT | IGNPAR | ISTRIP | IXON | IXOFF);
+    tio.c_iflag |= PARMRK | INPCK;
+
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+void
+SerialHandler::parseData(const uint8_t *data, size_t length, uint64_t now)
+{
+    if (m_raw) {
+	m_rawParser.feed(data, length, now);
+    } else {
+	IoHandler::parseData(data, length, now);
+    }
+}
+
 void
 SerialHandler::doCloseImpl()
 {
+    if (m_raw && Options::statsDebug()) {
+	Options::statsDebug() << "frames with CRC errors: "
+			      << m_rawParser.crcErrors() << std::endl;
+    }
+    if (m_uring) {
+	m_uring->cancel(m_serialPort.native_handle());
+    }
     m_serialPort.close();
 }
@@ -22,15 +22,23 @@
 
 #include <boost/asio/serial_port.hpp>
 #include "IoHandler.h"
+#include "RawFrameParser.h"
 
 class SerialHandler : public IoHandler
 {
     public:
-	SerialHandler(const std::string& device, Database& db, ValueCache& cache);
+	/* in raw mode, the device is a UART attached directly to the bus
+	 * instead of the AVR framer */
+	SerialHandler(const std::string& device, Database& db,
+		      ValueCache& cache, bool raw = false);
 	~SerialHandler();
 
     protected:
 	virtual void readStart() {
+	    if (m_uring) {
+		readStartUring(m_serialPort.native_handle());
+		return;
+	    }
 	    /* Start an asynchronous read and call read_complete when it completes or fails */
 	    m_serialPort.async_read_some(boost::asio::buffer(m_recvBuffer, maxReadLength),
 					 boost::bind(&SerialHandler::readComplete, this,
@@ -39,9 +47,18 @@ class SerialHandler : public IoHandler
 	}
 
 	virtual void doCloseImpl();
+	virtual void parseData(const uint8_t *data, size_t length, uint64_t now);
+
+    private:
+	/* major numbers of /dev/pts/ devices are this one and the 7 after it */
+	static const unsigned int UnixPtySlaveMajor = 136;
+
+	bool setupRawMode();
 
     private:
 	boost::asio::serial_port m_serialPort;
+	bool m_raw;
+	RawFrameParser m_rawParser;
 };
 
 #endif /* __SERIALHANDLER_H__ */
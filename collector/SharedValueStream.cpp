@@ -0,0 +1,191 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "SharedValueStream.h"
+#include "ValueApi.h"
+
+static_assert(sizeof(struct ems_stream_record) == 64, "records must fill one cache line");
+static_assert(sizeof(struct ems_stream_header) <= 64, "header too large");
+static_assert(EmsValue::TypeCount <= 256 && EmsValue::SubTypeCount <= 256,
+	      "types must fit into the record");
+
+static const size_t TypesOffset = 64;
+static const size_t SubTypesOffset = TypesOffset + EmsValue::TypeCount * EMS_VALUES_NAME_SIZE;
+static const size_t RecordsOffset =
+	(SubTypesOffset + EmsValue::SubTypeCount * EMS_VALUES_NAME_SIZE + 63) & ~63;
+
+SharedValueStream::SharedValueStream(const std::string& name, unsigned int capacity) :
+    m_name(name),
+    m_capacity(1),
+    m_base(MAP_FAILED),
+    m_header(NULL),
+    m_records(NULL),
+    m_head(0)
+{
+    while (m_capacity < capacity && m_capacity < (1U << 24)) {
+	m_capacity <<= 1;
+    }
+    m_size = RecordsOffset + m_capacity * sizeof(struct ems_stream_record);
+
+    if (!map()) {
+	std::cerr << "Could not set up value stream " << m_name << ": "
+		  << strerror(errno) << std::endl;
+	return;
+    }
+    setup();
+}
+
+SharedValueStream::~SharedValueStream()
+{
+    if (m_header) {
+	/* tells readers to look for the stream of the next run */
+	__atomic_store_n(&m_header->writer_pid, 0, __ATOMIC_RELEASE);
+    }
+    if (m_base != MAP_FAILED) {
+	munmap(m_base, m_size);
+    }
+}
+
+bool
+SharedValueStream::map()
+{
+    /* always start with a fresh segment: readers still attached to the
+     * one of a previous run keep their positions in it consistent */
+    shm_unlink(m_name.c_str());
+
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+	return false;
+    }
+
+    if (ftruncate(fd, m_size) != 0) {
+	int error = errno;
+	close(fd);
+	errno = error;
+	return false;
+    }
+
+    m_base = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return m_base != MAP_FAILED;
+}
+
+void
+SharedValueStream::setup()
+{
+    uint8_t *base = static_cast<uint8_t *>(m_base);
+
+    m_header = reinterpret_cast<struct ems_stream_header *>(base);
+    m_records = reinterpret_cast<struct ems_stream_record *>(base + RecordsOffset);
+
+    for (unsigned int i = 0; i < EmsValue::TypeCount; i++) {
+	char *name = reinterpret_cast<char *>(base + TypesOffset + i * EMS_VALUES_NAME_SIZE);
+	strncpy(name, ValueApi::getTypeName((EmsValue::Type) i), EMS_VALUES_NAME_SIZE - 1);
+    }
+    for (unsigned int i = 0; i < EmsValue::SubTypeCount; i++) {
+	char *name = reinterpret_cast<char *>(base + SubTypesOffset + i * EMS_VALUES_NAME_SIZE);
+	strncpy(name, ValueApi::getSubTypeName((EmsValue::SubType) i), EMS_VALUES_NAME_SIZE - 1);
+    }
+
+    /* the segment is new, so everything else is zero already */
+    m_header->version = EMS_STREAM_VERSION;
+    m_header->record_size = sizeof(struct ems_stream_record);
+    m_header->capacity = m_capacity;
+    m_header->type_count = EmsValue::TypeCount;
+    m_header->subtype_count = EmsValue::SubTypeCount;
+    m_header->types_offset = TypesOffset;
+    m_header->subtypes_offset = SubTypesOffset;
+    m_header->records_offset = RecordsOffset;
+    m_header->writer_pid = getpid();
+    m_header->start_time = time(NULL);
+    __atomic_store_n(&m_header->magic, EMS_STREAM_MAGIC, __ATOMIC_RELEASE);
+}
+
+void
+SharedValueStream::publish(const EmsValue& value, int64_t timestampNs)
+{
+    char buffer[ValueApi::FormatBufferSize];
+    size_t length = ValueApi::formatValue(value, buffer, sizeof(buffer));
+    struct ems_stream_record *record = &m_records[m_head & (m_capacity - 1)];
+    double numeric = NAN;
+    uint32_t integer = 0;
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    numeric = value.getValue<float>();
+	    break;
+	case EmsValue::Integer:
+	    integer = value.getValue<unsigned int>();
+	    break;
+	case EmsValue::Boolean:
+	    integer = value.getValue<bool>();
+	    break;
+	case EmsValue::Enumeration:
+	    integer = value.getValue<uint8_t>();
+	    break;
+	default:
+	    break;
+    }
+
+    length = std::min(length, sizeof(record->text) - 1);
+
+    /* odd while writing; the fence keeps the data stores after it */
+    __atomic_store_n(&record->seq, 2 * m_head + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->timestamp_ns = timestampNs;
+    record->type = value.getType();
+    record->subtype = value.getSubType();
+    record->reading_type = value.getReadingType();
+    record->integer = integer;
+    record->numeric = numeric;
+    memcpy(record->text, buffer, length);
+    memset(record->text + length, 0, sizeof(record->text) - length);
+
+    __atomic_store_n(&record->seq, 2 * m_head + 2, __ATOMIC_RELEASE);
+    m_head++;
+    __atomic_store_n(&m_header->head, m_head, __ATOMIC_RELEASE);
+}
+
+void
+SharedValueStream::publish(const EmsValueList& values)
+{
+    struct timespec now;
+
+    if (!m_header) {
+	return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t timestamp = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+    for (size_t i = 0; i < values.size(); i++) {
+	publish(values[i], timestamp);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SHAREDVALUESTREAM_H__
+#define __SHAREDVALUESTREAM_H__
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include "EmsMessage.h"
+#include "client/ems_stream.h"
+
+/*
+ * Writer side of the shared memory value stream described in
+ * client/ems_stream.h. Only the IO thread writes to it.
+ */
+class SharedValueStream : private boost::noncopyable
+{
+    public:
+	/* capacity is rounded up to a power of two */
+	SharedValueStream(const std::string& name, unsigned int capacity);
+	~SharedValueStream();
+
+	bool valid() const {
+	    return m_header != NULL;
+	}
+
+	/* values of one message share the timestamp */
+	void publish(const EmsValueList& values);
+	/* only to be called if valid() */
+	void publish(const EmsValue& value, int64_t timestampNs);
+
+    private:
+	bool map();
+	void setup();
+
+    private:
+	std::string m_name;
+	unsigned int m_capacity;
+	size_t m_size;
+	void *m_base;
+	struct ems_stream_header *m_header;
+	struct ems_stream_record *m_records;
+	/* private copy of the header's head, which readers only load */
+	uint64_t m_head;
+};
+
+#endif /* __SHAREDVALUESTREAM_H__ */
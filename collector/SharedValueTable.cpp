@@ -0,0 +1,222 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SharedValueTable.h"
+#include "ValueApi.h"
+
+static_assert(sizeof(struct ems_values_slot) == 64, "slots must fill one cache line");
+static_assert((int) EMS_READING_FORMATTED == (int) EmsValue::Formatted, "reading types out of sync");
+
+/* the header is padded to a cache line, as are the name tables */
+static const size_t TypesOffset = 64;
+static const size_t SubTypesOffset = TypesOffset + EmsValue::TypeCount * EMS_VALUES_NAME_SIZE;
+static const size_t SlotsOffset =
+	(SubTypesOffset + EmsValue::SubTypeCount * EMS_VALUES_NAME_SIZE + 63) & ~63;
+static const size_t TableSize = SlotsOffset +
+	EmsValue::TypeCount * EmsValue::SubTypeCount * sizeof(struct ems_values_slot);
+
+static_assert(sizeof(struct ems_values_header) <= TypesOffset, "header too large");
+
+SharedValueTable::SharedValueTable(const std::string& name) :
+    m_name(name),
+    m_base(MAP_FAILED),
+    m_header(NULL),
+    m_slots(NULL)
+{
+    if (!map()) {
+	std::cerr << "Could not set up value table " << m_name << ": "
+		  << strerror(errno) << std::endl;
+	return;
+    }
+    setup();
+}
+
+SharedValueTable::~SharedValueTable()
+{
+    if (m_header) {
+	/* the values stay readable, but readers can tell they're stale */
+	__atomic_store_n(&m_header->writer_pid, 0, __ATOMIC_RELEASE);
+    }
+    if (m_base != MAP_FAILED) {
+	munmap(m_base, TableSize);
+    }
+}
+
+bool
+SharedValueTable::map()
+{
+    struct stat st;
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+	return false;
+    }
+
+    /* readers of a table with a different layout would fault when it is
+     * resized, so give them a new one and leave them the old */
+    if (fstat(fd, &st) == 0 && st.st_size != 0 && (size_t) st.st_size != TableSize) {
+	close(fd);
+	shm_unlink(m_name.c_str());
+	fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+	    return false;
+	}
+    }
+
+    if (ftruncate(fd, TableSize) != 0) {
+	int error = errno;
+	close(fd);
+	errno = error;
+	return false;
+    }
+
+    m_base = mmap(NULL, TableSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return m_base != MAP_FAILED;
+}
+
+void
+SharedValueTable::setup()
+{
+    uint8_t *base = static_cast<uint8_t *>(m_base);
+
+    m_header = reinterpret_cast<struct ems_values_header *>(base);
+    m_slots = reinterpret_cast<struct ems_values_slot *>(base + SlotsOffset);
+
+    /* readers attaching meanwhile see no valid table */
+    __atomic_store_n(&m_header->magic, 0, __ATOMIC_RELEASE);
+
+    for (unsigned int i = 0; i < EmsValue::TypeCount; i++) {
+	char *name = reinterpret_cast<char *>(base + TypesOffset + i * EMS_VALUES_NAME_SIZE);
+	strncpy(name, ValueApi::getTypeName((EmsValue::Type) i), EMS_VALUES_NAME_SIZE - 1);
+	name[EMS_VALUES_NAME_SIZE - 1] = '\0';
+    }
+    for (unsigned int i = 0; i < EmsValue::SubTypeCount; i++) {
+	char *name = reinterpret_cast<char *>(base + SubTypesOffset + i * EMS_VALUES_NAME_SIZE);
+	strncpy(name, ValueApi::getSubTypeName((EmsValue::SubType) i), EMS_VALUES_NAME_SIZE - 1);
+	name[EMS_VALUES_NAME_SIZE - 1] = '\0';
+    }
+
+    /* values of a previous run are outdated; readers still attached to
+     * the segment see them disappear like any other slot update */
+    for (unsigned int i = 0; i < EmsValue::TypeCount * EmsValue::SubTypeCount; i++) {
+	struct ems_values_slot *slot = &m_slots[i];
+	if (slot->present) {
+	    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	    __atomic_thread_fence(__ATOMIC_RELEASE);
+	    slot->present = 0;
+	    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+	}
+    }
+
+    m_header->version = EMS_VALUES_VERSION;
+    m_header->type_count = EmsValue::TypeCount;
+    m_header->subtype_count = EmsValue::SubTypeCount;
+    m_header->slot_size = sizeof(struct ems_values_slot);
+    m_header->types_offset = TypesOffset;
+    m_header->subtypes_offset = SubTypesOffset;
+    m_header->slots_offset = SlotsOffset;
+    m_header->start_time = time(NULL);
+    m_header->writer_pid = getpid();
+    __atomic_store_n(&m_header->generation, m_header->generation + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_header->magic, EMS_VALUES_MAGIC, __ATOMIC_RELEASE);
+}
+
+struct ems_values_slot *
+SharedValueTable::beginWrite(EmsValue::Type type, EmsValue::SubType subtype)
+{
+    struct ems_values_slot *slot = &m_slots[type * EmsValue::SubTypeCount + subtype];
+
+    /* odd while writing; the fence keeps the data stores after it */
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return slot;
+}
+
+void
+SharedValueTable::endWrite(struct ems_values_slot *slot)
+{
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_header->generation, m_header->generation + 1, __ATOMIC_RELEASE);
+}
+
+void
+SharedValueTable::publish(const EmsValue& value, time_t timestamp)
+{
+    char buffer[ValueApi::FormatBufferSize];
+    size_t length = ValueApi::formatValue(value, buffer, sizeof(buffer));
+    struct ems_values_slot *slot;
+    double numeric = NAN;
+    uint32_t integer = 0;
+
+    if (!m_header) {
+	return;
+    }
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    numeric = value.getValue<float>();
+	    break;
+	case EmsValue::Integer:
+	    integer = value.getValue<unsigned int>();
+	    break;
+	case EmsValue::Boolean:
+	    integer = value.getValue<bool>();
+	    break;
+	case EmsValue::Enumeration:
+	    integer = value.getValue<uint8_t>();
+	    break;
+	default:
+	    break;
+    }
+
+    length = std::min(length, sizeof(slot->text) - 1);
+
+    slot = beginWrite(value.getType(), value.getSubType());
+    slot->present = 1;
+    slot->reading_type = value.getReadingType();
+    slot->timestamp = timestamp;
+    slot->numeric = numeric;
+    slot->integer = integer;
+    memcpy(slot->text, buffer, length);
+    memset(slot->text + length, 0, sizeof(slot->text) - length);
+    endWrite(slot);
+}
+
+void
+SharedValueTable::refresh(EmsValue::Type type, EmsValue::SubType subtype, time_t timestamp)
+{
+    if (!m_header) {
+	return;
+    }
+
+    struct ems_values_slot *slot = beginWrite(type, subtype);
+    slot->timestamp = timestamp;
+    endWrite(slot);
+}
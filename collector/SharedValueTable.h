@@ -0,0 +1,59 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SHAREDVALUETABLE_H__
+#define __SHAREDVALUETABLE_H__
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include "EmsMessage.h"
+#include "client/ems_values.h"
+
+/*
+ * Writer side of the shared memory value table described in
+ * client/ems_values.h. Only the IO thread writes to it.
+ */
+class SharedValueTable : private boost::noncopyable
+{
+    public:
+	SharedValueTable(const std::string& name);
+	~SharedValueTable();
+
+	bool valid() const {
+	    return m_header != NULL;
+	}
+
+	void publish(const EmsValue& value, time_t timestamp);
+	/* for values received again unchanged */
+	void refresh(EmsValue::Type type, EmsValue::SubType subtype, time_t timestamp);
+
+    private:
+	bool map();
+	void setup();
+	struct ems_values_slot * beginWrite(EmsValue::Type type, EmsValue::SubType subtype);
+	void endWrite(struct ems_values_slot *slot);
+
+    private:
+	std::string m_name;
+	void *m_base;
+	struct ems_values_header *m_header;
+	struct ems_values_slot *m_slots;
+};
+
+#endif /* __SHAREDVALUETABLE_H__ */
@@ -0,0 +1,209 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include "StoragePolicy.h"
+
+StoragePolicy::StoragePolicy() :
+    m_kind(OnChange),
+    m_parameter(0),
+    m_relative(false),
+    m_maxInterval(0),
+    m_active(false),
+    m_rowValue(0),
+    m_rowTime(0),
+    m_lastSample(0),
+    m_hasSnapshot(false),
+    m_snapshotValue(0),
+    m_snapshotTime(0),
+    m_upperSlope(0),
+    m_lowerSlope(0)
+{
+}
+
+bool
+StoragePolicy::parse(const std::string& definition, unsigned int& sensor,
+		     StoragePolicy& policy)
+{
+    std::vector<std::string> fields;
+    char *end;
+
+    boost::algorithm::split(fields, definition, boost::algorithm::is_any_of(","));
+    if (fields.size() < 2) {
+	return false;
+    }
+
+    sensor = strtoul(fields[0].c_str(), &end, 10);
+    if (*end || sensor == 0 || sensor > 65535) {
+	return false;
+    }
+
+    policy = StoragePolicy();
+
+    if (fields[1] == "onchange" && fields.size() == 2) {
+	policy.m_kind = OnChange;
+	return true;
+    }
+
+    if (fields.size() < 3) {
+	return false;
+    }
+
+    std::string& parameter = fields[2];
+    if (fields[1] == "deadband" && !parameter.empty() && parameter[parameter.size() - 1] == '%') {
+	policy.m_relative = true;
+	parameter.erase(parameter.size() - 1);
+    }
+    policy.m_parameter = strtod(parameter.c_str(), &end);
+    if (*end || parameter.empty() || policy.m_parameter < 0) {
+	return false;
+    }
+
+    if (fields[1] == "ratelimit" && fields.size() == 3) {
+	policy.m_kind = RateLimit;
+    } else if (fields[1] == "deadband" && fields.size() == 3) {
+	policy.m_kind = Deadband;
+    } else if (fields[1] == "swingingdoor" && fields.size() <= 4) {
+	policy.m_kind = SwingingDoor;
+	if (fields.size() == 4) {
+	    policy.m_maxInterval = strtoul(fields[3].c_str(), &end, 10);
+	    if (*end || fields[3].empty()) {
+		return false;
+	    }
+	}
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+void
+StoragePolicy::reset(float value, time_t time)
+{
+    m_active = true;
+    m_rowValue = value;
+    m_rowTime = time;
+    m_lastSample = time;
+    m_hasSnapshot = false;
+}
+
+StoragePolicy::Action
+StoragePolicy::sample(float value, time_t time, float& rowValue, time_t& rowTime)
+{
+    bool store = false;
+
+    switch (m_kind) {
+	case OnChange:
+	    store = value != m_rowValue;
+	    break;
+	case RateLimit:
+	    /* like --ratelimit: samples within the limit are dropped */
+	    if (time - m_lastSample < (time_t) m_parameter) {
+		return Skip;
+	    }
+	    store = value != m_rowValue;
+	    break;
+	case Deadband: {
+	    double band = m_relative ? std::fabs(m_rowValue) * m_parameter / 100 : m_parameter;
+	    store = std::fabs(value - m_rowValue) > band;
+	    break;
+	}
+	case SwingingDoor:
+	    return sampleSwingingDoor(value, time, rowValue, rowTime);
+    }
+
+    m_lastSample = time;
+    if (!store) {
+	return Extend;
+    }
+
+    reset(value, time);
+    rowValue = value;
+    rowTime = time;
+    return Store;
+}
+
+StoragePolicy::Action
+StoragePolicy::sampleSwingingDoor(float value, time_t time, float& rowValue, time_t& rowTime)
+{
+    double error = m_parameter;
+    time_t elapsed = time - m_rowTime;
+
+    m_lastSample = time;
+
+    if (elapsed <= 0) {
+	/* no slope within the same second, only a jump counts */
+	if (std::fabs(value - m_rowValue) <= error) {
+	    return Extend;
+	}
+	reset(value, time);
+	rowValue = value;
+	rowTime = time;
+	return Store;
+    }
+
+    double upper = (value + error - m_rowValue) / elapsed;
+    double lower = (value - error - m_rowValue) / elapsed;
+    /* slopes valid for all samples up to the snapshot */
+    double snapshotUpper = m_upperSlope, snapshotLower = m_lowerSlope;
+
+    if (!m_hasSnapshot) {
+	m_upperSlope = upper;
+	m_lowerSlope = lower;
+    } else {
+	m_upperSlope = std::min(m_upperSlope, upper);
+	m_lowerSlope = std::max(m_lowerSlope, lower);
+    }
+
+    bool doorsOpen = m_lowerSlope > m_upperSlope;
+    bool tooLong = m_maxInterval != 0 && elapsed > (time_t) m_maxInterval;
+
+    if (m_hasSnapshot && (doorsOpen || tooLong)) {
+	/* archive the previous sample and restart the doors from it. The
+	 * archived value is taken from the middle of the doors rather than
+	 * the sample itself: it is within the error of the sample, and
+	 * unlike the sample, the line to it is within the error of all
+	 * samples before, so the bound holds for every segment. */
+	double slope = (snapshotUpper + snapshotLower) / 2;
+	rowValue = m_rowValue + slope * (m_snapshotTime - m_rowTime);
+	rowTime = m_snapshotTime;
+	reset(rowValue, rowTime);
+	m_lastSample = time;
+
+	elapsed = time - m_rowTime;
+	if (elapsed > 0) {
+	    m_upperSlope = (value + error - m_rowValue) / elapsed;
+	    m_lowerSlope = (value - error - m_rowValue) / elapsed;
+	    m_hasSnapshot = true;
+	    m_snapshotValue = value;
+	    m_snapshotTime = time;
+	}
+	return Store;
+    }
+
+    m_hasSnapshot = true;
+    m_snapshotValue = value;
+    m_snapshotTime = time;
+    return Extend;
+}
@@ -0,0 +1,98 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STORAGEPOLICY_H__
+#define __STORAGEPOLICY_H__
+
+#include <ctime>
+#include <string>
+
+/*
+ * Decides per sample of a numeric sensor whether it starts a new row in
+ * the DB or only extends the open one, replacing the global rate limit
+ * for that sensor. The decision is made incrementally from the state of
+ * the open row and the samples seen since it was started.
+ *
+ * With swinging door compression, rows start at the archive points: a
+ * line through the start points of consecutive rows deviates from every
+ * sample in between by at most the configured error. Such a row starts
+ * at the sample before the one that caused it, with a value within the
+ * error of that sample.
+ */
+class StoragePolicy
+{
+    public:
+	typedef enum {
+	    OnChange,
+	    RateLimit,
+	    Deadband,
+	    SwingingDoor
+	} Kind;
+
+	typedef enum {
+	    /* drop the sample */
+	    Skip,
+	    /* extend the open row until the sample's time */
+	    Extend,
+	    /* close the open row and start a new one */
+	    Store
+	} Action;
+
+    public:
+	StoragePolicy();
+
+	/* <sensor id>,onchange | <sensor id>,ratelimit,<seconds> |
+	 * <sensor id>,deadband,<delta>[%] |
+	 * <sensor id>,swingingdoor,<max error>[,<max row length in s>] */
+	static bool parse(const std::string& definition, unsigned int& sensor,
+			  StoragePolicy& policy);
+
+	/* false until the open row is known through reset() */
+	bool active() const {
+	    return m_active;
+	}
+	/* the open row was started with the value at the given time */
+	void reset(float value, time_t time);
+	/* for Store, rowValue and rowTime are set to the start of the new row */
+	Action sample(float value, time_t time, float& rowValue, time_t& rowTime);
+
+    private:
+	Action sampleSwingingDoor(float value, time_t time, float& rowValue, time_t& rowTime);
+
+    private:
+	Kind m_kind;
+	double m_parameter;
+	bool m_relative;
+	unsigned int m_maxInterval;
+
+	bool m_active;
+	/* start of the open row */
+	float m_rowValue;
+	time_t m_rowTime;
+	time_t m_lastSample;
+	/* swinging door: last sample, not yet archived, and the slopes of
+	 * the upper and lower door */
+	bool m_hasSnapshot;
+	float m_snapshotValue;
+	time_t m_snapshotTime;
+	double m_upperSlope;
+	double m_lowerSlope;
+};
+
+#endif /* __STORAGEPOLICY_H__ */
@@ -19,6 +19,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <boost/format.hpp>
 #include "TcpHandler.h"
 #include "CommandHandler.h"
 #include "DataHandler.h"
@@ -30,7 +31,14 @@ TcpHandler::TcpHandler(const std::string& host,
 		       ValueCache& cache) :
     IoHandler(db, cache),
     m_socket(*this),
-    m_watchdog(*this)
+    m_writing(false),
+    m_queuedBytes(0),
+    m_maxQueuedBytes(0),
+    m_sentMessages(0),
+    m_failedSends(0),
+    m_rejectedSends(0),
+    m_watchdog(m_timers),
+    m_lastActivity(0)
 {
     boost::system::error_code error;
     boost::asio::ip::tcp::resolver resolver(*this);
@@ -59,76 +67,182 @@ TcpHandler::handleConnect(const boost::system::error_code& error)
     if (error) {
 	doClose(error);
     } else {
-	unsigned int port = Options::commandPort();
-	if (port != 0) {
-	    boost::asio::ip::tcp::endpoint cmdEndpoint(boost::asio::ip::tcp::v4(), port);
-	    m_cmdHandler.reset(new CommandHandler(*this, cmdEndpoint));
+	Listener::EndpointList endpoints;
+
+	endpoints = Listener::endpoints(Options::commandPort(), Options::commandSocket());
+	if (!endpoints.empty()) {
+	    m_cmdHandler.reset(new CommandHandler(*this, endpoints));
 	    m_pcMessageCallback = boost::bind(&CommandHandler::handlePcMessage,
 					      m_cmdHandler, _1);
 	}
-	port = Options::dataPort();
-	if (port != 0) {
-	    boost::asio::ip::tcp::endpoint dataEndpoint(boost::asio::ip::tcp::v4(), port);
-	    m_dataHandler.reset(new DataHandler(*this, dataEndpoint));
-	    m_valueCallback = boost::bind(&DataHandler::handleValue, m_dataHandler, _1);
+	endpoints = Listener::endpoints(Options::dataPort(), Options::dataSocket());
+	if (!endpoints.empty()) {
+	    m_dataHandler.reset(new DataHandler(*this, endpoints));
+	    m_valueCallback = boost::bind(&DataHandler::handleValues, m_dataHandler, _1, _2);
 	}
-	resetWatchdog();
+	m_lastActivity = LatencyStats::now();
+	m_watchdog.start(WatchdogInterval, boost::bind(&TcpHandler::checkWatchdog, this));
 	readStart();
     }
 }
 
 void
-TcpHandler::resetWatchdog()
+TcpHandler::checkWatchdog()
 {
-    m_watchdog.expires_from_now(boost::posix_time::minutes(2));
-    m_watchdog.async_wait(boost::bind(&TcpHandler::watchdogTimeout, this,
-				      boost::asio::placeholders::error));
-}
+    uint64_t idle = LatencyStats::now() - m_lastActivity;
 
-void
-TcpHandler::watchdogTimeout(const boost::system::error_code& error)
-{
-    if (error != boost::asio::error::operation_aborted) {
-	doClose(error);
+    if (idle >= WatchdogTimeout * 1000000000ULL) {
+	doClose(boost::system::error_code());
+    } else {
+	m_watchdog.start(WatchdogInterval, boost::bind(&TcpHandler::checkWatchdog, this));
     }
 }
 
 void
 TcpHandler::readComplete(const boost::system::error_code& error, size_t bytesTransferred)
 {
-    resetWatchdog();
+    m_lastActivity = LatencyStats::now();
     IoHandler::readComplete(error, bytesTransferred);
 }
 
 void
 TcpHandler::doCloseImpl()
 {
+    if (Options::statsDebug()) {
+	outputSendStats(Options::statsDebug());
+    }
+
     m_watchdog.cancel();
+    if (m_uring) {
+	m_uring->cancel(m_socket.native_handle());
+    }
+    m_socket.close();
+
+    /* fail pending sends while the command connections still exist; the
+     * callbacks are taken out first, as they may queue new messages */
+    std::vector<SendCallback> callbacks;
+    for (auto& pending : m_sendQueue) {
+	if (pending.callback) {
+	    callbacks.push_back(SendCallback());
+	    callbacks.back().swap(pending.callback);
+	}
+    }
+    /* the write in flight still uses its buffer until its handler has run
+     * with operation_aborted, which drops it */
+    if (m_writing) {
+	m_sendQueue.resize(1);
+	m_queuedBytes = m_sendQueue.front().data.size();
+    } else {
+	m_sendQueue.clear();
+	m_queuedBytes = 0;
+    }
+    for (size_t i = 0; i < callbacks.size(); i++) {
+	callbacks[i](boost::asio::error::operation_aborted);
+    }
+
     m_cmdHandler.reset();
     m_pcMessageCallback.clear();
     m_dataHandler.reset();
     m_valueCallback.clear();
-    m_socket.close();
 }
 
 void
-TcpHandler::sendMessage(const EmsMessage& msg)
+TcpHandler::sendMessage(const EmsMessage& msg, const SendCallback& callback)
 {
-    boost::system::error_code error;
-    std::vector<uint8_t> sendData = msg.getSendData();
+    if (m_sendQueue.size() >= MaxQueuedMessages) {
+	m_rejectedSends++;
+	if (callback) {
+	    post(boost::bind(callback, boost::asio::error::no_buffer_space));
+	}
+	return;
+    }
+
+    m_sendQueue.push_back(PendingSend());
+
+    PendingSend& pending = m_sendQueue.back();
     DebugStream& debug = Options::ioDebug();
 
+    pending.data = msg.getSendData();
+    pending.callback = callback;
+    pending.queueTime = LatencyStats::now();
+
     if (debug) {
 	debug << "IO: Sending bytes ";
-	for (size_t i = 0; i < sendData.size(); i++) {
+	for (size_t i = 0; i < pending.data.size(); i++) {
 	    debug << std::setfill('0') << std::setw(2)
 		  << std::showbase << std::hex
-		  << (unsigned int) sendData[i] << " ";
+		  << (unsigned int) pending.data[i] << " ";
 	}
 	debug << std::endl;
     }
 
-    boost::asio::write(m_socket, boost::asio::buffer(sendData),
-		       boost::asio::transfer_all(), error);
+    m_queuedBytes += pending.data.size();
+    m_maxQueuedBytes = std::max(m_maxQueuedBytes, m_queuedBytes);
+
+    if (!m_writing) {
+	writeNext();
+    }
+}
+
+void
+TcpHandler::writeNext()
+{
+    m_writing = true;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_sendQueue.front().data),
+			     boost::bind(&TcpHandler::handleWrite, this,
+					 boost::asio::placeholders::error));
 }
 
+void
+TcpHandler::handleWrite(const boost::system::error_code& error)
+{
+    m_writing = false;
+
+    if (error == boost::asio::error::operation_aborted) {
+	/* socket was closed, the callbacks were already called */
+	m_sendQueue.clear();
+	m_queuedBytes = 0;
+	return;
+    }
+
+    PendingSend sent(std::move(m_sendQueue.front()));
+    m_sendQueue.pop_front();
+    m_queuedBytes -= sent.data.size();
+
+    if (error) {
+	m_failedSends++;
+    } else {
+	m_sentMessages++;
+	LatencyStats::record(LatencyStats::BusWrite, sent.queueTime);
+	if (!m_sendQueue.empty()) {
+	    writeNext();
+	}
+    }
+
+    if (sent.callback) {
+	sent.callback(error);
+    }
+    if (error) {
+	/* the gateway connection is unusable, handle it like a read error */
+	doClose(error);
+    }
+}
+
+void
+TcpHandler::outputSendStats(std::ostream& stream)
+{
+    stream << "messages sent: " << m_sentMessages << std::endl;
+    stream << "send failures: " << m_failedSends << std::endl;
+    stream << "rejected (queue full): " << m_rejectedSends << std::endl;
+    stream << boost::format("queued: %d messages, %d bytes (max %d bytes)")
+	    % m_sendQueue.size() % m_queuedBytes % m_maxQueuedBytes << std::endl;
+}
+
+void
+TcpHandler::resetSendStats()
+{
+    m_maxQueuedBytes = m_queuedBytes;
+    m_sentMessages = 0;
+    m_failedSends = 0;
+    m_rejectedSends = 0;
+}
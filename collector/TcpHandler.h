@@ -21,6 +21,8 @@
 #define __TCPHANDLER_H__
 
 #include "IoHandler.h"
+#include <deque>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
 class CommandHandler;
@@ -31,10 +33,21 @@ class TcpHandler : public IoHandler
     public:
 	TcpHandler(const std::string& host, const std::string& port, Database& db, ValueCache& cache);
 	~TcpHandler();
-	void sendMessage(const EmsMessage& msg);
+
+	/* called when the message was written to the bus or failed to */
+	typedef boost::function<void (const boost::system::error_code& error)> SendCallback;
+	/* queues the message for sending; if the queue is full, the callback
+	 * is called with no_buffer_space */
+	void sendMessage(const EmsMessage& msg, const SendCallback& callback = SendCallback());
+	void outputSendStats(std::ostream& stream);
+	void resetSendStats();
 
     protected:
 	virtual void readStart() {
+	    if (m_uring) {
+		readStartUring(m_socket.native_handle());
+		return;
+	    }
 	    /* Start an asynchronous read and call read_complete when it completes or fails */
 	    m_socket.async_read_some(boost::asio::buffer(m_recvBuffer, maxReadLength),
 				     boost::bind(&TcpHandler::readComplete, this,
@@ -47,12 +60,35 @@ class TcpHandler : public IoHandler
 
     private:
 	void handleConnect(const boost::system::error_code& error);
-	void resetWatchdog();
-	void watchdogTimeout(const boost::system::error_code& error);
+	void checkWatchdog();
+	void writeNext();
+	void handleWrite(const boost::system::error_code& error);
 
     private:
+	/* maximum number of messages waiting to be written */
+	static const size_t MaxQueuedMessages = 16;
+	/* close the connection if nothing was read for this long */
+	static const unsigned int WatchdogTimeout = 120; /* s */
+	static const unsigned int WatchdogInterval = 1000; /* ms */
+
+	struct PendingSend {
+	    std::vector<uint8_t> data;
+	    SendCallback callback;
+	    uint64_t queueTime;
+	};
+
 	boost::asio::ip::tcp::socket m_socket;
-	boost::asio::deadline_timer m_watchdog;
+	/* the front entry is being written if m_writing is set */
+	std::deque<PendingSend> m_sendQueue;
+	bool m_writing;
+	size_t m_queuedBytes;
+	size_t m_maxQueuedBytes;
+	uint64_t m_sentMessages;
+	uint64_t m_failedSends;
+	uint64_t m_rejectedSends;
+	/* reads only update the timestamp, a wheel timer checks it */
+	TimerWheel::Timer m_watchdog;
+	uint64_t m_lastActivity;
 	boost::shared_ptr<CommandHandler> m_cmdHandler;
 	boost::shared_ptr<DataHandler> m_dataHandler;
 };
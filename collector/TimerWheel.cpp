@@ -0,0 +1,169 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/bind.hpp>
+#include "TimerWheel.h"
+
+TimerWheel::Timer::Timer(TimerWheel& wheel) :
+    m_wheel(wheel),
+    m_rounds(0)
+{
+    prev = next = NULL;
+}
+
+void
+TimerWheel::Timer::start(unsigned int milliseconds, const Callback& callback)
+{
+    cancel();
+    m_callback = callback;
+    m_wheel.add(this, milliseconds);
+}
+
+void
+TimerWheel::Timer::cancel()
+{
+    if (pending()) {
+	m_wheel.cancel(this);
+    }
+    m_callback.clear();
+}
+
+TimerWheel::TimerWheel(boost::asio::io_service& service) :
+    m_timer(service),
+    m_running(false),
+    m_current(0),
+    m_pending(0)
+{
+    for (unsigned int i = 0; i < SlotCount; i++) {
+	m_slots[i].prev = m_slots[i].next = &m_slots[i];
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    /* timers may outlive the wheel, make sure they don't point into it */
+    for (unsigned int i = 0; i < SlotCount; i++) {
+	while (m_slots[i].next != &m_slots[i]) {
+	    remove(m_slots[i].next);
+	}
+    }
+}
+
+void
+TimerWheel::insert(Link *head, Link *link)
+{
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+void
+TimerWheel::remove(Link *link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = link->next = NULL;
+}
+
+void
+TimerWheel::add(Timer *timer, unsigned int milliseconds)
+{
+    /* round up, and count the partial tick currently in progress as
+     * none, so the timer never expires early */
+    unsigned int ticks = (milliseconds + TickMilliseconds - 1) / TickMilliseconds + 1;
+
+    timer->m_rounds = (ticks - 1) / SlotCount;
+    insert(&m_slots[(m_current + ticks) % SlotCount], timer);
+    m_pending++;
+
+    if (!m_running) {
+	m_running = true;
+	m_nextTick = boost::posix_time::microsec_clock::universal_time() +
+		boost::posix_time::milliseconds(TickMilliseconds);
+	m_timer.expires_at(m_nextTick);
+	m_timer.async_wait(boost::bind(&TimerWheel::tick, this,
+				       boost::asio::placeholders::error));
+    }
+}
+
+void
+TimerWheel::cancel(Timer *timer)
+{
+    remove(timer);
+    m_pending--;
+}
+
+void
+TimerWheel::tick(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    }
+
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    /* catch up on ticks missed because the io_service was busy */
+    while (m_pending > 0 && m_nextTick <= now) {
+	m_current = (m_current + 1) % SlotCount;
+	m_nextTick += boost::posix_time::milliseconds(TickMilliseconds);
+	expireSlot(&m_slots[m_current]);
+    }
+
+    if (m_pending == 0) {
+	m_running = false;
+	return;
+    }
+
+    m_timer.expires_at(m_nextTick);
+    m_timer.async_wait(boost::bind(&TimerWheel::tick, this,
+				   boost::asio::placeholders::error));
+}
+
+void
+TimerWheel::expireSlot(Link *slot)
+{
+    Link expired;
+
+    /* move the slot contents to a local list first, as callbacks may
+     * start or cancel timers, including ones in this slot */
+    expired.prev = expired.next = &expired;
+    while (slot->next != slot) {
+	Link *link = slot->next;
+	remove(link);
+	insert(&expired, link);
+    }
+
+    while (expired.next != &expired) {
+	Timer *timer = static_cast<Timer *>(expired.next);
+
+	remove(timer);
+	if (timer->m_rounds > 0) {
+	    timer->m_rounds--;
+	    insert(slot, timer);
+	    continue;
+	}
+
+	/* the callback may destroy or restart the timer */
+	Callback callback;
+	callback.swap(timer->m_callback);
+	m_pending--;
+	callback();
+    }
+}
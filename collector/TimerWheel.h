@@ -0,0 +1,94 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+/*
+ * Hashed timing wheel running on an io_service. Starting and cancelling
+ * a timer is O(1) and does not touch the io_service; the wheel itself
+ * only keeps one deadline_timer armed while any timer is pending.
+ * Expiry is rounded up to the next tick, so timers never fire early.
+ */
+class TimerWheel : private boost::noncopyable
+{
+    private:
+	/* node of the doubly linked, circular slot lists */
+	struct Link {
+	    Link *prev;
+	    Link *next;
+	};
+
+    public:
+	typedef boost::function<void ()> Callback;
+
+	class Timer : private Link, private boost::noncopyable
+	{
+	    public:
+		Timer(TimerWheel& wheel);
+		~Timer() {
+		    cancel();
+		}
+
+		/* a pending timer is cancelled first */
+		void start(unsigned int milliseconds, const Callback& callback);
+		void cancel();
+		bool pending() const {
+		    return next != NULL;
+		}
+
+	    private:
+		friend class TimerWheel;
+
+		TimerWheel& m_wheel;
+		Callback m_callback;
+		/* full wheel revolutions left before firing */
+		unsigned int m_rounds;
+	};
+
+    public:
+	static const unsigned int TickMilliseconds = 50;
+
+	TimerWheel(boost::asio::io_service& service);
+	~TimerWheel();
+
+    private:
+	static const unsigned int SlotCount = 256;
+
+	static void insert(Link *head, Link *link);
+	static void remove(Link *link);
+
+	void add(Timer *timer, unsigned int milliseconds);
+	void cancel(Timer *timer);
+	void tick(const boost::system::error_code& error);
+	void expireSlot(Link *slot);
+
+	boost::asio::deadline_timer m_timer;
+	boost::posix_time::ptime m_nextTick;
+	bool m_running;
+	unsigned int m_current;
+	size_t m_pending;
+	Link m_slots[SlotCount];
+};
+
+#endif /* __TIMERWHEEL_H__ */
@@ -17,292 +17,552 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <map>
-#include <sstream>
-#include <boost/format.hpp>
-#include "CommandHandler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <asm/byteorder.h>
 #include "ValueApi.h"
 
-std::string
-ValueApi::getTypeName(EmsValue::Type type)
+struct EnumLabel {
+    uint8_t value;
+    /* API name and german description, NULL if there is none */
+    const char *name;
+    const char *description;
+};
+
+struct TypeInfo {
+    EmsValue::Type type;
+    const char *name;
+    const char *description;
+    const char *unit;
+    /* terminated by an entry with NULL name and description */
+    const EnumLabel *labels;
+};
+
+struct SubTypeInfo {
+    EmsValue::SubType subtype;
+    const char *name;
+    const char *description;
+};
+
+/*
+ * All names are kept in constant tables indexed by the enum values, so
+ * lookups neither allocate nor search. The static_asserts below make sure
+ * the tables are kept in sync with EmsValue when adding types.
+ */
+
+static constexpr EnumLabel WWSYSTEMLABELS[] = {
+    { EmsProto::WWSystemNone, "none", "keins" },
+    { EmsProto::WWSystemDurchlauf, "tankless", "Durchlauferhitzer" },
+    { EmsProto::WWSystemKlein, "small", "klein" },
+    { EmsProto::WWSystemGross, "large", "groß" },
+    { EmsProto::WWSystemSpeicherlade, "speicherladesystem", "Speicherladesystem" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel ZIRKSPLABELS[] = {
+    { 0, "off", "aus" },
+    { 1, "1x", "1x 3min" },
+    { 2, "2x", "2x 3min" },
+    { 3, "3x", "3x 3min" },
+    { 4, "4x", "4x 3min" },
+    { 5, "5x", "5x 3min" },
+    { 6, "6x", "6x 3min" },
+    { 7, "alwayson", "dauerhaft an" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel MAINTENANCEMESSAGESLABELS[] = {
+    { 0, "off", "keine" },
+    { 1, "byhours", "nach Betriebsstunden" },
+    { 2, "bydate", "nach Datum" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel MAINTENANCENEEDEDLABELS[] = {
+    { 0, "no", "nein" },
+    { 3, "byhours", "ja, wegen Betriebsstunden" },
+    { 8, "bydate", "ja, wegen Datum" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel OPMODELABELS[] = {
+    { 0, "off", "ständig aus" },
+    { 1, "on", "ständig an" },
+    { 2, "auto", "Automatik" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel DAYLABELS[] = {
+    { 0, "monday", "Montag" },
+    { 1, "tuesday", "Dienstag" },
+    { 2, "wednesday", "Mittwoch" },
+    { 3, "thursday", "Donnerstag" },
+    { 4, "friday", "Freitag" },
+    { 5, "saturday", "Samstag" },
+    { 6, "sunday", "Sonntag" },
+    { 7, "everyday", NULL },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel BUILDINGTYPELABELS[] = {
+    { 0, "light", "leicht" },
+    { 1, "medium", "mittel" },
+    { 2, "heavy", "schwer" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel HEATINGTYPELABELS[] = {
+    { 1, "heater", "Heizkörper" },
+    { 2, "convector", "Konvektor" },
+    { 3, "floorheater", "Fußboden" },
+    { 4, "roomvorlauf", "Raumvorlauf" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel CONTROLTYPELABELS[] = {
+    { 0, "offmode", "Abschalt" },
+    { 1, "reduced", "Reduziert" },
+    { 2, "raumhalt", "Raumhalt" },
+    { 3, "aussenhalt", "Außenhalt" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel FROSTPROTECTLABELS[] = {
+    { 0, "off", "kein" },
+    { 1, "byoutdoortemp", "Außentemperatur" },
+    { 2, "byindoortemp", "Raumtemperatur 5 Grad" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel RELEVANTVALUELABELS[] = {
+    { 0, "outdoor", "außentemperaturgeführt" },
+    { 1, "indoor", "raumtemperaturgeführt" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel VACATIONREDUCTIONLABELS[] = {
+    { 3, "outdoor", "Außenhalt" },
+    { 2, "indoor", "Raumhalt" },
+    { 0, NULL, NULL }
+};
+
+static constexpr EnumLabel ERRORTYPELABELS[] = {
+    { 0x10, "L", "Verriegelnder Fehler" },
+    { 0x11, "B", "Blockierender Fehler" },
+    { 0x12, "S", "Anlagenfehler" },
+    { 0x13, "D", "Zurückgesetzter Anlagenfehler" },
+    { 0, NULL, NULL }
+};
+
+static constexpr TypeInfo TYPES[] = {
+    { EmsValue::SollTemp, "targettemperature", "Solltemperatur", "°C", NULL },
+    { EmsValue::IstTemp, "currenttemperature", "Isttemperatur", "°C", NULL },
+    { EmsValue::SetTemp, "settemperature", "Temperatureinstellung", "°C", NULL },
+    { EmsValue::MinTemp, "mintemperature", "Minimale Temperatur", "°C", NULL },
+    { EmsValue::MaxTemp, "maxtemperature", "Maximale Temperatur", "°C", NULL },
+    { EmsValue::TagTemp, "daytemperature", "Tagtemperatur", "°C", NULL },
+    { EmsValue::NachtTemp, "nighttemperature", "Nachttemperatur", "°C", NULL },
+    { EmsValue::UrlaubTemp, "vacationtemperature", "Urlaubstemperatur", "°C", NULL },
+    { EmsValue::RaumEinfluss, "maxroomeffect", "Max. Raumeinfluss", "K", NULL },
+    { EmsValue::RaumOffset, "roomoffset", "Raumoffset", "K", NULL },
+    { EmsValue::GedaempfteTemp, "dampedtemperature", "Temperatur (gedämpft)", "°C", NULL },
+    { EmsValue::DesinfektionsTemp, "desinfectiontemperature", "Desinfektionstemperatur", "°C", NULL },
+    { EmsValue::TemperaturAenderung, "temperaturechange", "Temperaturänderung", "K/min", NULL },
+    { EmsValue::Mischersteuerung, "mixercontrol", "Mischersteuerung", "", NULL },
+    { EmsValue::Flammenstrom, "flamecurrent", "Flammenstrom", "µA", NULL },
+    { EmsValue::Systemdruck, "pressure", "Systemdruck", "bar", NULL },
+    { EmsValue::IstModulation, "currentmodulation", "Istwert Modulation", "%", NULL },
+    { EmsValue::MinModulation, "minmodulation", "Min. Modulation", "%", NULL },
+    { EmsValue::MaxModulation, "maxmodulation", "Max. Modulation", "%", NULL },
+    { EmsValue::SollModulation, "targetmodulation", "Sollwert Modulation", "%", NULL },
+    { EmsValue::EinschaltHysterese, "onhysteresis", "Einschalthysterese", "K", NULL },
+    { EmsValue::AusschaltHysterese, "offhysteresis", "Abschalthysterese", "K", NULL },
+    { EmsValue::SchwelleSommerWinter, "summerwinterthreshold", "Schwelle Sommer/Winter", "°C", NULL },
+    { EmsValue::FrostSchutzTemp, "frostsafetemperature", "Frostschutztemperatur", "°C", NULL },
+    { EmsValue::AuslegungsTemp, "designtemperature", "Auslegungstemperatur", "°C", NULL },
+    { EmsValue::RaumUebersteuerTemp, "temperatureoverride", "Temporäre Raumtemperaturübersteuerung", "°C", NULL },
+    { EmsValue::AbsenkungsSchwellenTemp, "reducedmodethreshold", "Schwellentemperatur Außenhaltbetrieb", "°C", NULL },
+    { EmsValue::UrlaubAbsenkungsSchwellenTemp, "vacationreducedmodethreshold", "Schwellentemperatur Außenhaltbetrieb Urlaub", "°C", NULL },
+    { EmsValue::AbsenkungsAbbruchTemp, "cancelreducedmodethreshold", "Nachtabsenkung abbrechen unterhalb", "°C", NULL },
+    { EmsValue::BetriebsZeit, "operatingminutes", "Betriebszeit", "min", NULL },
+    { EmsValue::HeizZeit, "heatingminutes", "Heizzeit", "min", NULL },
+    { EmsValue::WarmwasserbereitungsZeit, "warmwaterminutes", "WW-Bereitungszeit", "min", NULL },
+    { EmsValue::Brennerstarts, "heaterstarts", "Brennerstarts", "", NULL },
+    { EmsValue::WarmwasserBereitungen, "warmwaterpreparations", "WW-Bereitungen ", "", NULL },
+    { EmsValue::DesinfektionStunde, "desinfectionhour", "Thermische Desinfektion Stunde", "h", NULL },
+    { EmsValue::HektoStundenVorWartung, "maintenanceintervalin100hours", "Wartungsintervall in 100h", "", NULL },
+    { EmsValue::EinschaltoptimierungsZeit, "onoptimizationminutes", "Einschaltoptimierungszeit", "min", NULL },
+    { EmsValue::AusschaltoptimierungsZeit, "offoptimizationminutes", "Abschaltoptimierungszeit", "min", NULL },
+    { EmsValue::AntipendelZeit, "antipendelminutes", "Antipendelzeit", "min", NULL },
+    { EmsValue::NachlaufZeit, "followupminutes", "Nachlaufzeit", "min", NULL },
+    { EmsValue::PartyZeit, "partyhours", "restl. Partyzeit", "h", NULL },
+    { EmsValue::PausenZeit, "pausehours", "restl. Pausenzeit", "h", NULL },
+    { EmsValue::FlammeAktiv, "flameactive", "Flamme", "", NULL },
+    { EmsValue::BrennerAktiv, "heateractive", "Brenner", "", NULL },
+    { EmsValue::ZuendungAktiv, "ignitionactive", "Zündung", "", NULL },
+    { EmsValue::PumpeAktiv, "pumpactive", "Pumpe", "", NULL },
+    { EmsValue::ZirkulationAktiv, "zirkpumpactive", "Zirkulation", "", NULL },
+    { EmsValue::DreiWegeVentilAufWW, "3wayonww", "3-Wege-Ventil auf WW", "", NULL },
+    { EmsValue::EinmalLadungAktiv, "onetimeload", "Einmalladung", "", NULL },
+    { EmsValue::DesinfektionAktiv, "desinfectionactive", "Therm. Desinfektion", "", NULL },
+    { EmsValue::NachladungAktiv, "boostcharge", "Nachladung", "", NULL },
+    { EmsValue::WarmwasserBereitung, "warmwaterpreparationactive", "WW-Bereitung", "", NULL },
+    { EmsValue::WarmwasserTempOK, "warmwatertempok", "WW-Temperatur OK", "", NULL },
+    { EmsValue::Automatikbetrieb, "automode", "Automatikbetrieb", "", NULL },
+    { EmsValue::Tagbetrieb, "daymode", "Tagbetrieb", "", NULL },
+    { EmsValue::Sommerbetrieb, "summermode", "Sommerbetrieb", "", NULL },
+    { EmsValue::Ausschaltoptimierung, "offoptimization", "Ausschaltoptimierung", "", NULL },
+    { EmsValue::Einschaltoptimierung, "onoptimization", "Einschaltoptimierung", "", NULL },
+    { EmsValue::Estrichtrocknung, "floordrying", "Estrichtrocknung", "", NULL },
+    { EmsValue::WWVorrang, "wwoverride", "WW-Vorrang", "", NULL },
+    { EmsValue::Ferien, "holidaymode", "Ferienbetrieb", "", NULL },
+    { EmsValue::Urlaub, "vacationmode", "Urlaubsbetrieb", "", NULL },
+    { EmsValue::Party, "partymode", "Partybetrieb", "", NULL },
+    { EmsValue::Pause, "pausemode", "Pausebetrieb", "", NULL },
+    { EmsValue::Frostschutzbetrieb, "frostsafemodeactive", "Frostschutzbetrieb", "", NULL },
+    { EmsValue::SchaltuhrEin, "switchpointactive", "Schaltuhr aktiv", "", NULL },
+    { EmsValue::KesselSchalter, "masterswitch", "per Kesselschalter freigegeben", "", NULL },
+    { EmsValue::EigenesProgrammAktiv, "customschedule", "Eigenes Programm aktiv", "", NULL },
+    { EmsValue::Desinfektion, "desinfection", "Thermische Desinfektion", "", NULL },
+    { EmsValue::EinmalLadungsLED, "onetimeloadindicator", "Einmalladungs-LED", "", NULL },
+    { EmsValue::ATDaempfung, "damping", "Dämpfung Außentemperatur", "", NULL },
+    { EmsValue::SchaltzeitOptimierung, "scheduleoptimizer", "Schaltzeitoptimierung", "", NULL },
+    { EmsValue::WWSystemType, "warmwatersystemtype", "WW-System-Typ", "", WWSYSTEMLABELS },
+    { EmsValue::Schaltpunkte, "switchpoints", "Schaltpunkte", "", ZIRKSPLABELS },
+    { EmsValue::Wartungsmeldungen, "maintenancereminder", "Wartungsmeldungen", "", MAINTENANCEMESSAGESLABELS },
+    { EmsValue::WartungFaellig, "maintenancedue", "Wartung fällig?", "", MAINTENANCENEEDEDLABELS },
+    { EmsValue::Betriebsart, "opmode", "Betriebsart", "", OPMODELABELS },
+    { EmsValue::DesinfektionTag, "desinfectionday", "Thermische Desinfektion Tag", "", DAYLABELS },
+    { EmsValue::GebaeudeArt, "buildingtype", "Gebäudeart", "", BUILDINGTYPELABELS },
+    { EmsValue::HeizArt, "heatingtype", "Heizart", "", HEATINGTYPELABELS },
+    { EmsValue::RegelungsArt, "controltype", "Regelungsart", "", CONTROLTYPELABELS },
+    { EmsValue::HeizSystem, "heatsystem", "Heizsystem", "", HEATINGTYPELABELS },
+    { EmsValue::FuehrungsGroesse, "relevantparameter", "Führungsgröße", "", RELEVANTVALUELABELS },
+    { EmsValue::UrlaubAbsenkungsArt, "vacationreductionmode", "Urlaubsabsenkungsart", "", VACATIONREDUCTIONLABELS },
+    { EmsValue::Frostschutz, "frostsafemode", "Frostschutz", "", FROSTPROTECTLABELS },
+    { EmsValue::HKKennlinie, "characteristic", "Kennlinie", "", NULL },
+    { EmsValue::Fehler, "error", "Fehler", "", NULL },
+    { EmsValue::SystemZeit, "systemtime", "Systemzeit", "", NULL },
+    { EmsValue::Wartungstermin, "maintenancedate", "Wartungstermin", "", NULL },
+    { EmsValue::ServiceCode, "servicecode", "Servicecode", "", NULL },
+    { EmsValue::FehlerCode, "errorcode", "Fehlercode", "", NULL }
+};
+
+static constexpr SubTypeInfo SUBTYPES[] = {
+    { EmsValue::None, "", "" },
+    { EmsValue::HK1, "hk1", "HK1" },
+    { EmsValue::HK2, "hk2", "HK2" },
+    { EmsValue::HK3, "hk3", "HK3" },
+    { EmsValue::HK4, "hk4", "HK4" },
+    { EmsValue::Brenner, "burner", "Brenner" },
+    { EmsValue::Kessel, "heater", "Kessel" },
+    { EmsValue::KesselPumpe, "heaterpump", "Kesselpumpe" },
+    { EmsValue::Ruecklauf, "returnflow", "Rücklauf" },
+    { EmsValue::Waermetauscher, "heatexchanger", "Wärmetauscher" },
+    { EmsValue::WW, "ww", "Warmwasser" },
+    { EmsValue::Zirkulation, "zirkpump", "Zirkulation" },
+    { EmsValue::Raum, "indoor", "Raum" },
+    { EmsValue::Aussen, "outdoor", "Außen" },
+    { EmsValue::Abgas, "exhaust", "Abgas" }
+};
+
+static constexpr size_t TypeTableSize = sizeof(TYPES) / sizeof(TYPES[0]);
+static constexpr size_t SubTypeTableSize = sizeof(SUBTYPES) / sizeof(SUBTYPES[0]);
+
+static constexpr bool
+typesInOrder(size_t index)
 {
-    static const std::map<EmsValue::Type, const char *> TYPEMAPPING = {
-	{ EmsValue::SollTemp, "targettemperature" },
-	{ EmsValue::IstTemp, "currenttemperature" },
-	{ EmsValue::SetTemp, "settemperature" },
-	{ EmsValue::MinTemp, "mintemperature" },
-	{ EmsValue::MaxTemp, "maxtemperature" },
-	{ EmsValue::TagTemp, "daytemperature" },
-	{ EmsValue::NachtTemp, "nighttemperature" },
-	{ EmsValue::UrlaubTemp, "vacationtemperature" },
-	{ EmsValue::RaumEinfluss, "maxroomeffect" },
-	{ EmsValue::RaumOffset, "roomoffset" },
-	{ EmsValue::SchwelleSommerWinter, "summerwinterthreshold" },
-	{ EmsValue::FrostSchutzTemp, "frostsafetemperature" },
-	{ EmsValue::AuslegungsTemp, "designtemperature" },
-	{ EmsValue::RaumUebersteuerTemp, "temperatureoverride" },
-	{ EmsValue::AbsenkungsSchwellenTemp, "reducedmodethreshold" },
-	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "vacationreducedmodethreshold" },
-	{ EmsValue::AbsenkungsAbbruchTemp, "cancelreducedmodethreshold" },
-	{ EmsValue::GedaempfteTemp, "dampedtemperature" },
-	{ EmsValue::DesinfektionsTemp, "desinfectiontemperature" },
-	{ EmsValue::TemperaturAenderung, "temperaturechange" },
-	{ EmsValue::Mischersteuerung, "mixercontrol" },
-	{ EmsValue::Flammenstrom, "flamecurrent" },
-	{ EmsValue::Systemdruck, "pressure" },
-	{ EmsValue::BetriebsZeit, "operatingminutes" },
-	{ EmsValue::MinModulation, "minmodulation" },
-	{ EmsValue::MaxModulation, "maxmodulation" },
-	{ EmsValue::SollModulation, "targetmodulation" },
-	{ EmsValue::IstModulation, "currentmodulation" },
-	{ EmsValue::EinschaltHysterese, "onhysteresis" },
-	{ EmsValue::AusschaltHysterese, "offhysteresis" },
-
-	{ EmsValue::HeizZeit, "heatingminutes" },
-	{ EmsValue::WarmwasserbereitungsZeit, "warmwaterminutes" },
-	{ EmsValue::Brennerstarts, "heaterstarts" },
-	{ EmsValue::WarmwasserBereitungen, "warmwaterpreparations" },
-	{ EmsValue::EinschaltoptimierungsZeit, "onoptimizationminutes" },
-	{ EmsValue::AusschaltoptimierungsZeit, "offoptimizationminutes" },
-	{ EmsValue::AntipendelZeit, "antipendelminutes" },
-	{ EmsValue::NachlaufZeit, "followupminutes" },
-	{ EmsValue::DesinfektionStunde, "desinfectionhour" },
-	{ EmsValue::HektoStundenVorWartung, "maintenanceintervalin100hours" },
-	{ EmsValue::PausenZeit, "pausehours" },
-	{ EmsValue::PartyZeit, "partyhours" },
-
-	{ EmsValue::FlammeAktiv, "flameactive" },
-	{ EmsValue::BrennerAktiv, "heateractive" },
-	{ EmsValue::ZuendungAktiv, "ignitionactive" },
-	{ EmsValue::PumpeAktiv, "pumpactive" },
-	{ EmsValue::ZirkulationAktiv, "zirkpumpactive" },
-	{ EmsValue::DreiWegeVentilAufWW, "3wayonww" },
-	{ EmsValue::EinmalLadungAktiv, "onetimeload" },
-	{ EmsValue::DesinfektionAktiv, "desinfectionactive" },
-	{ EmsValue::Desinfektion, "desinfection" },
-	{ EmsValue::NachladungAktiv, "boostcharge" },
-	{ EmsValue::WarmwasserBereitung, "warmwaterpreparationactive" },
-	{ EmsValue::WarmwasserTempOK, "warmwatertempok" },
-	{ EmsValue::Automatikbetrieb, "automode" },
-	{ EmsValue::Tagbetrieb, "daymode" },
-	{ EmsValue::Sommerbetrieb, "summermode" },
-	{ EmsValue::Ausschaltoptimierung, "offoptimization" },
-	{ EmsValue::Einschaltoptimierung, "onoptimization" },
-	{ EmsValue::Estrichtrocknung, "floordrying" },
-	{ EmsValue::WWVorrang, "wwoverride" },
-	{ EmsValue::Urlaub, "vacationmode" },
-	{ EmsValue::Ferien, "holidaymode" },
-	{ EmsValue::Party, "partymode" },
-	{ EmsValue::Pause, "pausemode" },
-	{ EmsValue::Frostschutzbetrieb, "frostsafemodeactive" },
-	{ EmsValue::SchaltuhrEin, "switchpointactive" },
-	{ EmsValue::KesselSchalter, "masterswitch" },
-	{ EmsValue::EigenesProgrammAktiv, "customschedule" },
-	{ EmsValue::EinmalLadungsLED, "onetimeloadindicator" },
-	{ EmsValue::ATDaempfung, "damping" },
-	{ EmsValue::SchaltzeitOptimierung, "scheduleoptimizer" },
-
-	{ EmsValue::WWSystemType, "warmwatersystemtype" },
-	{ EmsValue::Schaltpunkte, "switchpoints" },
-	{ EmsValue::Wartungsmeldungen, "maintenancereminder" },
-	{ EmsValue::WartungFaellig, "maintenancedue" },
-	{ EmsValue::Betriebsart, "opmode" },
-	{ EmsValue::DesinfektionTag, "desinfectionday" },
-	{ EmsValue::GebaeudeArt, "buildingtype" },
-	{ EmsValue::HeizArt, "heatingtype" },
-	{ EmsValue::RegelungsArt, "controltype" },
-	{ EmsValue::HeizSystem, "heatsystem" },
-	{ EmsValue::FuehrungsGroesse, "relevantparameter" },
-	{ EmsValue::Frostschutz, "frostsafemode" },
-	{ EmsValue::UrlaubAbsenkungsArt, "vacationreductionmode" },
-
-	{ EmsValue::HKKennlinie, "characteristic" },
-	{ EmsValue::Fehler, "error" },
-	{ EmsValue::SystemZeit, "systemtime" },
-	{ EmsValue::Wartungstermin, "maintenancedate" },
-
-	{ EmsValue::ServiceCode, "servicecode" },
-	{ EmsValue::FehlerCode, "errorcode" }
-    };
+    return index >= TypeTableSize ||
+	    (TYPES[index].type == index && typesInOrder(index + 1));
+}
+
+static constexpr bool
+subtypesInOrder(size_t index)
+{
+    return index >= SubTypeTableSize ||
+	    (SUBTYPES[index].subtype == index && subtypesInOrder(index + 1));
+}
+
+static_assert(TypeTableSize == EmsValue::TypeCount, "type table is incomplete");
+static_assert(typesInOrder(0), "type table is not in enum order");
+static_assert(SubTypeTableSize == EmsValue::SubTypeCount, "subtype table is incomplete");
+static_assert(subtypesInOrder(0), "subtype table is not in enum order");
 
-    auto iter = TYPEMAPPING.find(type);
-    if (iter == TYPEMAPPING.end()) {
-	return "";
+static const EnumLabel *
+findLabel(const EnumLabel *labels, uint8_t value)
+{
+    if (!labels) {
+	return NULL;
+    }
+    for (; labels->name || labels->description; labels++) {
+	if (labels->value == value) {
+	    return labels;
+	}
     }
+    return NULL;
+}
 
-    return iter->second;
+const char *
+ValueApi::getTypeName(EmsValue::Type type)
+{
+    return (size_t) type < TypeTableSize ? TYPES[type].name : "";
 }
 
-std::string
+const char *
 ValueApi::getSubTypeName(EmsValue::SubType subtype)
 {
-    static const std::map<EmsValue::SubType, const char *> SUBTYPEMAPPING = {
-	{ EmsValue::HK1, "hk1" },
-	{ EmsValue::HK2, "hk2" },
-	{ EmsValue::HK3, "hk3" },
-	{ EmsValue::HK4, "hk4" },
-	{ EmsValue::Kessel, "heater" },
-	{ EmsValue::KesselPumpe, "heaterpump" },
-	{ EmsValue::Brenner, "burner" },
-	{ EmsValue::Ruecklauf, "returnflow" },
-	{ EmsValue::Waermetauscher, "heatexchanger" },
-	{ EmsValue::WW, "ww" },
-	{ EmsValue::Zirkulation, "zirkpump" },
-	{ EmsValue::Raum, "indoor" },
-	{ EmsValue::Aussen, "outdoor" },
-	{ EmsValue::Abgas, "exhaust" },
-    };
+    return (size_t) subtype < SubTypeTableSize ? SUBTYPES[subtype].name : "";
+}
 
-    auto iter = SUBTYPEMAPPING.find(subtype);
-    if (iter == SUBTYPEMAPPING.end()) {
-	return "";
-    }
+const char *
+ValueApi::getTypeDescription(EmsValue::Type type)
+{
+    return (size_t) type < TypeTableSize ? TYPES[type].description : "";
+}
 
-    return iter->second;
+const char *
+ValueApi::getSubTypeDescription(EmsValue::SubType subtype)
+{
+    return (size_t) subtype < SubTypeTableSize ? SUBTYPES[subtype].description : "";
 }
 
-std::string
-ValueApi::formatValue(const EmsValue& value)
+const char *
+ValueApi::getUnit(EmsValue::Type type)
 {
-    static const std::map<uint8_t, const char *> WWSYSTEMMAPPING = {
-	{ EmsProto::WWSystemNone, "none" },
-	{ EmsProto::WWSystemDurchlauf, "tankless" },
-	{ EmsProto::WWSystemKlein, "small" },
-	{ EmsProto::WWSystemGross, "large" },
-	{ EmsProto::WWSystemSpeicherlade, "speicherladesystem" }
-    };
+    return (size_t) type < TypeTableSize ? TYPES[type].unit : "";
+}
 
-    static const std::map<uint8_t, const char *> ZIRKSPMAPPING = {
-	{ 0, "off" }, { 1, "1x" }, { 2, "2x" }, { 3, "3x" },
-	{ 4, "4x" }, { 5, "5x" }, { 6, "6x" }, { 7, "alwayson" }
-    };
+const char *
+ValueApi::getEnumLabel(EmsValue::Type type, uint8_t value, bool descriptive)
+{
+    if ((size_t) type >= TypeTableSize) {
+	return NULL;
+    }
 
-    static const std::map<uint8_t, const char *> MAINTENANCEMESSAGESMAPPING = {
-	{ 0, "off" }, { 1, "byhours" }, { 2, "bydate" }
-    };
+    const EnumLabel *label = findLabel(TYPES[type].labels, value);
+    if (!label) {
+	return NULL;
+    }
+    return descriptive ? label->description : label->name;
+}
 
-    static const std::map<uint8_t, const char *> MAINTENANCENEEDEDMAPPING = {
-	{ 0, "no" }, { 3, "byhours" }, { 8, "bydate" }
-    };
+const char *
+ValueApi::getErrorTypeLabel(uint8_t type, bool descriptive)
+{
+    const EnumLabel *label = findLabel(ERRORTYPELABELS, type);
+    if (!label) {
+	return NULL;
+    }
+    return descriptive ? label->description : label->name;
+}
 
-    static const std::map<uint8_t, const char *> ERRORTYPEMAPPING = {
-	{ 0x10, "L" }, { 0x11, "B" }, { 0x12, "S" }, { 0x13, "D" }
-    };
+bool
+ValueApi::parseTypeName(const std::string& name, EmsValue::Type& type)
+{
+    for (size_t i = 0; i < TypeTableSize; i++) {
+	if (name == TYPES[i].name) {
+	    type = TYPES[i].type;
+	    return true;
+	}
+    }
 
-    static const std::map<uint8_t, const char *> OPMODEMAPPING = {
-	{ 0, "off" }, { 1, "on" }, { 2, "auto" }
-    };
+    return false;
+}
 
-    static const std::map<uint8_t, const char *> DAYMAPPING = {
-	{ 0, "monday" }, { 1, "tuesday" }, { 2, "wednesday"}, { 3, "thursday" },
-	{ 4, "friday" }, { 5, "saturday" }, { 6, "sunday" }, { 7, "everyday" }
-    };
+bool
+ValueApi::parseSubTypeName(const std::string& name, EmsValue::SubType& subtype)
+{
+    for (size_t i = 0; i < SubTypeTableSize; i++) {
+	if (name == SUBTYPES[i].name) {
+	    subtype = SUBTYPES[i].subtype;
+	    return true;
+	}
+    }
 
-    static const std::map<uint8_t, const char *> BUILDINGTYPEMAPPING = {
-	{ 0, "light" }, { 1, "medium" }, { 2, "heavy" }
-    };
+    return false;
+}
 
-    static const std::map<uint8_t, const char *> HEATINGTYPEMAPPING = {
-	{ 1, "heater" }, { 2, "convector" }, { 3, "floorheater" }, { 4, "roomvorlauf" }
-    };
+namespace {
+    /* appends to a fixed buffer, truncating if it is too small */
+    class BufferWriter {
+	public:
+	    BufferWriter(char *buffer, size_t size) :
+		m_buffer(buffer), m_size(size), m_length(0) {}
 
-    static const std::map<uint8_t, const char *> CONTROLTYPEMAPPING = {
-	{ 0, "offmode" }, { 1, "reduced" }, { 2, "raumhalt" }, { 3, "aussenhalt" }
-    };
+	    void append(const char *text, size_t length) {
+		if (m_length < m_size) {
+		    size_t count = std::min(length, m_size - m_length);
+		    memcpy(m_buffer + m_length, text, count);
+		}
+		m_length += length;
+	    }
+	    void append(const char *text) {
+		append(text, strlen(text));
+	    }
+	    void append(char c) {
+		append(&c, 1);
+	    }
+	    void appendNumber(unsigned int value, unsigned int minDigits = 1) {
+		char digits[16];
+		char *pos = digits + sizeof(digits);
 
-    static const std::map<uint8_t, const char *> FROSTPROTECTMAPPING = {
-	{ 0, "off" }, { 1, "byoutdoortemp" }, { 2, "byindoortemp" }
-    };
+		do {
+		    *--pos = '0' + value % 10;
+		    value /= 10;
+		} while (value != 0 || digits + sizeof(digits) - pos < (ptrdiff_t) minDigits);
+		append(pos, digits + sizeof(digits) - pos);
+	    }
+	    void appendHex(uint8_t value) {
+		static const char digits[] = "0123456789abcdef";
+		append(digits[value >> 4]);
+		append(digits[value & 0xf]);
+	    }
+	    void appendFloat(float value) {
+		/* %g matches what ostream printed with default precision */
+		char digits[32];
+		int length = snprintf(digits, sizeof(digits), "%g", value);
+		append(digits, length);
+	    }
 
-    static const std::map<uint8_t, const char *> RELEVANTVALUEMAPPING = {
-	{ 0, "outdoor" }, { 1, "indoor" }
-    };
+	    size_t finish() {
+		if (m_size > 0) {
+		    m_buffer[std::min(m_length, m_size - 1)] = 0;
+		}
+		return m_length;
+	    }
 
-    static const std::map<uint8_t, const char *> VACATIONREDUCTIONMAPPING = {
-	{ 3, "outdoor" }, { 2, "indoor" }
+	private:
+	    char *m_buffer;
+	    size_t m_size;
+	    size_t m_length;
     };
+}
 
-    std::ostringstream stream;
+size_t
+ValueApi::formatValue(const EmsValue& value, char *buffer, size_t size)
+{
+    BufferWriter writer(buffer, size);
 
     switch (value.getReadingType()) {
 	case EmsValue::Numeric: {
 	    float numValue = value.getValue<float>();
 	    if (std::isnan(numValue)) {
-		stream << "unavailable";
+		writer.append("unavailable");
 	    } else {
-		stream << numValue;
+		writer.appendFloat(numValue);
 	    }
 	    break;
 	}
 	case EmsValue::Integer:
-	    stream << value.getValue<unsigned int>();
+	    writer.appendNumber(value.getValue<unsigned int>());
 	    break;
 	case EmsValue::Boolean:
-	    stream << (value.getValue<bool>() ? "on" : "off");
+	    writer.append(value.getValue<bool>() ? "on" : "off");
 	    break;
 	case EmsValue::Enumeration: {
-	    const std::map<uint8_t, const char *> *map = NULL;
 	    uint8_t enumValue = value.getValue<uint8_t>();
-	    switch (value.getType()) {
-		case EmsValue::WWSystemType: map = &WWSYSTEMMAPPING; break;
-		case EmsValue::Schaltpunkte: map = &ZIRKSPMAPPING; break;
-		case EmsValue::Wartungsmeldungen: map = &MAINTENANCEMESSAGESMAPPING; break;
-		case EmsValue::WartungFaellig: map = &MAINTENANCENEEDEDMAPPING; break;
-		case EmsValue::Betriebsart: map = &OPMODEMAPPING; break;
-		case EmsValue::DesinfektionTag: map = &DAYMAPPING; break;
-		case EmsValue::GebaeudeArt: map = &BUILDINGTYPEMAPPING; break;
-		case EmsValue::HeizArt:
-		case EmsValue::HeizSystem: map = &HEATINGTYPEMAPPING; break;
-		case EmsValue::RegelungsArt: map = &CONTROLTYPEMAPPING; break;
-		case EmsValue::Frostschutz: map = &FROSTPROTECTMAPPING; break;
-		case EmsValue::FuehrungsGroesse: map = &RELEVANTVALUEMAPPING; break;
-		case EmsValue::UrlaubAbsenkungsArt: map = &VACATIONREDUCTIONMAPPING; break;
-		default: break;
-	    }
-	    if (map && map->find(enumValue) != map->end()) {
-		stream << map->at(enumValue);
+	    const char *label = getEnumLabel(value.getType(), enumValue, false);
+	    if (label) {
+		writer.append(label);
 	    } else {
-		stream << (unsigned int) enumValue;
+		writer.appendNumber(enumValue);
 	    }
 	    break;
 	}
 	case EmsValue::Kennlinie: {
-	    std::vector<uint8_t> kennlinie = value.getValue<std::vector<uint8_t> >();
-	    stream << boost::format("%d/%d/%d")
-		    % (unsigned int) kennlinie[0] % (unsigned int) kennlinie[1]
-		    % (unsigned int) kennlinie[2];
+	    const std::vector<uint8_t>& kennlinie = value.getValue<std::vector<uint8_t> >();
+	    writer.appendNumber(kennlinie[0]);
+	    writer.append('/');
+	    writer.appendNumber(kennlinie[1]);
+	    writer.append('/');
+	    writer.appendNumber(kennlinie[2]);
 	    break;
 	}
 	case EmsValue::Error: {
-	    EmsValue::ErrorEntry entry = value.getValue<EmsValue::ErrorEntry>();
-	    std::string formatted = CommandConnection::buildRecordResponse(&entry.record);
-	    if (formatted.empty()) {
-		formatted = "empty";
-	    }
+	    const EmsValue::ErrorEntry& entry = value.getValue<EmsValue::ErrorEntry>();
+	    const EmsProto::ErrorRecord& record = entry.record;
+	    const char *type = getErrorTypeLabel(entry.type, false);
 
-	    stream << boost::format("%s%02d %s")
-		    % ERRORTYPEMAPPING.at(entry.type) % entry.index % formatted;
+	    writer.append(type ? type : "?");
+	    writer.appendNumber(entry.index, 2);
+	    writer.append(' ');
+	    /* same format as CommandConnection::buildRecordResponse() */
+	    if (record.errorAscii[0] == 0) {
+		writer.append("empty");
+		break;
+	    }
+	    if (record.time.valid) {
+		writer.appendNumber(2000 + record.time.year, 4);
+		writer.append('-');
+		writer.appendNumber(record.time.month, 2);
+		writer.append('-');
+		writer.appendNumber(record.time.day, 2);
+		writer.append(' ');
+		writer.appendNumber(record.time.hour, 2);
+		writer.append(':');
+		writer.appendNumber(record.time.minute, 2);
+	    } else {
+		writer.append("xxxx-xx-xx xx:xx");
+	    }
+	    writer.append(' ');
+	    writer.appendHex(record.source);
+	    writer.append(' ');
+	    writer.append(record.errorAscii[0]);
+	    writer.append(record.errorAscii[1]);
+	    writer.append(' ');
+	    writer.appendNumber(__be16_to_cpu(record.code_be16));
+	    writer.append(' ');
+	    writer.appendNumber(__be16_to_cpu(record.durationMinutes_be16));
 	    break;
 	}
 	case EmsValue::Date: {
-	    EmsProto::DateRecord record = value.getValue<EmsProto::DateRecord>();
-	    stream << boost::format("%04d-%02d-%02d")
-		    % (2000 + record.year) % (unsigned int) record.month
-		    % (unsigned int) record.day;
+	    const EmsProto::DateRecord& record = value.getValue<EmsProto::DateRecord>();
+	    writer.appendNumber(2000 + record.year, 4);
+	    writer.append('-');
+	    writer.appendNumber(record.month, 2);
+	    writer.append('-');
+	    writer.appendNumber(record.day, 2);
 	    break;
 	}
 	case EmsValue::SystemTime: {
-	    EmsProto::SystemTimeRecord record = value.getValue<EmsProto::SystemTimeRecord>();
-	    stream << boost::format("%04d-%02d-%02d %02d:%02d:%02d")
-		    % (2000 + record.common.year) % (unsigned int) record.common.month
-		    % (unsigned int) record.common.day % (unsigned int) record.common.hour
-		    % (unsigned int)  record.common.minute % (unsigned int) record.second;
+	    const EmsProto::SystemTimeRecord& record =
+		    value.getValue<EmsProto::SystemTimeRecord>();
+	    writer.appendNumber(2000 + record.common.year, 4);
+	    writer.append('-');
+	    writer.appendNumber(record.common.month, 2);
+	    writer.append('-');
+	    writer.appendNumber(record.common.day, 2);
+	    writer.append(' ');
+	    writer.appendNumber(record.common.hour, 2);
+	    writer.append(':');
+	    writer.appendNumber(record.common.minute, 2);
+	    writer.append(':');
+	    writer.appendNumber(record.second, 2);
 	    break;
 	}
-	case EmsValue::Formatted:
-	    stream << value.getValue<std::string>();
+	case EmsValue::Formatted: {
+	    const std::string& text = value.getValue<std::string>();
+	    writer.append(text.data(), text.size());
 	    break;
+	}
+    }
+
+    return writer.finish();
+}
+
+std::string
+ValueApi::formatValue(const EmsValue& value)
+{
+    char buffer[FormatBufferSize];
+    size_t length = formatValue(value, buffer, sizeof(buffer));
+
+    if (length >= sizeof(buffer)) {
+	std::string result(length, 0);
+	formatValue(value, &result[0], length + 1);
+	return result;
     }
 
-    return stream.str();
+    return std::string(buffer, length);
 }
@@ -23,8 +23,25 @@
 #include "EmsMessage.h"
 
 namespace ValueApi {
-    std::string getTypeName(EmsValue::Type type);
-    std::string getSubTypeName(EmsValue::SubType subtype);
+    /* enough for all values except unusually long formatted ones */
+    static const size_t FormatBufferSize = 128;
+
+    /* all names point to static strings, "" if there is none */
+    const char * getTypeName(EmsValue::Type type);
+    const char * getSubTypeName(EmsValue::SubType subtype);
+    /* german names and units, used for debug output */
+    const char * getTypeDescription(EmsValue::Type type);
+    const char * getSubTypeDescription(EmsValue::SubType subtype);
+    const char * getUnit(EmsValue::Type type);
+    /* NULL if the value has no label */
+    const char * getEnumLabel(EmsValue::Type type, uint8_t value, bool descriptive);
+    const char * getErrorTypeLabel(uint8_t type, bool descriptive);
+    /* reverse of the above, return false for unknown names */
+    bool parseTypeName(const std::string& name, EmsValue::Type& type);
+    bool parseSubTypeName(const std::string& name, EmsValue::SubType& subtype);
+    /* like snprintf: always terminates the buffer and returns the length
+     * the formatted value has without truncation */
+    size_t formatValue(const EmsValue& value, char *buffer, size_t size);
     std::string formatValue(const EmsValue& value);
 }
 
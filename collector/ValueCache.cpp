@@ -1,38 +1,380 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include "LatencyStats.h"
+#include "Options.h"
 #include "ValueApi.h"
 #include "ValueCache.h"
 
-ValueCache::ValueCache()
+/*
+ * Snapshot file layout, in host byte order as the file is only meant to
+ * be read back on the same machine:
+ *   uint32 magic, uint32 version, uint32 entry count
+ * per entry:
+ *   uint8 length + type name, uint8 length + subtype name,
+ *   uint8 reading type, int64 timestamp, uint16 length + value bytes
+ * Types are stored by name, so snapshots survive renumbering of the enums.
+ */
+static const uint32_t SnapshotMagic = 0x43534d45; /* 'EMSC' */
+static const uint32_t SnapshotVersion = 1;
+
+template<typename T> static void
+appendRaw(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void
+appendName(std::string& out, const char *name)
+{
+    size_t length = std::min(strlen(name), (size_t) 255);
+    out.push_back((char) length);
+    out.append(name, length);
+}
+
+static void
+appendValue(std::string& out, const EmsValue& value)
+{
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    appendRaw(out, value.getValue<float>());
+	    break;
+	case EmsValue::Integer:
+	    appendRaw(out, (uint32_t) value.getValue<unsigned int>());
+	    break;
+	case EmsValue::Boolean:
+	    appendRaw(out, (uint8_t) value.getValue<bool>());
+	    break;
+	case EmsValue::Enumeration:
+	    appendRaw(out, value.getValue<uint8_t>());
+	    break;
+	case EmsValue::Kennlinie: {
+	    const std::vector<uint8_t>& points = value.getValue<std::vector<uint8_t> >();
+	    out.append(points.begin(), points.end());
+	    break;
+	}
+	case EmsValue::Error: {
+	    const EmsValue::ErrorEntry& entry = value.getValue<EmsValue::ErrorEntry>();
+	    appendRaw(out, entry.type);
+	    appendRaw(out, (uint32_t) entry.index);
+	    appendRaw(out, entry.record);
+	    break;
+	}
+	case EmsValue::Date:
+	    appendRaw(out, value.getValue<EmsProto::DateRecord>());
+	    break;
+	case EmsValue::SystemTime:
+	    appendRaw(out, value.getValue<EmsProto::SystemTimeRecord>());
+	    break;
+	case EmsValue::Formatted:
+	    out.append(value.getValue<std::string>());
+	    break;
+    }
+}
+
+/* the inverse of appendValue(), false if the data doesn't fit the type */
+static bool
+parseValue(EmsValue::ReadingType readingType, const char *data, size_t length,
+	   EmsValue::Reading& reading)
+{
+    switch (readingType) {
+	case EmsValue::Numeric: {
+	    float value;
+	    if (length != sizeof(value)) {
+		return false;
+	    }
+	    memcpy(&value, data, sizeof(value));
+	    reading = value;
+	    return true;
+	}
+	case EmsValue::Integer: {
+	    uint32_t value;
+	    if (length != sizeof(value)) {
+		return false;
+	    }
+	    memcpy(&value, data, sizeof(value));
+	    reading = (unsigned int) value;
+	    return true;
+	}
+	case EmsValue::Boolean:
+	    if (length != 1) {
+		return false;
+	    }
+	    reading = data[0] != 0;
+	    return true;
+	case EmsValue::Enumeration:
+	    if (length != 1) {
+		return false;
+	    }
+	    reading = (uint8_t) data[0];
+	    return true;
+	case EmsValue::Kennlinie:
+	    reading = std::vector<uint8_t>(data, data + length);
+	    return true;
+	case EmsValue::Error: {
+	    EmsValue::ErrorEntry entry;
+	    uint32_t index;
+	    if (length != sizeof(entry.type) + sizeof(index) + sizeof(entry.record)) {
+		return false;
+	    }
+	    memcpy(&entry.type, data, sizeof(entry.type));
+	    memcpy(&index, data + sizeof(entry.type), sizeof(index));
+	    memcpy(&entry.record, data + sizeof(entry.type) + sizeof(index), sizeof(entry.record));
+	    entry.index = index;
+	    reading = entry;
+	    return true;
+	}
+	case EmsValue::Date: {
+	    EmsProto::DateRecord record;
+	    if (length != sizeof(record)) {
+		return false;
+	    }
+	    memcpy(&record, data, sizeof(record));
+	    reading = record;
+	    return true;
+	}
+	case EmsValue::SystemTime: {
+	    EmsProto::SystemTimeRecord record;
+	    if (length != sizeof(record)) {
+		return false;
+	    }
+	    memcpy(&record, data, sizeof(record));
+	    reading = record;
+	    return true;
+	}
+	case EmsValue::Formatted:
+	    reading = std::string(data, length);
+	    return true;
+    }
+
+    return false;
+}
+
+ValueCache::ValueCache() :
+    m_snapshotPath(Options::cacheFile()),
+    m_lastSnapshot(time(NULL))
 {
+    const std::string& tableName = Options::valueTableName();
+    const std::string& streamName = Options::valueStreamName();
+
+    if (!tableName.empty()) {
+	m_sharedTable.reset(new SharedValueTable(tableName));
+	if (!m_sharedTable->valid()) {
+	    m_sharedTable.reset();
+	}
+    }
+    if (!streamName.empty()) {
+	m_sharedStream.reset(new SharedValueStream(streamName, Options::valueStreamSize()));
+	if (!m_sharedStream->valid()) {
+	    m_sharedStream.reset();
+	}
+    }
+    if (!m_snapshotPath.empty()) {
+	loadSnapshot();
+    }
 }
 
 ValueCache::~ValueCache()
 {
+    if (!m_snapshotPath.empty()) {
+	saveSnapshot();
+    }
 }
 
 void
-ValueCache::handleValue(const EmsValue& value)
+ValueCache::checkSnapshot()
+{
+    time_t now = time(NULL);
+    unsigned int interval = Options::cacheSaveInterval();
+
+    if (interval != 0 && now - m_lastSnapshot >= (time_t) interval) {
+	saveSnapshot();
+	m_lastSnapshot = now;
+    }
+}
+
+bool
+ValueCache::saveSnapshot()
+{
+    std::string data;
+    uint32_t count = m_cache.size();
+
+    data.reserve(64 + m_cache.size() * 32);
+    appendRaw(data, SnapshotMagic);
+    appendRaw(data, SnapshotVersion);
+    appendRaw(data, count);
+
+    for (auto& entry : m_cache) {
+	const EmsValue& value = entry.second.value;
+	size_t lengthPos;
+
+	appendName(data, ValueApi::getTypeName(value.getType()));
+	appendName(data, ValueApi::getSubTypeName(value.getSubType()));
+	appendRaw(data, (uint8_t) value.getReadingType());
+	appendRaw(data, (int64_t) entry.second.timestamp);
+	lengthPos = data.size();
+	appendRaw(data, (uint16_t) 0);
+	appendValue(data, value);
+
+	uint16_t length = std::min(data.size() - lengthPos - sizeof(uint16_t), (size_t) 65535);
+	memcpy(&data[lengthPos], &length, sizeof(length));
+	data.resize(lengthPos + sizeof(uint16_t) + length);
+    }
+
+    /* replace the old snapshot only once the new one is complete */
+    std::string tempPath = m_snapshotPath + ".tmp";
+    std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+    file.close();
+
+    if (!file || rename(tempPath.c_str(), m_snapshotPath.c_str()) != 0) {
+	std::cerr << "Could not write cache snapshot " << m_snapshotPath << ": "
+		  << strerror(errno) << std::endl;
+	unlink(tempPath.c_str());
+	return false;
+    }
+
+    return true;
+}
+
+bool
+ValueCache::loadSnapshot()
+{
+    uint64_t start = LatencyStats::now();
+    std::ifstream file(m_snapshotPath.c_str(), std::ios::binary);
+    std::ostringstream contents;
+    uint32_t magic, version, count;
+    size_t pos = 3 * sizeof(uint32_t);
+
+    if (!file) {
+	/* no snapshot yet */
+	return false;
+    }
+
+    contents << file.rdbuf();
+    const std::string& data = contents.str();
+
+    if (data.size() < pos) {
+	std::cerr << "Ignoring truncated cache snapshot " << m_snapshotPath << std::endl;
+	return false;
+    }
+    memcpy(&magic, &data[0], sizeof(magic));
+    memcpy(&version, &data[4], sizeof(version));
+    memcpy(&count, &data[8], sizeof(count));
+    if (magic != SnapshotMagic || version != SnapshotVersion) {
+	std::cerr << "Ignoring cache snapshot " << m_snapshotPath
+		  << " of unknown format" << std::endl;
+	return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+	std::string typeName, subtypeName;
+	EmsValue::Type type;
+	EmsValue::SubType subtype;
+	EmsValue::Reading reading;
+	uint8_t readingType;
+	int64_t timestamp;
+	uint16_t length;
+
+	if (pos + 1 > data.size() || pos + 1 + (uint8_t) data[pos] > data.size()) {
+	    break;
+	}
+	typeName.assign(data, pos + 1, (uint8_t) data[pos]);
+	pos += 1 + typeName.size();
+	if (pos + 1 > data.size() || pos + 1 + (uint8_t) data[pos] > data.size()) {
+	    break;
+	}
+	subtypeName.assign(data, pos + 1, (uint8_t) data[pos]);
+	pos += 1 + subtypeName.size();
+
+	if (pos + sizeof(readingType) + sizeof(timestamp) + sizeof(length) > data.size()) {
+	    break;
+	}
+	memcpy(&readingType, &data[pos], sizeof(readingType));
+	memcpy(&timestamp, &data[pos + sizeof(readingType)], sizeof(timestamp));
+	memcpy(&length, &data[pos + sizeof(readingType) + sizeof(timestamp)], sizeof(length));
+	pos += sizeof(readingType) + sizeof(timestamp) + sizeof(length);
+	if (pos + length > data.size()) {
+	    break;
+	}
+
+	/* values of types this version doesn't know any more are dropped */
+	subtype = EmsValue::None;
+	if (ValueApi::parseTypeName(typeName, type) &&
+		(subtypeName.empty() || ValueApi::parseSubTypeName(subtypeName, subtype)) &&
+		readingType <= EmsValue::Formatted &&
+		parseValue((EmsValue::ReadingType) readingType, &data[pos], length, reading)) {
+	    EmsValue value(type, subtype, (EmsValue::ReadingType) readingType, reading);
+	    CacheKey key(type, subtype);
+
+	    m_cache.erase(key);
+	    m_cache.insert(std::make_pair(key, CacheEntry(value, (time_t) timestamp, 0)));
+	    if (m_sharedTable) {
+		m_sharedTable->publish(value, timestamp);
+	    }
+	}
+	pos += length;
+    }
+
+    if (pos != data.size()) {
+	std::cerr << "Cache snapshot " << m_snapshotPath << " is truncated" << std::endl;
+    }
+    if (Options::statsDebug()) {
+	Options::statsDebug() << "STATS: loaded " << m_cache.size() << " cached values in "
+			      << (LatencyStats::now() - start) / 1000 << " us" << std::endl;
+    }
+
+    return true;
+}
+
+void
+ValueCache::handleValue(const EmsValue& value, uint32_t origin)
 {
     CacheKey key(value.getType(), value.getSubType());
     m_cache.erase(key);
-    m_cache.insert(std::make_pair(key, CacheEntry(value)));
+    auto result = m_cache.insert(std::make_pair(key, CacheEntry(value, time(NULL), origin)));
+
+    if (m_sharedTable) {
+	m_sharedTable->publish(value, result.first->second.timestamp);
+    }
+}
+
+const EmsValue *
+ValueCache::refreshValue(const EmsValueKey& key, uint32_t origin)
+{
+    auto iter = m_cache.find(CacheKey(key.first, key.second));
+    if (iter == m_cache.end() || iter->second.origin != origin) {
+	return NULL;
+    }
+
+    iter->second.timestamp = time(NULL);
+    if (m_sharedTable) {
+	m_sharedTable->refresh(key.first, key.second, iter->second.timestamp);
+    }
+    return &iter->second.value;
 }
 
 void
 ValueCache::outputValues(const std::vector<std::string>& selector, std::ostream& stream)
 {
     for (auto& entry: m_cache) {
-	std::string type = ValueApi::getTypeName(entry.first.m_type);
-	if (type.empty()) {
+	const char *type = ValueApi::getTypeName(entry.first.m_type);
+	if (!*type) {
 	    continue;
 	}
 
-	std::string subtype = ValueApi::getSubTypeName(entry.first.m_subtype);
+	const char *subtype = ValueApi::getSubTypeName(entry.first.m_subtype);
 	bool matchesSelector = false;
 
 	if (selector.size() >= 1) {
 	    if (selector[0] == type) {
 		matchesSelector = true;
-	    } else if (selector[0] == subtype || (selector[0] == "none" && subtype.empty())) {
+	    } else if (selector[0] == subtype || (selector[0] == "none" && !*subtype)) {
 		if (selector.size() == 1) {
 		    matchesSelector = true;
 		} else if (selector[1] == type) {
@@ -47,10 +389,18 @@ ValueCache::outputValues(const std::vector<std::string>& selector, std::ostream&
 	    continue;
 	}
 
-	if (!subtype.empty()) {
+	if (*subtype) {
 	    stream << subtype << " ";
 	}
-	stream << type << " = " << ValueApi::formatValue(entry.second.value);
+
+	char buffer[ValueApi::FormatBufferSize];
+	size_t length = ValueApi::formatValue(entry.second.value, buffer, sizeof(buffer));
+	stream << type << " = ";
+	if (length < sizeof(buffer)) {
+	    stream.write(buffer, length);
+	} else {
+	    stream << ValueApi::formatValue(entry.second.value);
+	}
 	stream << " | " << entry.second.timestamp << '\n';
     }
 }
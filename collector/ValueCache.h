@@ -22,7 +22,10 @@
 
 #include <map>
 #include <vector>
+#include <boost/scoped_ptr.hpp>
 #include "EmsMessage.h"
+#include "SharedValueStream.h"
+#include "SharedValueTable.h"
 
 class ValueCache
 {
@@ -30,8 +33,36 @@ class ValueCache
 	ValueCache();
 	~ValueCache();
 
-	void handleValue(const EmsValue& value);
+	/* 'origin' identifies the message the value was decoded from */
+	void handleValue(const EmsValue& value, uint32_t origin = 0);
+	void handleValues(const EmsValueList& values, uint32_t origin = 0) {
+	    for (size_t i = 0; i < values.size(); i++) {
+		handleValue(values[i], origin);
+	    }
+	    if (!m_snapshotPath.empty()) {
+		checkSnapshot();
+	    }
+	}
+	/* appends freshly decoded values to the shared memory stream, if any */
+	void streamValues(const EmsValueList& values) {
+	    if (m_sharedStream) {
+		m_sharedStream->publish(values);
+	    }
+	}
+	/* updates the timestamp of a value which was received again, but not
+	 * decoded as its bytes were unchanged; returns NULL if not cached or
+	 * if the cached value was decoded from another message, as some values
+	 * are sent in several messages (e.g. the room temperatures in the
+	 * monitor message of every heating circuit) */
+	const EmsValue * refreshValue(const EmsValueKey& key, uint32_t origin);
 	void outputValues(const std::vector<std::string>& selector, std::ostream& stream);
+	/* writes all values to the --cache-file snapshot, which is done
+	 * periodically and on destruction as well */
+	bool saveSnapshot();
+
+    private:
+	bool loadSnapshot();
+	void checkSnapshot();
 
     private:
 	class CacheKey {
@@ -55,12 +86,18 @@ class ValueCache
 	struct CacheEntry {
 	    time_t timestamp;
 	    EmsValue value;
+	    /* 0 if not known, as for values loaded from the snapshot */
+	    uint32_t origin;
 
-	    CacheEntry(const EmsValue& v) :
-		timestamp(time(NULL)), value(v) { }
+	    CacheEntry(const EmsValue& v, time_t t, uint32_t o) :
+		timestamp(t), value(v), origin(o) { }
 	};
 
 	std::map<CacheKey, CacheEntry> m_cache;
+	std::string m_snapshotPath;
+	time_t m_lastSnapshot;
+	boost::scoped_ptr<SharedValueTable> m_sharedTable;
+	boost::scoped_ptr<SharedValueStream> m_sharedStream;
 };
 
 #endif /* __VALUECACHE_H__ */
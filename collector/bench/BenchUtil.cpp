@@ -0,0 +1,210 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <new>
+#include "BenchUtil.h"
+
+static size_t allocations = 0;
+
+void *
+operator new(size_t size)
+{
+    void *p;
+
+    allocations++;
+    p = malloc(size ? size : 1);
+    if (!p) {
+	throw std::bad_alloc();
+    }
+    return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+size_t
+Bench::allocationCount()
+{
+    return allocations;
+}
+
+void
+Bench::Meter::start()
+{
+    m_startAllocations = allocations;
+    clock_gettime(CLOCK_MONOTONIC, &m_startTime);
+}
+
+void
+Bench::Meter::stop(size_t items)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    m_nanoseconds += (now.tv_sec - m_startTime.tv_sec) * 1e9 +
+	    (now.tv_nsec - m_startTime.tv_nsec);
+    m_allocations += allocations - m_startAllocations;
+    m_items += items;
+}
+
+void
+Bench::Meter::report(benchmark::State& state, const char *unit)
+{
+    std::string suffix = std::string("/") + unit;
+
+    if (m_items == 0) {
+	return;
+    }
+
+    state.counters["ns" + suffix] = m_nanoseconds / m_items;
+    state.counters["allocs" + suffix] = (double) m_allocations / m_items;
+}
+
+static std::vector<Bench::Frame>
+loadCorpus()
+{
+    std::vector<Bench::Frame> frames;
+    const char *path = getenv("EMS_BENCH_CORPUS");
+    std::ifstream file(path ? path : "bench/corpus/frames.txt");
+    std::string line;
+
+    if (!file) {
+	std::cerr << "Could not open frame corpus "
+		  << (path ? path : "bench/corpus/frames.txt") << std::endl;
+	exit(1);
+    }
+
+    while (std::getline(file, line)) {
+	std::istringstream stream(line);
+	Bench::Frame frame;
+	unsigned int byte;
+
+	if (line.empty() || line[0] == '#') {
+	    continue;
+	}
+
+	stream >> frame.name >> std::hex;
+	while (stream >> byte) {
+	    frame.data.push_back(byte);
+	}
+	if (frame.data.size() >= 4) {
+	    frames.push_back(frame);
+	}
+    }
+
+    return frames;
+}
+
+const std::vector<Bench::Frame>&
+Bench::corpus()
+{
+    static const std::vector<Frame> frames = loadCorpus();
+    return frames;
+}
+
+const std::vector<EmsValue>&
+Bench::corpusValues()
+{
+    static std::vector<EmsValue> values;
+
+    if (values.empty()) {
+	EmsMessage::ValueHandler handler = [] (const EmsValueList& list, const EmsValueKeyList& unchanged) {
+	    values.insert(values.end(), list.begin(), list.end());
+	};
+	for (auto& frame : corpus()) {
+	    EmsMessage message(handler, frame.data);
+	    message.handle();
+	}
+    }
+
+    return values;
+}
+
+const std::vector<EmsValueList>&
+Bench::corpusValueLists()
+{
+    static std::vector<EmsValueList> lists;
+
+    if (lists.empty()) {
+	EmsMessage::ValueHandler handler = [] (const EmsValueList& list, const EmsValueKeyList& unchanged) {
+	    lists.push_back(list);
+	};
+	for (auto& frame : corpus()) {
+	    EmsMessage message(handler, frame.data);
+	    message.handle();
+	}
+    }
+
+    return lists;
+}
+
+static void
+appendPacket(std::vector<uint8_t>& stream, const std::vector<uint8_t>& data,
+	     bool breakChecksum)
+{
+    uint8_t checksum = 0;
+
+    stream.push_back(0xaa);
+    stream.push_back(0x55);
+    stream.push_back(data.size());
+    for (auto byte : data) {
+	stream.push_back(byte);
+	checksum ^= byte;
+    }
+    stream.push_back(breakChecksum ? ~checksum : checksum);
+}
+
+std::vector<uint8_t>
+Bench::buildStream(const std::vector<Frame>& frames, unsigned int repeat, bool garbage)
+{
+    std::vector<uint8_t> stream;
+    unsigned int seed = 4711;
+
+    for (unsigned int i = 0; i < repeat; i++) {
+	for (size_t f = 0; f < frames.size(); f++) {
+	    if (garbage) {
+		/* line noise, including stray sync bytes */
+		size_t noise = rand_r(&seed) % 8;
+		for (size_t n = 0; n < noise; n++) {
+		    stream.push_back(rand_r(&seed) % 4 == 0 ? 0xaa : rand_r(&seed));
+		}
+		if (f % 7 == 3) {
+		    /* a frame which fails the checksum test */
+		    appendPacket(stream, frames[f].data, true);
+		}
+	    }
+	    appendPacket(stream, frames[f].data, false);
+	}
+    }
+
+    return stream;
+}
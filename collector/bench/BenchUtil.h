@@ -0,0 +1,71 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BENCHUTIL_H__
+#define __BENCHUTIL_H__
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "EmsMessage.h"
+
+namespace Bench {
+    struct Frame {
+	std::string name;
+	/* source, dest, type, offset, data - as delivered by the framer */
+	std::vector<uint8_t> data;
+    };
+
+    /* frames from bench/corpus/frames.txt (or $EMS_BENCH_CORPUS) */
+    const std::vector<Frame>& corpus();
+    /* all values the corpus decodes to, in corpus order */
+    const std::vector<EmsValue>& corpusValues();
+    /* the same values, as handed out per message */
+    const std::vector<EmsValueList>& corpusValueLists();
+
+    /* wraps frames into 0xaa 0x55 packets like the framer does; with
+     * garbage enabled, line noise, false sync words and frames with
+     * broken checksums are interleaved to exercise resyncing */
+    std::vector<uint8_t> buildStream(const std::vector<Frame>& frames,
+				     unsigned int repeat, bool garbage);
+
+    /* number of operator new calls done by the process so far */
+    size_t allocationCount();
+
+    /* accumulates time and allocations spent on a number of items
+     * (frames, values) and reports them as ns/<unit> and allocs/<unit> */
+    class Meter {
+	public:
+	    Meter() : m_items(0), m_allocations(0), m_nanoseconds(0) { }
+
+	    void start();
+	    void stop(size_t items);
+	    void report(benchmark::State& state, const char *unit);
+
+	private:
+	    size_t m_items;
+	    size_t m_allocations;
+	    double m_nanoseconds;
+	    size_t m_startAllocations;
+	    struct timespec m_startTime;
+    };
+}
+
+#endif /* __BENCHUTIL_H__ */
@@ -0,0 +1,78 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <set>
+#include "BenchUtil.h"
+
+/* with 'repeated' set, each frame is decoded as repetition of itself,
+ * i.e. with all fields unchanged */
+static void
+runDecode(benchmark::State& state, const std::string& name, bool repeated)
+{
+    std::vector<const Bench::Frame *> frames;
+    std::vector<std::vector<uint8_t> > payloads;
+    Bench::Meter meter;
+    size_t values = 0;
+    EmsMessage::ValueHandler handler =
+	    [&values] (const EmsValueList& list, const EmsValueKeyList& unchanged) {
+	values += list.size();
+    };
+
+    for (auto& frame : Bench::corpus()) {
+	if (frame.name == name) {
+	    frames.push_back(&frame);
+	    /* payload without source, dest, type and offset */
+	    payloads.push_back(std::vector<uint8_t>(frame.data.begin() + 4, frame.data.end()));
+	}
+    }
+
+    for (auto _ : state) {
+	meter.start();
+	for (size_t i = 0; i < frames.size(); i++) {
+	    EmsMessage message(handler, frames[i]->data);
+	    if (repeated) {
+		message.setPreviousData(&payloads[i]);
+	    }
+	    message.handle();
+	}
+	meter.stop(frames.size());
+    }
+
+    benchmark::DoNotOptimize(values);
+    meter.report(state, "frame");
+}
+
+/* one benchmark per message type found in the corpus */
+static int
+registerDecodeBenchmarks()
+{
+    std::set<std::string> names;
+
+    for (auto& frame : Bench::corpus()) {
+	if (names.insert(frame.name).second) {
+	    benchmark::RegisterBenchmark(("BM_Decode/" + frame.name).c_str(),
+					 runDecode, frame.name, false);
+	    benchmark::RegisterBenchmark(("BM_DecodeUnchanged/" + frame.name).c_str(),
+					 runDecode, frame.name, true);
+	}
+    }
+
+    return 0;
+}
+static int dummy = registerDecodeBenchmarks();
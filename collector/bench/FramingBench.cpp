@@ -0,0 +1,203 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include "BenchUtil.h"
+#include "FrameParser.h"
+#include "IoHandler.h"
+
+/* IO handler which gets its bytes from memory instead of a device */
+class ReplayHandler : public IoHandler
+{
+    public:
+	ReplayHandler(Database& db, ValueCache& cache) :
+	    IoHandler(db, cache) { }
+
+	void feed(const std::vector<uint8_t>& stream) {
+	    size_t pos = 0;
+	    while (pos < stream.size()) {
+		size_t count = std::min(stream.size() - pos, (size_t) maxReadLength);
+		memcpy(m_recvBuffer, &stream[pos], count);
+		readComplete(boost::system::error_code(), count);
+		pos += count;
+	    }
+	}
+
+    protected:
+	virtual void readStart() { }
+	virtual void doCloseImpl() { }
+};
+
+static void
+runFraming(benchmark::State& state, bool garbage)
+{
+    const std::vector<Bench::Frame>& frames = Bench::corpus();
+    std::vector<uint8_t> stream = Bench::buildStream(frames, 16, garbage);
+    Database db;
+    ValueCache cache;
+    ReplayHandler handler(db, cache);
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	meter.start();
+	handler.feed(stream);
+	meter.stop(16 * frames.size());
+    }
+
+    state.SetBytesProcessed(state.iterations() * stream.size());
+    meter.report(state, "frame");
+}
+
+static void
+BM_FramingClean(benchmark::State& state)
+{
+    runFraming(state, false);
+}
+BENCHMARK(BM_FramingClean);
+
+static void
+BM_FramingGarbageResync(benchmark::State& state)
+{
+    runFraming(state, true);
+}
+BENCHMARK(BM_FramingGarbageResync);
+
+/* the byte-at-a-time state machine IoHandler used before FrameParser,
+ * kept as reference for the parser benchmarks */
+class LegacyFrameParser
+{
+    public:
+	LegacyFrameParser() :
+	    m_state(Syncing), m_pos(0), m_length(0), m_checkSum(0), m_frames(0) {
+	    m_data.reserve(256);
+	}
+
+	void feed(const uint8_t *data, size_t length) {
+	    for (size_t i = 0; i < length; i++) {
+		uint8_t dataByte = data[i];
+
+		switch (m_state) {
+		    case Syncing:
+			if (m_pos == 0 && dataByte == 0xaa) {
+			    m_pos = 1;
+			} else if (m_pos == 1 && dataByte == 0x55) {
+			    m_state = Length;
+			    m_pos = 0;
+			} else {
+			    m_pos = 0;
+			}
+			break;
+		    case Length:
+			m_state = Data;
+			m_pos = 0;
+			m_length = dataByte;
+			m_checkSum = 0;
+			break;
+		    case Data:
+			m_data.push_back(dataByte);
+			m_checkSum ^= dataByte;
+			m_pos++;
+			if (m_pos == m_length) {
+			    m_state = Checksum;
+			}
+			break;
+		    case Checksum:
+			if (m_checkSum == dataByte) {
+			    m_frames++;
+			}
+			m_data.clear();
+			m_state = Syncing;
+			m_pos = 0;
+			break;
+		}
+	    }
+	}
+
+	size_t frames() const {
+	    return m_frames;
+	}
+
+    private:
+	typedef enum {
+	    Syncing,
+	    Length,
+	    Data,
+	    Checksum
+	} State;
+
+	State m_state;
+	size_t m_pos, m_length;
+	uint8_t m_checkSum;
+	size_t m_frames;
+	std::vector<uint8_t> m_data;
+};
+
+/* framing only, without decoding; the stream is fed in chunks of the
+ * size IoHandler reads from the device */
+static const unsigned int parserRepeat = 1000;
+
+static void
+countFrame(size_t *frames, const std::vector<uint8_t>& data, uint64_t rxTime)
+{
+    benchmark::DoNotOptimize(data.data());
+    (*frames)++;
+}
+
+static void
+BM_FrameParser(benchmark::State& state)
+{
+    std::vector<uint8_t> stream = Bench::buildStream(Bench::corpus(), parserRepeat, state.range(0));
+    size_t frames = 0;
+    FrameParser parser(boost::bind(&countFrame, &frames, _1, _2));
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	size_t before = frames;
+	meter.start();
+	for (size_t pos = 0; pos < stream.size(); pos += 512) {
+	    parser.feed(&stream[pos], std::min(stream.size() - pos, (size_t) 512), 0);
+	}
+	meter.stop(frames - before);
+    }
+
+    state.SetBytesProcessed(state.iterations() * stream.size());
+    meter.report(state, "frame");
+}
+BENCHMARK(BM_FrameParser)->ArgName("garbage")->Arg(0)->Arg(1);
+
+static void
+BM_LegacyFrameParser(benchmark::State& state)
+{
+    std::vector<uint8_t> stream = Bench::buildStream(Bench::corpus(), parserRepeat, state.range(0));
+    LegacyFrameParser parser;
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	size_t before = parser.frames();
+	meter.start();
+	for (size_t pos = 0; pos < stream.size(); pos += 512) {
+	    parser.feed(&stream[pos], std::min(stream.size() - pos, (size_t) 512));
+	}
+	meter.stop(parser.frames() - before);
+    }
+
+    state.SetBytesProcessed(state.iterations() * stream.size());
+    meter.report(state, "frame");
+}
+BENCHMARK(BM_LegacyFrameParser)->ArgName("garbage")->Arg(0)->Arg(1);
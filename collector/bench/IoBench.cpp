@@ -0,0 +1,294 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <boost/bind.hpp>
+#include "BenchUtil.h"
+#include "IoUring.h"
+#include "Listener.h"
+#include "ValueApi.h"
+
+/*
+ * Fan-out of one message's worth of data port output to many clients
+ * connected over TCP loopback or unix domain sockets, as DataHandler
+ * does it for every bus message, and command interface round trips.
+ */
+
+namespace {
+    class Clients {
+	public:
+	    Clients(size_t count, bool local);
+	    ~Clients();
+
+	    /* server side descriptors, the ones written to */
+	    const std::vector<int>& fds() const {
+		return m_serverFds;
+	    }
+	    const std::vector<int>& clientFds() const {
+		return m_clientFds;
+	    }
+	    /* reads everything the clients received */
+	    void drain();
+
+	private:
+	    std::vector<int> m_serverFds;
+	    std::vector<int> m_clientFds;
+    };
+
+    Clients::Clients(size_t count, bool local)
+    {
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	int listener = -1;
+
+	if (!local) {
+	    listener = socket(AF_INET, SOCK_STREAM, 0);
+	    memset(&addr, 0, sizeof(addr));
+	    addr.sin_family = AF_INET;
+	    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    bind(listener, (struct sockaddr *) &addr, sizeof(addr));
+	    getsockname(listener, (struct sockaddr *) &addr, &length);
+	    listen(listener, count);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+	    int fds[2];
+
+	    if (local) {
+		/* the same kernel path as a connection to a listening socket */
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		    break;
+		}
+	    } else {
+		fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(fds[0], (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		    close(fds[0]);
+		    break;
+		}
+		fds[1] = accept(listener, NULL, NULL);
+	    }
+	    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	    m_clientFds.push_back(fds[0]);
+	    m_serverFds.push_back(fds[1]);
+	}
+	if (listener >= 0) {
+	    close(listener);
+	}
+    }
+
+    Clients::~Clients()
+    {
+	for (size_t i = 0; i < m_clientFds.size(); i++) {
+	    close(m_clientFds[i]);
+	    close(m_serverFds[i]);
+	}
+    }
+
+    void
+    Clients::drain()
+    {
+	char buffer[4096];
+
+	for (size_t i = 0; i < m_clientFds.size(); i++) {
+	    while (read(m_clientFds[i], buffer, sizeof(buffer)) > 0);
+	}
+    }
+}
+
+/* what DataConnection sends for one of the larger corpus messages */
+static const std::string&
+messageText()
+{
+    static std::string text;
+
+    if (text.empty()) {
+	const std::vector<EmsValueList>& lists = Bench::corpusValueLists();
+	const EmsValueList *largest = &lists[0];
+
+	for (size_t i = 1; i < lists.size(); i++) {
+	    if (lists[i].size() > largest->size()) {
+		largest = &lists[i];
+	    }
+	}
+	for (auto& value : *largest) {
+	    if (*ValueApi::getSubTypeName(value.getSubType())) {
+		text += ValueApi::getSubTypeName(value.getSubType());
+		text += ' ';
+	    }
+	    text += ValueApi::getTypeName(value.getType());
+	    text += ' ';
+	    text += ValueApi::formatValue(value);
+	    text += '\n';
+	}
+    }
+
+    return text;
+}
+
+static void
+countWrite(size_t *done, const boost::system::error_code& error)
+{
+    (*done)++;
+}
+
+static void
+countSend(size_t *done, int result, unsigned int flags)
+{
+    (*done)++;
+}
+
+static void
+BM_FanoutAsio(benchmark::State& state)
+{
+    boost::asio::io_service service;
+    Clients clients(state.range(0), state.range(1));
+    const std::string& text = messageText();
+    std::vector<boost::shared_ptr<Listener::Socket> > sockets;
+    boost::asio::generic::stream_protocol protocol(state.range(1) ? AF_UNIX : AF_INET, 0);
+    Bench::Meter meter;
+
+    for (auto fd : clients.fds()) {
+	sockets.push_back(boost::shared_ptr<Listener::Socket>(
+		new Listener::Socket(service, protocol, dup(fd))));
+    }
+
+    for (auto _ : state) {
+	size_t done = 0;
+
+	meter.start();
+	for (auto& socket : sockets) {
+	    boost::asio::async_write(*socket, boost::asio::buffer(text),
+				     boost::bind(countWrite, &done,
+						 boost::asio::placeholders::error));
+	}
+	/* the service stops whenever it runs out of work */
+	service.reset();
+	while (done < sockets.size()) {
+	    service.run_one();
+	}
+	meter.stop(sockets.size());
+
+	clients.drain();
+    }
+
+    meter.report(state, "client");
+}
+BENCHMARK(BM_FanoutAsio)->ArgNames({"clients", "unix"})
+    ->Args({1, 0})->Args({16, 0})->Args({64, 0})->Args({256, 0})
+    ->Args({1, 1})->Args({16, 1})->Args({64, 1})->Args({256, 1});
+
+static void
+runFanoutUring(benchmark::State& state, bool batched)
+{
+    boost::asio::io_service service;
+    IoUring uring(service);
+    Clients clients(state.range(0), state.range(1));
+    const std::string& text = messageText();
+    const std::vector<int>& fds = clients.fds();
+    Bench::Meter meter;
+
+    if (!uring.valid()) {
+	state.SkipWithError("io_uring not available");
+	return;
+    }
+
+    uint64_t startCalls = uring.submitCalls();
+    for (auto _ : state) {
+	size_t done = 0;
+
+	meter.start();
+	for (auto fd : fds) {
+	    uring.send(fd, text.data(), text.size(), boost::bind(countSend, &done, _1, _2));
+	    if (!batched) {
+		uring.submit();
+	    }
+	}
+	uring.submit();
+	while (done < fds.size()) {
+	    service.run_one();
+	}
+	meter.stop(fds.size());
+
+	clients.drain();
+    }
+
+    meter.report(state, "client");
+    state.counters["enter/msg"] = benchmark::Counter(uring.submitCalls() - startCalls,
+						     benchmark::Counter::kAvgIterations);
+}
+
+static void
+BM_FanoutUring(benchmark::State& state)
+{
+    runFanoutUring(state, true);
+}
+BENCHMARK(BM_FanoutUring)->ArgNames({"clients", "unix"})
+    ->Args({1, 0})->Args({16, 0})->Args({64, 0})->Args({256, 0})
+    ->Args({1, 1})->Args({16, 1})->Args({64, 1})->Args({256, 1});
+
+static void
+BM_FanoutUringUnbatched(benchmark::State& state)
+{
+    runFanoutUring(state, false);
+}
+BENCHMARK(BM_FanoutUringUnbatched)->ArgNames({"clients", "unix"})
+    ->Args({16, 0})->Args({256, 0})->Args({16, 1})->Args({256, 1});
+
+/* a command and its response over a blocking connection, without the
+ * collector's processing; only the transport cost differs */
+static void
+BM_CommandRoundtrip(benchmark::State& state)
+{
+    Clients clients(1, state.range(0));
+    int client = clients.clientFds()[0];
+    int server = clients.fds()[0];
+    static const char request[] = "stats sending\n";
+    std::string response;
+    char buffer[512];
+    Bench::Meter meter;
+
+    fcntl(client, F_SETFL, 0);
+    response = messageText().substr(0, 160);
+
+    for (auto _ : state) {
+	size_t received = 0;
+
+	meter.start();
+	if (write(client, request, sizeof(request) - 1) < 0 ||
+		read(server, buffer, sizeof(buffer)) <= 0 ||
+		write(server, response.data(), response.size()) < 0) {
+	    state.SkipWithError("write failed");
+	    break;
+	}
+	while (received < response.size()) {
+	    ssize_t count = read(client, buffer, sizeof(buffer));
+	    if (count <= 0) {
+		break;
+	    }
+	    received += count;
+	}
+	meter.stop(1);
+    }
+
+    meter.report(state, "request");
+}
+BENCHMARK(BM_CommandRoundtrip)->ArgName("unix")->Arg(0)->Arg(1);
@@ -0,0 +1,167 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "BenchUtil.h"
+#include "SharedValueStream.h"
+#include "client/ems_stream.h"
+
+/*
+ * Publishing values into the shared memory value stream and following it
+ * with the reader library, alone and with readers running concurrently.
+ */
+
+static const unsigned int StreamCapacity = 65536;
+
+static std::string
+streamName()
+{
+    std::ostringstream name;
+    name << "/ems-bench-stream-" << getpid();
+    return name.str();
+}
+
+static void
+BM_StreamPublish(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    std::string name = streamName();
+    SharedValueStream stream(name, StreamCapacity);
+    Bench::Meter meter;
+
+    if (!stream.valid()) {
+	state.SkipWithError("Could not create stream");
+	return;
+    }
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& value : values) {
+	    stream.publish(value, 0);
+	}
+	meter.stop(values.size());
+    }
+
+    meter.report(state, "value");
+    state.SetItemsProcessed(state.iterations() * values.size());
+    shm_unlink(name.c_str());
+}
+BENCHMARK(BM_StreamPublish);
+
+static void
+BM_StreamRead(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    std::string name = streamName();
+    SharedValueStream stream(name, StreamCapacity);
+    struct ems_stream_record record;
+    Bench::Meter meter;
+
+    if (!stream.valid()) {
+	state.SkipWithError("Could not create stream");
+	return;
+    }
+
+    ems_stream *reader = ems_stream_open(name.c_str());
+
+    for (auto _ : state) {
+	size_t count = 0;
+
+	state.PauseTiming();
+	for (auto& value : values) {
+	    stream.publish(value, 0);
+	}
+	state.ResumeTiming();
+
+	meter.start();
+	while (ems_stream_next(reader, &record)) {
+	    benchmark::DoNotOptimize(record);
+	    count++;
+	}
+	meter.stop(count);
+    }
+
+    meter.report(state, "record");
+    ems_stream_close(reader);
+    shm_unlink(name.c_str());
+}
+BENCHMARK(BM_StreamRead);
+
+/* the writer publishes as fast as it can, so readers which are slower
+ * than it lose records; those are counted, but not read */
+static void
+BM_StreamConcurrent(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    std::string name = streamName();
+    SharedValueStream stream(name, StreamCapacity);
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> read(state.range(0)), lost(state.range(0));
+    std::atomic<bool> running(true);
+
+    if (!stream.valid()) {
+	state.SkipWithError("Could not create stream");
+	return;
+    }
+
+    for (int i = 0; i < state.range(0); i++) {
+	threads.push_back(std::thread([&, i] {
+	    ems_stream *reader = ems_stream_open(name.c_str());
+	    struct ems_stream_record record;
+
+	    while (running.load(std::memory_order_relaxed)) {
+		while (ems_stream_next(reader, &record)) {
+		    read[i]++;
+		}
+	    }
+	    while (ems_stream_next(reader, &record)) {
+		read[i]++;
+	    }
+	    lost[i] = ems_stream_lost(reader);
+	    ems_stream_close(reader);
+	}));
+    }
+
+    for (auto _ : state) {
+	for (auto& value : values) {
+	    stream.publish(value, 0);
+	}
+    }
+
+    running = false;
+    for (auto& thread : threads) {
+	thread.join();
+    }
+
+    uint64_t totalRead = 0, totalLost = 0;
+    for (int i = 0; i < state.range(0); i++) {
+	totalRead += read[i];
+	totalLost += lost[i];
+    }
+
+    state.SetItemsProcessed(state.iterations() * values.size());
+    state.counters["read/s"] = benchmark::Counter(totalRead, benchmark::Counter::kIsRate);
+    state.counters["lost%"] = 100.0 * totalLost / std::max<uint64_t>(totalRead + totalLost, 1);
+    shm_unlink(name.c_str());
+}
+BENCHMARK(BM_StreamConcurrent)->ArgName("readers")->Arg(1)->Arg(4)->UseRealTime();
@@ -0,0 +1,229 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <mysql++/query.h>
+#include "BenchUtil.h"
+#include "Database.h"
+#include "Downsampler.h"
+#define MYSQLPP_SSQLS_NO_STATICS
+#include "PendingWrites.h"
+#include "StoragePolicy.h"
+#include "ValueApi.h"
+#include "ValueCache.h"
+
+static void
+BM_FormatValue(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& value : values) {
+	    char buffer[ValueApi::FormatBufferSize];
+	    const char *type = ValueApi::getTypeName(value.getType());
+	    const char *subtype = ValueApi::getSubTypeName(value.getSubType());
+	    size_t length = ValueApi::formatValue(value, buffer, sizeof(buffer));
+	    benchmark::DoNotOptimize(type);
+	    benchmark::DoNotOptimize(subtype);
+	    benchmark::DoNotOptimize(length);
+	}
+	meter.stop(values.size());
+    }
+
+    meter.report(state, "value");
+}
+BENCHMARK(BM_FormatValue);
+
+static void
+BM_FormatValueString(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& value : values) {
+	    std::string formatted = ValueApi::formatValue(value);
+	    benchmark::DoNotOptimize(formatted);
+	}
+	meter.stop(values.size());
+    }
+
+    meter.report(state, "value");
+}
+BENCHMARK(BM_FormatValueString);
+
+static void
+BM_CacheUpdate(benchmark::State& state)
+{
+    const std::vector<EmsValue>& values = Bench::corpusValues();
+    Bench::Meter meter;
+    ValueCache cache;
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& value : values) {
+	    cache.handleValue(value);
+	}
+	meter.stop(values.size());
+    }
+
+    meter.report(state, "value");
+}
+BENCHMARK(BM_CacheUpdate);
+
+/* without a connection, this measures mapping the values to their
+ * sensors only; no statement is built */
+static void
+BM_DatabaseMapping(benchmark::State& state)
+{
+    const std::vector<EmsValueList>& lists = Bench::corpusValueLists();
+    Bench::Meter meter;
+    Database db;
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& list : lists) {
+	    db.handleValues(list);
+	}
+	meter.stop(Bench::corpusValues().size());
+    }
+
+    meter.report(state, "value");
+}
+BENCHMARK(BM_DatabaseMapping);
+
+/* the part of storing which needs no connection: the numeric values of
+ * each message are queued and built into one multi-row insert, which
+ * isn't sent */
+static void
+BM_InsertStatement(benchmark::State& state)
+{
+    const std::vector<EmsValueList>& lists = Bench::corpusValueLists();
+    Bench::Meter meter;
+    size_t length = 0;
+
+    for (auto _ : state) {
+	meter.start();
+	for (auto& list : lists) {
+	    PendingWrites writes(time(NULL));
+
+	    for (size_t i = 0; i < list.size(); i++) {
+		if (list[i].getReadingType() == EmsValue::Numeric) {
+		    queueRow(writes.numericRows, i + 1, list[i].getValue<float>(),
+			     writes.timestamp);
+		}
+	    }
+	    if (!writes.numericRows.empty()) {
+		mysqlpp::Query query(NULL);
+		query.insert(writes.numericRows.begin(), writes.numericRows.end());
+		length += query.str().size();
+	    }
+	}
+	meter.stop(Bench::corpusValues().size());
+    }
+
+    meter.report(state, "value");
+    benchmark::DoNotOptimize(length);
+}
+BENCHMARK(BM_InsertStatement);
+
+/* a noisy sensor like the flame current: a slow swing with jitter of a
+ * few tenths, sampled every 10s for a day, in steps of 0.1 like the bus */
+static const std::vector<float>&
+noisySamples()
+{
+    static std::vector<float> samples;
+
+    if (samples.empty()) {
+	srand(1);
+	for (unsigned int i = 0; i < 8640; i++) {
+	    double value = 20 + 5 * sin(i / 60.0) + (rand() % 7 - 3) / 10.0;
+	    samples.push_back(round(value * 10) / 10);
+	}
+    }
+    return samples;
+}
+
+/* reports how many of the samples start a new row */
+static void
+BM_StoragePolicy(benchmark::State& state)
+{
+    static const char * POLICIES[] = {
+	"1,onchange", "1,ratelimit,60", "1,deadband,0.5", "1,deadband,5%",
+	"1,swingingdoor,0.5", "1,swingingdoor,0.5,600"
+    };
+    const std::vector<float>& samples = noisySamples();
+    const char *definition = POLICIES[state.range(0)];
+    StoragePolicy policy;
+    unsigned int sensor;
+    size_t rows = 0;
+    Bench::Meter meter;
+
+    StoragePolicy::parse(definition, sensor, policy);
+    state.SetLabel(definition + 2);
+
+    for (auto _ : state) {
+	float rowValue;
+	time_t rowTime;
+
+	rows = 1;
+	policy.reset(samples[0], 0);
+	meter.start();
+	for (size_t i = 1; i < samples.size(); i++) {
+	    if (policy.sample(samples[i], i * 10, rowValue, rowTime) == StoragePolicy::Store) {
+		rows++;
+	    }
+	}
+	meter.stop(samples.size());
+    }
+
+    meter.report(state, "sample");
+    state.counters["rows/sample"] = (double) rows / samples.size();
+}
+BENCHMARK(BM_StoragePolicy)->DenseRange(0, 5);
+
+/* a day of samples reduced for a graph, as done by the history command */
+static void
+BM_Downsampler(benchmark::State& state)
+{
+    const std::vector<float>& samples = noisySamples();
+    unsigned int maxPoints = state.range(0);
+    size_t points = 0;
+    Bench::Meter meter;
+
+    for (auto _ : state) {
+	Downsampler downsampler(0, samples.size() * 10, maxPoints);
+
+	meter.start();
+	for (size_t i = 0; i < samples.size(); i++) {
+	    downsampler.add(i * 10, samples[i]);
+	}
+	downsampler.finish();
+	meter.stop(samples.size());
+	points = downsampler.points().size();
+    }
+
+    meter.report(state, "sample");
+    state.counters["points"] = points;
+}
+BENCHMARK(BM_Downsampler)->Arg(100)->Arg(800);
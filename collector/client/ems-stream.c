@@ -0,0 +1,107 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Follows the shared memory value stream and prints every value as
+ * '<record> <time> [<subtype>] <type> = <value>', reporting lost records.
+ * The stream is reopened when the collector restarts.
+ *
+ * Usage: ems-stream [-n <stream name>] [-a]
+ *   -a  start with the oldest record still in the stream
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ems_stream.h"
+
+/* readers poll; 10ms is far below the interval of bus messages */
+#define POLL_INTERVAL_US 10000
+
+int
+main(int argc, char **argv)
+{
+    const char *name = NULL;
+    struct ems_stream_record record;
+    ems_stream *stream = NULL;
+    uint64_t reported_lost = 0;
+    int opt, rewind = 0;
+
+    while ((opt = getopt(argc, argv, "n:a")) != -1) {
+	switch (opt) {
+	    case 'n':
+		name = optarg;
+		break;
+	    case 'a':
+		rewind = 1;
+		break;
+	    default:
+		fprintf(stderr, "Usage: %s [-n <stream name>] [-a]\n", argv[0]);
+		return 1;
+	}
+    }
+
+    for (;;) {
+	if (!stream) {
+	    stream = ems_stream_open(name);
+	    if (!stream) {
+		if (errno != ENOENT) {
+		    fprintf(stderr, "Could not open value stream %s: %s\n",
+			    name ? name : EMS_STREAM_DEFAULT_NAME, strerror(errno));
+		    return 1;
+		}
+		usleep(1000000);
+		continue;
+	    }
+	    if (rewind) {
+		ems_stream_rewind(stream);
+	    }
+	    reported_lost = 0;
+	}
+
+	if (!ems_stream_next(stream, &record)) {
+	    if (ems_stream_header(stream)->writer_pid == 0) {
+		/* the next run of the collector creates a new stream */
+		ems_stream_close(stream);
+		stream = NULL;
+		rewind = 1;
+		usleep(1000000);
+	    } else {
+		fflush(stdout);
+		usleep(POLL_INTERVAL_US);
+	    }
+	    continue;
+	}
+
+	if (ems_stream_lost(stream) != reported_lost) {
+	    printf("# lost %" PRIu64 " records\n", ems_stream_lost(stream) - reported_lost);
+	    reported_lost = ems_stream_lost(stream);
+	}
+
+	const char *subtype = ems_stream_subtype_name(stream, record.subtype);
+	printf("%" PRIu64 " %" PRId64 ".%03d ", record.seq,
+	       record.timestamp_ns / 1000000000, (int) (record.timestamp_ns / 1000000 % 1000));
+	if (*subtype) {
+	    printf("%s ", subtype);
+	}
+	printf("%s = %s\n", ems_stream_type_name(stream, record.type), record.text);
+    }
+}
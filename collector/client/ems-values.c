@@ -0,0 +1,100 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Prints the values of the shared memory value table in the format of
+ * the 'cache fetch' command, without connecting to the collector.
+ *
+ * Usage: ems-values [-n <table name>] [<subtype|none|type> [<type>]]
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ems_values.h"
+
+static int
+matches(const char *subtype, const char *type, int argc, char **argv)
+{
+    if (argc == 0) {
+	return 1;
+    }
+    if (strcmp(argv[0], type) == 0) {
+	return 1;
+    }
+    if (strcmp(argv[0], subtype) == 0 || (strcmp(argv[0], "none") == 0 && !*subtype)) {
+	return argc == 1 || strcmp(argv[1], type) == 0;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = NULL;
+    struct ems_value value;
+    ems_values *table;
+    int opt, i, count;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+	switch (opt) {
+	    case 'n':
+		name = optarg;
+		break;
+	    default:
+		fprintf(stderr, "Usage: %s [-n <table name>] [<subtype|none|type> [<type>]]\n",
+			argv[0]);
+		return 1;
+	}
+    }
+
+    table = ems_values_open(name);
+    if (!table) {
+	fprintf(stderr, "Could not open value table %s: %s\n",
+		name ? name : EMS_VALUES_DEFAULT_NAME, strerror(errno));
+	return 1;
+    }
+
+    if (ems_values_header(table)->writer_pid == 0) {
+	fprintf(stderr, "Warning: the collector is not running, values may be outdated\n");
+    }
+
+    count = ems_values_slot_count(table);
+    for (i = 0; i < count; i++) {
+	const char *type = ems_values_type_name(table, i);
+	const char *subtype = ems_values_subtype_name(table, i);
+
+	if (!*type || !matches(subtype, type, argc - optind, argv + optind)) {
+	    continue;
+	}
+	if (ems_values_read(table, i, &value) != 0) {
+	    continue;
+	}
+
+	if (*subtype) {
+	    printf("%s ", subtype);
+	}
+	printf("%s = %s | %" PRId64 "\n", type, value.text, value.timestamp);
+    }
+
+    ems_values_close(table);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ems_stream.h"
+
+struct ems_stream {
+    const uint8_t *base;
+    size_t size;
+    const volatile struct ems_stream_header *header;
+    const volatile struct ems_stream_record *records;
+    uint64_t mask;
+    /* number of the next record to read */
+    uint64_t position;
+    uint64_t lost;
+};
+
+static int
+check_layout(const struct ems_stream_header *header, size_t size)
+{
+    uint64_t end;
+
+    if (size < sizeof(*header)) {
+	return 0;
+    }
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != EMS_STREAM_MAGIC ||
+	    header->version != EMS_STREAM_VERSION ||
+	    header->record_size != sizeof(struct ems_stream_record) ||
+	    header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0) {
+	return 0;
+    }
+
+    end = (uint64_t) header->types_offset + header->type_count * EMS_VALUES_NAME_SIZE;
+    if (end > size) {
+	return 0;
+    }
+    end = (uint64_t) header->subtypes_offset + header->subtype_count * EMS_VALUES_NAME_SIZE;
+    if (end > size) {
+	return 0;
+    }
+    end = (uint64_t) header->records_offset +
+	    (uint64_t) header->capacity * header->record_size;
+    if (end > size || header->records_offset % 8 != 0) {
+	return 0;
+    }
+
+    return 1;
+}
+
+ems_stream *
+ems_stream_open(const char *name)
+{
+    struct stat st;
+    ems_stream *stream;
+    void *base;
+    int fd, error;
+
+    fd = shm_open(name ? name : EMS_STREAM_DEFAULT_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+	return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+	error = errno;
+	close(fd);
+	errno = error;
+	return NULL;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    error = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+	errno = error;
+	return NULL;
+    }
+
+    if (!check_layout((const struct ems_stream_header *) base, st.st_size)) {
+	munmap(base, st.st_size);
+	errno = EPROTO;
+	return NULL;
+    }
+
+    stream = malloc(sizeof(*stream));
+    if (!stream) {
+	munmap(base, st.st_size);
+	errno = ENOMEM;
+	return NULL;
+    }
+
+    stream->base = base;
+    stream->size = st.st_size;
+    stream->header = (const volatile struct ems_stream_header *) base;
+    stream->records = (const volatile struct ems_stream_record *)
+	    (stream->base + stream->header->records_offset);
+    stream->mask = stream->header->capacity - 1;
+    stream->position = __atomic_load_n(&stream->header->head, __ATOMIC_ACQUIRE);
+    stream->lost = 0;
+
+    return stream;
+}
+
+void
+ems_stream_close(ems_stream *stream)
+{
+    if (stream) {
+	munmap((void *) stream->base, stream->size);
+	free(stream);
+    }
+}
+
+/* oldest record which can't be overwritten while reading it: the slot of
+ * record head - capacity is the one the collector writes next */
+static uint64_t
+oldest_record(const ems_stream *stream)
+{
+    uint64_t head = __atomic_load_n(&stream->header->head, __ATOMIC_ACQUIRE);
+    return head > stream->mask ? head - stream->mask : 0;
+}
+
+void
+ems_stream_rewind(ems_stream *stream)
+{
+    stream->position = oldest_record(stream);
+}
+
+int
+ems_stream_next(ems_stream *stream, struct ems_stream_record *record)
+{
+    for (;;) {
+	const volatile struct ems_stream_record *entry =
+		&stream->records[stream->position & stream->mask];
+	uint64_t expected = 2 * stream->position + 2;
+	uint64_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+	if (seq < expected) {
+	    /* not yet written, or being written right now */
+	    return 0;
+	}
+
+	if (seq == expected) {
+	    record->timestamp_ns = entry->timestamp_ns;
+	    record->type = entry->type;
+	    record->subtype = entry->subtype;
+	    record->reading_type = entry->reading_type;
+	    record->reserved = 0;
+	    record->integer = entry->integer;
+	    record->numeric = entry->numeric;
+	    memcpy(record->text, (const void *) entry->text, sizeof(record->text));
+
+	    /* keeps the copies above before the second sequence check */
+	    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	    if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == expected) {
+		record->seq = stream->position++;
+		record->text[sizeof(record->text) - 1] = '\0';
+		return 1;
+	    }
+	}
+
+	/* overrun: the collector lapped us, skip to what is still there */
+	uint64_t oldest = oldest_record(stream);
+	if (oldest > stream->position) {
+	    stream->lost += oldest - stream->position;
+	    stream->position = oldest;
+	} else {
+	    /* overwritten while copying, but the head moved on meanwhile */
+	    stream->lost++;
+	    stream->position++;
+	}
+    }
+}
+
+uint64_t
+ems_stream_lost(const ems_stream *stream)
+{
+    return stream->lost;
+}
+
+const volatile struct ems_stream_header *
+ems_stream_header(const ems_stream *stream)
+{
+    return stream->header;
+}
+
+const char *
+ems_stream_type_name(const ems_stream *stream, unsigned int type)
+{
+    if (type >= stream->header->type_count) {
+	return "";
+    }
+    return (const char *) stream->base + stream->header->types_offset +
+	    type * EMS_VALUES_NAME_SIZE;
+}
+
+const char *
+ems_stream_subtype_name(const ems_stream *stream, unsigned int subtype)
+{
+    if (subtype >= stream->header->subtype_count) {
+	return "";
+    }
+    return (const char *) stream->base + stream->header->subtypes_offset +
+	    subtype * EMS_VALUES_NAME_SIZE;
+}
@@ -0,0 +1,103 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMS_STREAM_H__
+#define __EMS_STREAM_H__
+
+/*
+ * Stream of all decoded values the collector publishes in POSIX shared
+ * memory (--value-stream), as a ring of fixed size records. Record n is
+ * stored at index n % capacity; its sequence field is 2n + 1 while the
+ * collector writes it and 2n + 2 once it is complete. The collector never
+ * waits for readers: a reader that falls more than capacity records
+ * behind finds newer sequence numbers in its slots, skips ahead to the
+ * oldest record still available and counts the skipped ones as lost.
+ *
+ * Readers only map the segment read-only and keep their position
+ * privately, so any number of them can follow the stream independently
+ * without system calls.
+ */
+
+#include <stdint.h>
+#include "ems_values.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMS_STREAM_DEFAULT_NAME "/ems-stream"
+#define EMS_STREAM_MAGIC 0x454d5353 /* 'EMSS' */
+#define EMS_STREAM_VERSION 1
+#define EMS_STREAM_TEXT_SIZE 32
+
+struct ems_stream_header {
+    uint32_t magic;		/* written last when setting up the stream */
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;		/* records, a power of two */
+    uint32_t type_count;	/* names as in the value table */
+    uint32_t subtype_count;
+    uint32_t types_offset;
+    uint32_t subtypes_offset;
+    uint32_t records_offset;
+    uint32_t writer_pid;	/* 0 once the collector has stopped */
+    int64_t start_time;		/* when the collector set up the stream */
+    uint64_t head;		/* number of records published so far */
+};
+
+/* one cache line per record */
+struct ems_stream_record {
+    uint64_t seq;
+    int64_t timestamp_ns;	/* CLOCK_REALTIME when the value was decoded */
+    uint8_t type;
+    uint8_t subtype;
+    uint8_t reading_type;	/* enum ems_reading_type */
+    uint8_t reserved;
+    uint32_t integer;		/* integer, boolean and enumeration values */
+    double numeric;		/* numeric values, NaN if not available */
+    char text[EMS_STREAM_TEXT_SIZE]; /* formatted value, possibly truncated */
+};
+
+typedef struct ems_stream ems_stream;
+
+/* maps the stream read-only, positioned after the newest record; name
+ * may be NULL for the default name. Returns NULL with errno set if the
+ * stream doesn't exist or has an incompatible layout (EPROTO). */
+ems_stream * ems_stream_open(const char *name);
+void ems_stream_close(ems_stream *stream);
+
+/* moves the position to the oldest record still in the ring */
+void ems_stream_rewind(ems_stream *stream);
+/* copies the next record; returns 1 if there was one, 0 if the reader
+ * has caught up with the collector. The record's seq field is turned
+ * into the record number. */
+int ems_stream_next(ems_stream *stream, struct ems_stream_record *record);
+/* records overwritten before this reader got to them */
+uint64_t ems_stream_lost(const ems_stream *stream);
+
+const volatile struct ems_stream_header * ems_stream_header(const ems_stream *stream);
+/* "" for unknown or unnamed indices */
+const char * ems_stream_type_name(const ems_stream *stream, unsigned int type);
+const char * ems_stream_subtype_name(const ems_stream *stream, unsigned int subtype);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EMS_STREAM_H__ */
@@ -0,0 +1,244 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ems_values.h"
+
+/* a writer holds a slot for a few stores only, so this is plenty unless
+ * the collector was stopped in the middle of an update */
+#define MAX_READ_RETRIES 10000
+
+struct ems_values {
+    const uint8_t *base;
+    size_t size;
+    const volatile struct ems_values_header *header;
+    const volatile struct ems_values_slot *slots;
+    int type_count;
+    int subtype_count;
+};
+
+static int
+check_layout(const struct ems_values_header *header, size_t size)
+{
+    uint64_t names_end, slots_end;
+
+    if (size < sizeof(*header)) {
+	return 0;
+    }
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != EMS_VALUES_MAGIC ||
+	    header->version != EMS_VALUES_VERSION ||
+	    header->slot_size != sizeof(struct ems_values_slot) ||
+	    header->type_count == 0 || header->subtype_count == 0) {
+	return 0;
+    }
+
+    names_end = (uint64_t) header->types_offset + header->type_count * EMS_VALUES_NAME_SIZE;
+    if (names_end > size) {
+	return 0;
+    }
+    names_end = (uint64_t) header->subtypes_offset + header->subtype_count * EMS_VALUES_NAME_SIZE;
+    if (names_end > size) {
+	return 0;
+    }
+    slots_end = (uint64_t) header->slots_offset +
+	    (uint64_t) header->type_count * header->subtype_count * header->slot_size;
+    if (slots_end > size || header->slots_offset % 8 != 0) {
+	return 0;
+    }
+
+    return 1;
+}
+
+ems_values *
+ems_values_open(const char *name)
+{
+    struct stat st;
+    ems_values *table;
+    void *base;
+    int fd, error;
+
+    fd = shm_open(name ? name : EMS_VALUES_DEFAULT_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+	return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+	error = errno;
+	close(fd);
+	errno = error;
+	return NULL;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    error = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+	errno = error;
+	return NULL;
+    }
+
+    if (!check_layout((const struct ems_values_header *) base, st.st_size)) {
+	munmap(base, st.st_size);
+	errno = EPROTO;
+	return NULL;
+    }
+
+    table = malloc(sizeof(*table));
+    if (!table) {
+	munmap(base, st.st_size);
+	errno = ENOMEM;
+	return NULL;
+    }
+
+    table->base = base;
+    table->size = st.st_size;
+    table->header = (const volatile struct ems_values_header *) base;
+    table->slots = (const volatile struct ems_values_slot *)
+	    (table->base + table->header->slots_offset);
+    table->type_count = table->header->type_count;
+    table->subtype_count = table->header->subtype_count;
+
+    return table;
+}
+
+void
+ems_values_close(ems_values *table)
+{
+    if (table) {
+	munmap((void *) table->base, table->size);
+	free(table);
+    }
+}
+
+int
+ems_values_slot_count(const ems_values *table)
+{
+    return table->type_count * table->subtype_count;
+}
+
+const volatile struct ems_values_header *
+ems_values_header(const ems_values *table)
+{
+    return table->header;
+}
+
+const char *
+ems_values_type_name(const ems_values *table, int slot)
+{
+    if (slot < 0 || slot >= ems_values_slot_count(table)) {
+	return NULL;
+    }
+    return (const char *) table->base + table->header->types_offset +
+	    (slot / table->subtype_count) * EMS_VALUES_NAME_SIZE;
+}
+
+const char *
+ems_values_subtype_name(const ems_values *table, int slot)
+{
+    if (slot < 0 || slot >= ems_values_slot_count(table)) {
+	return NULL;
+    }
+    return (const char *) table->base + table->header->subtypes_offset +
+	    (slot % table->subtype_count) * EMS_VALUES_NAME_SIZE;
+}
+
+static int
+find_name(const ems_values *table, uint32_t offset, int count, const char *name)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+	const char *entry = (const char *) table->base + offset + i * EMS_VALUES_NAME_SIZE;
+	if (strncmp(entry, name, EMS_VALUES_NAME_SIZE) == 0) {
+	    return i;
+	}
+    }
+
+    return -1;
+}
+
+int
+ems_values_find(const ems_values *table, const char *subtype, const char *type)
+{
+    int type_index, subtype_index;
+
+    if (!type || !*type) {
+	return -1;
+    }
+    if (!subtype || strcmp(subtype, "none") == 0) {
+	subtype = "";
+    }
+
+    type_index = find_name(table, table->header->types_offset, table->type_count, type);
+    subtype_index = find_name(table, table->header->subtypes_offset,
+			      table->subtype_count, subtype);
+    if (type_index < 0 || subtype_index < 0) {
+	return -1;
+    }
+
+    return type_index * table->subtype_count + subtype_index;
+}
+
+int
+ems_values_read(const ems_values *table, int slot, struct ems_value *value)
+{
+    const volatile struct ems_values_slot *entry;
+    unsigned int retries;
+    uint32_t seq;
+    uint8_t present;
+
+    if (slot < 0 || slot >= ems_values_slot_count(table)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    entry = &table->slots[slot];
+    for (retries = 0; retries < MAX_READ_RETRIES; retries++) {
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1) {
+	    continue;
+	}
+
+	present = entry->present;
+	value->timestamp = entry->timestamp;
+	value->reading_type = entry->reading_type;
+	value->integer = entry->integer;
+	value->numeric = entry->numeric;
+	memcpy(value->text, (const void *) entry->text, sizeof(value->text));
+
+	/* keeps the copies above before the second sequence check */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq) {
+	    if (!present) {
+		errno = ENOENT;
+		return -1;
+	    }
+	    value->text[sizeof(value->text) - 1] = '\0';
+	    return 0;
+	}
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
@@ -0,0 +1,119 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMS_VALUES_H__
+#define __EMS_VALUES_H__
+
+/*
+ * Live value table the collector publishes in POSIX shared memory
+ * (--value-table). There is one fixed slot per (type, subtype) pair,
+ * at index type * subtype_count + subtype. Each slot is protected by a
+ * sequence counter which is odd while the collector writes it; readers
+ * copy the slot and retry if the counter changed meanwhile. Reading thus
+ * needs no system calls and never blocks the collector.
+ *
+ * The names of types and subtypes are stored in the segment as well, so
+ * readers can find slots without knowing the collector's numbering.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EMS_VALUES_DEFAULT_NAME "/ems-values"
+#define EMS_VALUES_MAGIC 0x454d5356 /* 'EMSV' */
+#define EMS_VALUES_VERSION 1
+#define EMS_VALUES_NAME_SIZE 32
+#define EMS_VALUES_TEXT_SIZE 36
+
+/* same order as EmsValue::ReadingType */
+enum ems_reading_type {
+    EMS_READING_NUMERIC,
+    EMS_READING_INTEGER,
+    EMS_READING_BOOLEAN,
+    EMS_READING_ENUMERATION,
+    EMS_READING_KENNLINIE,
+    EMS_READING_ERROR,
+    EMS_READING_DATE,
+    EMS_READING_SYSTEMTIME,
+    EMS_READING_FORMATTED
+};
+
+struct ems_values_header {
+    uint32_t magic;		/* written last when setting up the table */
+    uint32_t version;
+    uint32_t type_count;
+    uint32_t subtype_count;
+    uint32_t slot_size;
+    uint32_t types_offset;	/* type_count names of EMS_VALUES_NAME_SIZE */
+    uint32_t subtypes_offset;	/* subtype_count names, "" for no subtype */
+    uint32_t slots_offset;
+    int64_t start_time;		/* when the collector set up the table */
+    uint32_t writer_pid;	/* 0 once the collector has stopped */
+    uint32_t reserved;
+    uint64_t generation;	/* incremented after every slot update */
+};
+
+/* one cache line per slot */
+struct ems_values_slot {
+    uint32_t seq;
+    uint8_t present;
+    uint8_t reading_type;
+    uint16_t reserved;
+    int64_t timestamp;
+    double numeric;
+    uint32_t integer;
+    char text[EMS_VALUES_TEXT_SIZE];
+};
+
+/* a slot as copied out by ems_values_read() */
+struct ems_value {
+    int64_t timestamp;		/* unix time the value was last received */
+    uint8_t reading_type;	/* enum ems_reading_type */
+    uint32_t integer;		/* integer, boolean and enumeration values */
+    double numeric;		/* numeric values, NaN if not available */
+    char text[EMS_VALUES_TEXT_SIZE]; /* formatted value, as in 'cache fetch' */
+};
+
+typedef struct ems_values ems_values;
+
+/* maps the table read-only; name may be NULL for the default name.
+ * Returns NULL with errno set if the table doesn't exist or has an
+ * incompatible layout (EPROTO). */
+ems_values * ems_values_open(const char *name);
+void ems_values_close(ems_values *table);
+
+/* slot index for a type and subtype name (NULL, "" or "none" for none);
+ * -1 if the collector doesn't know the pair */
+int ems_values_find(const ems_values *table, const char *subtype, const char *type);
+/* consistent copy of a slot; returns 0 if present, -1 otherwise */
+int ems_values_read(const ems_values *table, int slot, struct ems_value *value);
+/* the header, e.g. to check generation or writer_pid */
+const volatile struct ems_values_header * ems_values_header(const ems_values *table);
+int ems_values_slot_count(const ems_values *table);
+const char * ems_values_type_name(const ems_values *table, int slot);
+const char * ems_values_subtype_name(const ems_values *table, int slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EMS_VALUES_H__ */
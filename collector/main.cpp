@@ -36,6 +36,10 @@ getHandler(const std::string& target, Database& db, ValueCache& cache)
 	return new SerialHandler(target.substr(7), db, cache);
     }
 
+    if (target.compare(0, 10, "rawserial:") == 0) {
+	return new SerialHandler(target.substr(10), db, cache, true);
+    }
+
     if (target.compare(0, 4, "tcp:") == 0) {
 	size_t pos = target.find(':', 4);
 	if (pos != std::string::npos) {
@@ -57,6 +61,16 @@ int main(int argc, char *argv[])
 	return 0;
     }
 
+    if (Options::migrateSchema()) {
+	const std::string& dbPath = Options::databasePath();
+	if (dbPath.empty() || dbPath == "none") {
+	    std::cerr << "No database to migrate" << std::endl;
+	    return 1;
+	}
+	return Database::migrateSchema(dbPath, Options::databaseUser(),
+				       Options::databasePassword()) ? 0 : 1;
+    }
+
     try {
 	sigset_t oldMask, newMask, waitMask;
 	struct timespec pollTimeout;
@@ -71,13 +85,6 @@ int main(int argc, char *argv[])
 	    pid.aquire();
 	}
 
-	if (dbPath != "none") {
-	    if (!db.connect(dbPath, Options::databaseUser(), Options::databasePassword())) {
-		std::cerr << "Could not connect to database" << std::endl;
-		return 1;
-	    }
-	}
-
 	if (Options::daemonize()) {
 	    if (daemon(0, 0) == -1) {
 		std::ostringstream msg;
@@ -88,6 +95,11 @@ int main(int argc, char *argv[])
 	    pid.write();
 	}
 
+	/* after daemonizing, as the thread would not survive the fork */
+	if (dbPath != "none") {
+	    db.startConnecting(dbPath, Options::databaseUser(), Options::databasePassword());
+	}
+
 	pollTimeout.tv_sec = 2;
 	pollTimeout.tv_nsec = 0;
 
@@ -0,0 +1,73 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <gtest/gtest.h>
+#include "RequestPacer.h"
+
+using boost::posix_time::milliseconds;
+using boost::posix_time::ptime;
+using boost::posix_time::time_from_string;
+
+static const long Distance = 100;
+static const ptime Start(time_from_string("2014-03-12 12:00:00"));
+
+TEST(RequestPacer, QueuedMessagesAreSpaced)
+{
+    RequestPacer pacer(Distance);
+
+    /* queued at once, they must not go out on the same tick */
+    EXPECT_EQ(0, pacer.reserve(0x08, Start));
+    EXPECT_EQ(100, pacer.reserve(0x08, Start));
+    EXPECT_EQ(200, pacer.reserve(0x08, Start));
+}
+
+TEST(RequestPacer, SpacingCountsFromQueueTime)
+{
+    RequestPacer pacer(Distance);
+
+    EXPECT_EQ(0, pacer.reserve(0x08, Start));
+    EXPECT_EQ(70, pacer.reserve(0x08, Start + milliseconds(30)));
+    EXPECT_EQ(140, pacer.reserve(0x08, Start + milliseconds(60)));
+    /* after the last slot has passed, a message goes out right away */
+    EXPECT_EQ(0, pacer.reserve(0x08, Start + milliseconds(300)));
+}
+
+TEST(RequestPacer, DestinationsAreIndependent)
+{
+    RequestPacer pacer(Distance);
+
+    EXPECT_EQ(0, pacer.reserve(0x08, Start));
+    EXPECT_EQ(0, pacer.reserve(0x10, Start));
+    EXPECT_EQ(100, pacer.reserve(0x08, Start));
+    EXPECT_EQ(100, pacer.reserve(0x10, Start));
+}
+
+TEST(RequestPacer, ActivityDelaysNextMessage)
+{
+    RequestPacer pacer(Distance);
+
+    pacer.handleActivity(0x08, Start);
+    EXPECT_EQ(60, pacer.reserve(0x08, Start + milliseconds(40)));
+    EXPECT_EQ(160, pacer.reserve(0x08, Start + milliseconds(40)));
+
+    /* activity doesn't move slots already handed out back */
+    pacer.handleActivity(0x08, Start + milliseconds(50));
+    EXPECT_EQ(260, pacer.reserve(0x08, Start + milliseconds(40)));
+}
@@ -0,0 +1,62 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2014 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <gtest/gtest.h>
+#define MYSQLPP_SSQLS_NO_STATICS
+#include "PendingWrites.h"
+#include "Schema.h"
+
+static const time_t Now = 1394625600;
+
+static std::string
+keyOf(unsigned int sensor, const mysqlpp::sql_datetime& start)
+{
+    std::ostringstream key;
+    key << "(sensor = " << sensor << " and starttime = '" << start << "')";
+    return key.str();
+}
+
+TEST(Schema, KeyConditionUsesStartOfEachRow)
+{
+    PendingWrites writes(Now);
+    mysqlpp::sql_datetime earlier(Now - 600);
+    std::ostringstream condition;
+
+    queueRow(writes.numericRows, 1, 21.5f, writes.timestamp);
+    /* a swinging door row starts at an earlier sample */
+    queueRow(writes.numericRows, 2, 48.0f, earlier, writes.timestamp);
+    Schema::appendKeyCondition(condition, writes.numericRows);
+
+    EXPECT_EQ(keyOf(1, writes.timestamp) + " or " + keyOf(2, earlier), condition.str());
+}
+
+TEST(Schema, KeyConditionFollowsRequeuedRow)
+{
+    PendingWrites writes(Now);
+    mysqlpp::sql_datetime earlier(Now - 600);
+    std::ostringstream condition;
+
+    /* the last value of a sensor within a message wins, with its start */
+    queueRow(writes.numericRows, 2, 47.5f, writes.timestamp);
+    queueRow(writes.numericRows, 2, 48.0f, earlier, writes.timestamp);
+    Schema::appendKeyCondition(condition, writes.numericRows);
+
+    EXPECT_EQ(keyOf(2, earlier), condition.str());
+}
@@ -0,0 +1,253 @@
+/*
+ * Buderus EMS frame grabber
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "framer.h"
+
+#if defined(FRAMER_CRC_TABLE) && defined(__AVR__)
+#include <avr/pgmspace.h>
+#define CRC_TABLE_ATTR	    PROGMEM
+#define CRC_TABLE_READ(i)   pgm_read_byte(&crc_table[i])
+#else
+#define CRC_TABLE_ATTR
+#define CRC_TABLE_READ(i)   crc_table[i]
+#endif
+
+static uint8_t recv_buffer[RECV_BUF_SIZE];
+static uint8_t recv_pos = 0;
+static uint8_t recv_valid = 0;
+static uint8_t recv_overflow = 0;
+
+static volatile uint8_t tx_buffer[TRANSMIT_BUF_SIZE];
+static volatile uint8_t tx_write_pos = 0;
+static volatile uint8_t tx_read_pos = 0;
+
+void framer_init(void)
+{
+    recv_pos = 0;
+    recv_valid = 0;
+    recv_overflow = 0;
+    tx_write_pos = 0;
+    tx_read_pos = 0;
+}
+
+uint8_t calc_checksum(const uint8_t *buffer, uint8_t size)
+{
+    uint8_t crc = 0, d;
+
+    for (uint8_t i = 0; i < size; i++) {
+	d = 0;
+	if (crc & 0x80) {
+	    crc ^= 0xc;
+	    d = 1;
+	}
+	crc <<= 1;
+	crc &= 0xfe;
+	crc |= d;
+	crc = crc ^ buffer[i];
+	FRAMER_COST(14);
+    }
+
+    return crc;
+}
+
+#if defined(FRAMER_CRC_TABLE) || defined(FRAMER_SIMULATION)
+/* crc_table[crc] is the shift step of calc_checksum() for crc */
+static const uint8_t crc_table[256] CRC_TABLE_ATTR = {
+    0x00, 0x02, 0x04, 0x06, 0x08, 0x0a, 0x0c, 0x0e,
+    0x10, 0x12, 0x14, 0x16, 0x18, 0x1a, 0x1c, 0x1e,
+    0x20, 0x22, 0x24, 0x26, 0x28, 0x2a, 0x2c, 0x2e,
+    0x30, 0x32, 0x34, 0x36, 0x38, 0x3a, 0x3c, 0x3e,
+    0x40, 0x42, 0x44, 0x46, 0x48, 0x4a, 0x4c, 0x4e,
+    0x50, 0x52, 0x54, 0x56, 0x58, 0x5a, 0x5c, 0x5e,
+    0x60, 0x62, 0x64, 0x66, 0x68, 0x6a, 0x6c, 0x6e,
+    0x70, 0x72, 0x74, 0x76, 0x78, 0x7a, 0x7c, 0x7e,
+    0x80, 0x82, 0x84, 0x86, 0x88, 0x8a, 0x8c, 0x8e,
+    0x90, 0x92, 0x94, 0x96, 0x98, 0x9a, 0x9c, 0x9e,
+    0xa0, 0xa2, 0xa4, 0xa6, 0xa8, 0xaa, 0xac, 0xae,
+    0xb0, 0xb2, 0xb4, 0xb6, 0xb8, 0xba, 0xbc, 0xbe,
+    0xc0, 0xc2, 0xc4, 0xc6, 0xc8, 0xca, 0xcc, 0xce,
+    0xd0, 0xd2, 0xd4, 0xd6, 0xd8, 0xda, 0xdc, 0xde,
+    0xe0, 0xe2, 0xe4, 0xe6, 0xe8, 0xea, 0xec, 0xee,
+    0xf0, 0xf2, 0xf4, 0xf6, 0xf8, 0xfa, 0xfc, 0xfe,
+    0x19, 0x1b, 0x1d, 0x1f, 0x11, 0x13, 0x15, 0x17,
+    0x09, 0x0b, 0x0d, 0x0f, 0x01, 0x03, 0x05, 0x07,
+    0x39, 0x3b, 0x3d, 0x3f, 0x31, 0x33, 0x35, 0x37,
+    0x29, 0x2b, 0x2d, 0x2f, 0x21, 0x23, 0x25, 0x27,
+    0x59, 0x5b, 0x5d, 0x5f, 0x51, 0x53, 0x55, 0x57,
+    0x49, 0x4b, 0x4d, 0x4f, 0x41, 0x43, 0x45, 0x47,
+    0x79, 0x7b, 0x7d, 0x7f, 0x71, 0x73, 0x75, 0x77,
+    0x69, 0x6b, 0x6d, 0x6f, 0x61, 0x63, 0x65, 0x67,
+    0x99, 0x9b, 0x9d, 0x9f, 0x91, 0x93, 0x95, 0x97,
+    0x89, 0x8b, 0x8d, 0x8f, 0x81, 0x83, 0x85, 0x87,
+    0xb9, 0xbb, 0xbd, 0xbf, 0xb1, 0xb3, 0xb5, 0xb7,
+    0xa9, 0xab, 0xad, 0xaf, 0xa1, 0xa3, 0xa5, 0xa7,
+    0xd9, 0xdb, 0xdd, 0xdf, 0xd1, 0xd3, 0xd5, 0xd7,
+    0xc9, 0xcb, 0xcd, 0xcf, 0xc1, 0xc3, 0xc5, 0xc7,
+    0xf9, 0xfb, 0xfd, 0xff, 0xf1, 0xf3, 0xf5, 0xf7,
+    0xe9, 0xeb, 0xed, 0xef, 0xe1, 0xe3, 0xe5, 0xe7,
+};
+
+uint8_t calc_checksum_table(const uint8_t *buffer, uint8_t size)
+{
+    uint8_t crc = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+	crc = CRC_TABLE_READ(crc) ^ buffer[i];
+	FRAMER_COST(8);
+    }
+
+    return crc;
+}
+#endif
+
+static uint8_t frame_checksum(const uint8_t *buffer, uint8_t size)
+{
+#if defined(FRAMER_SIMULATION)
+    if (framer_use_crc_table) {
+	return calc_checksum_table(buffer, size);
+    }
+#elif defined(FRAMER_CRC_TABLE)
+    return calc_checksum_table(buffer, size);
+#endif
+    return calc_checksum(buffer, size);
+}
+
+static void copy_to_tx_buffer(uint8_t data)
+{
+    tx_buffer[tx_write_pos++] = data;
+    if (tx_write_pos >= TRANSMIT_BUF_SIZE) {
+	tx_write_pos = 0;
+    }
+    FRAMER_COST(12);
+}
+
+static void start_tx_frame(void)
+{
+    copy_to_tx_buffer(0xaa);
+    copy_to_tx_buffer(0x55);
+}
+
+static void add_tx_data(uint8_t *data, uint8_t len)
+{
+    uint8_t csum = 0;
+
+    copy_to_tx_buffer(len);
+    for (uint8_t i = 0; i < len; i++) {
+	copy_to_tx_buffer(data[i]);
+	csum ^= data[i];
+	FRAMER_COST(4);
+    }
+    /* checksum -> running XOR */
+    copy_to_tx_buffer(csum);
+}
+
+static uint8_t enough_tx_space(uint8_t needed)
+{
+    uint8_t space;
+
+    FRAMER_COST(16);
+    needed += 5; /* frame start, type, len, csum */
+    if (tx_write_pos >= tx_read_pos) {
+	space = TRANSMIT_BUF_SIZE - (tx_write_pos - tx_read_pos);
+    } else {
+	space = tx_read_pos - tx_write_pos;
+    }
+
+    return space >= needed;
+}
+
+framer_result_t framer_rx_byte(uint8_t data, uint8_t frame_error)
+{
+    framer_result_t result = FRAMER_NONE;
+
+    /* reading status and data, ISR entry and exit */
+    FRAMER_COST(40);
+
+    if (recv_valid) {
+	if (frame_error) {
+	    /* frame error -> end of frame byte */
+
+	    if (recv_overflow) {
+		result = FRAMER_RX_OVERFLOW;
+	    } else if (recv_pos > 1) {
+		/* ignore 1-byte-long frames, strip CRC */
+		recv_pos--;
+
+		uint8_t crc = frame_checksum(recv_buffer, recv_pos);
+		if (crc == recv_buffer[recv_pos]) {
+		    /* checksum valid, check whether there's enough
+		     * room in the TX buffer */
+
+		    /* need frame start + len + payload */
+		    if (enough_tx_space(recv_pos)) {
+			start_tx_frame();
+			add_tx_data(recv_buffer, recv_pos);
+			result = FRAMER_FRAME_OK;
+		    } else {
+			result = FRAMER_TX_FULL;
+		    }
+		} else {
+		    result = FRAMER_CRC_ERROR;
+		}
+	    }
+	} else {
+	    if (recv_pos < RECV_BUF_SIZE) {
+		recv_buffer[recv_pos++] = data;
+		FRAMER_COST(10);
+	    } else {
+		recv_overflow = 1;
+	    }
+	}
+    }
+
+    if (frame_error) {
+	/* after frame end, the upcoming data is valid */
+	recv_pos = 0;
+	recv_valid = 1;
+	recv_overflow = 0;
+    }
+
+    return result;
+}
+
+uint8_t framer_tx_pending(void)
+{
+    return tx_write_pos != tx_read_pos;
+}
+
+uint8_t framer_tx_peek(void)
+{
+    return tx_buffer[tx_read_pos];
+}
+
+void framer_tx_advance(void)
+{
+    tx_read_pos++;
+    if (tx_read_pos >= TRANSMIT_BUF_SIZE) {
+	tx_read_pos = 0;
+    }
+}
+
+uint8_t framer_tx_fill(void)
+{
+    if (tx_write_pos >= tx_read_pos) {
+	return tx_write_pos - tx_read_pos;
+    }
+    return TRANSMIT_BUF_SIZE - (tx_read_pos - tx_write_pos);
+}
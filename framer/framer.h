@@ -0,0 +1,74 @@
+/*
+ * Buderus EMS frame grabber
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRAMER_H__
+#define __FRAMER_H__
+
+#include <stdint.h>
+
+/*
+ * Hardware independent part of the frame grabber: collects the bytes of
+ * EMS frames, checks their CRC and queues them as 0xaa 0x55 <len> <data>
+ * <xor checksum> packets for the host. main.c feeds it from the UART ISR
+ * and drains the TX ring from the main loop; sim.c does the same on the
+ * host, with a model of the bus timing.
+ */
+
+#ifndef RECV_BUF_SIZE
+#define RECV_BUF_SIZE	    64
+#endif
+#ifndef TRANSMIT_BUF_SIZE
+#define TRANSMIT_BUF_SIZE   250
+#endif
+
+/* rough ATmega8 cycle estimates, only accounted in the host simulation */
+#ifdef FRAMER_SIMULATION
+extern uint32_t framer_cycles;
+extern uint8_t framer_use_crc_table;
+#define FRAMER_COST(cycles) (framer_cycles += (cycles))
+#else
+#define FRAMER_COST(cycles)
+#endif
+
+typedef enum {
+    FRAMER_NONE,	/* byte stored or ignored */
+    FRAMER_FRAME_OK,	/* frame queued for the host */
+    FRAMER_CRC_ERROR,
+    FRAMER_RX_OVERFLOW,	/* frame longer than RECV_BUF_SIZE */
+    FRAMER_TX_FULL	/* valid frame, but no room in the TX ring */
+} framer_result_t;
+
+void framer_init(void);
+
+/* called for every received byte; frame_error is set for the break
+ * (a zero byte without stop bit) that ends each frame */
+framer_result_t framer_rx_byte(uint8_t data, uint8_t frame_error);
+
+/* TX ring access for the main loop; must not be interrupted by the ISR */
+uint8_t framer_tx_pending(void);
+uint8_t framer_tx_peek(void);
+void framer_tx_advance(void);
+uint8_t framer_tx_fill(void);
+
+uint8_t calc_checksum(const uint8_t *buffer, uint8_t size);
+#if defined(FRAMER_CRC_TABLE) || defined(FRAMER_SIMULATION)
+uint8_t calc_checksum_table(const uint8_t *buffer, uint8_t size);
+#endif
+
+#endif /* __FRAMER_H__ */
@@ -20,9 +20,7 @@
 #include <avr/io.h>
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
-
-#define RECV_BUF_SIZE	    64
-#define TRANSMIT_BUF_SIZE   250
+#include "framer.h"
 
 #define BAUD     9600
 #define UBRR_VAL (F_CPU / 16 / BAUD - 1)
@@ -30,74 +28,6 @@
 #define PACKET_LED_TIME	    100 /* ms */
 #define FAULT_LED_TIME	    200 /* ms */
 
-static uint8_t recv_buffer[RECV_BUF_SIZE];
-static uint8_t recv_pos = 0;
-static uint8_t recv_valid = 0;
-
-static volatile uint8_t tx_buffer[TRANSMIT_BUF_SIZE];
-static volatile uint8_t tx_write_pos = 0;
-static volatile uint8_t tx_read_pos = 0;
-
-static uint8_t calc_checksum(const uint8_t *buffer, uint8_t size)
-{
-    uint8_t crc = 0, d;
-
-    for (uint8_t i = 0; i < size; i++) {
-	d = 0;
-	if (crc & 0x80) {
-	    crc ^= 0xc;
-	    d = 1;
-	}
-	crc <<= 1;
-	crc &= 0xfe;
-	crc |= d;
-	crc = crc ^ buffer[i];
-    }
-
-    return crc;
-}
-
-static void copy_to_tx_buffer(uint8_t data)
-{
-    tx_buffer[tx_write_pos++] = data;
-    if (tx_write_pos >= TRANSMIT_BUF_SIZE) {
-	tx_write_pos = 0;
-    }
-}
-
-static void start_tx_frame()
-{
-    copy_to_tx_buffer(0xaa);
-    copy_to_tx_buffer(0x55);
-}
-
-static void add_tx_data(uint8_t *data, uint8_t len)
-{
-    uint8_t csum = 0;
-
-    copy_to_tx_buffer(len);
-    for (uint8_t i = 0; i < len; i++) {
-	copy_to_tx_buffer(data[i]);
-	csum ^= data[i];
-    }
-    /* checksum -> running XOR */
-    copy_to_tx_buffer(csum);
-}
-
-static uint8_t enough_tx_space(uint8_t needed)
-{
-    uint8_t space;
-
-    needed += 5; /* frame start, type, len, csum */
-    if (tx_write_pos >= tx_read_pos) {
-	space = TRANSMIT_BUF_SIZE - (tx_write_pos - tx_read_pos);
-    } else {
-	space = tx_read_pos - tx_write_pos;
-    }
-
-    return space >= needed;
-}
-
 static void enable_led(uint8_t fault)
 {
     uint16_t time;
@@ -139,41 +69,16 @@ ISR(SIG_UART_RECV)
 
 	data = UDR;
 
-	if (recv_valid) {
-	    if (status & _BV(FE)) {
-		/* frame error -> end of frame byte */
-
-		/* ignore 1-byte-long frames */
-		if (recv_pos > 1) {
-		    /* strip CRC */
-		    recv_pos--;
-
-		    uint8_t crc = calc_checksum(recv_buffer, recv_pos);
-		    if (crc == recv_buffer[recv_pos]) {
-			/* checksum valid, check whether there's enough
-			 * room in the TX buffer */
-
-			/* need frame start + len + payload */
-			if (enough_tx_space(recv_pos)) {
-			    start_tx_frame();
-			    add_tx_data(recv_buffer, recv_pos);
-			    enable_led(0);
-			}
-		    } else {
-			enable_led(1);
-		    }
-		}
-	    } else {
-		if (recv_pos < RECV_BUF_SIZE) {
-		    recv_buffer[recv_pos++] = data;
-		}
-	    }
-	}
-
-	if (status & _BV(FE)) {
-	    /* after frame end, the upcoming data is valid */
-	    recv_pos = 0;
-	    recv_valid = 1;
+	switch (framer_rx_byte(data, status & _BV(FE))) {
+	    case FRAMER_FRAME_OK:
+		enable_led(0);
+		break;
+	    case FRAMER_CRC_ERROR:
+	    case FRAMER_RX_OVERFLOW:
+		enable_led(1);
+		break;
+	    default:
+		break;
 	}
     }
 }
@@ -205,22 +110,20 @@ int main(void)
     PORTB = 0;
     DDRB = _BV(DDB1) | _BV(DDB2);
 
+    framer_init();
     uart_init();
     sei();
 
     while (1) {
 	cli();
-	has_data = tx_write_pos != tx_read_pos;
+	has_data = framer_tx_pending();
 	sei();
 
 	if (has_data) {
-	    uart_write(tx_buffer[tx_read_pos]);
+	    uart_write(framer_tx_peek());
 
 	    cli();
-	    tx_read_pos++;
-	    if (tx_read_pos >= TRANSMIT_BUF_SIZE) {
-		tx_read_pos = 0;
-	    }
+	    framer_tx_advance();
 	    sei();
 	}
 
@@ -0,0 +1,381 @@
+/*
+ * Buderus EMS frame grabber
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the frame grabber: replays a bus timeline through
+ * framer.c at 9600 baud, drains the TX ring at the same rate like the
+ * main loop does and reports dropped frames and the estimated ISR load.
+ * Every forwarded packet is checked against the frame it came from.
+ *
+ * Timelines have one frame per line: <gap in ms> <hex bytes...>, the gap
+ * being the bus idle time before the frame. The CRC is appended by the
+ * simulation; single byte lines are polls and are sent as they are.
+ * With -c, a collector-bench corpus (<name> <hex bytes...>) is used with
+ * the gap given by -g; -s generates random frames instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "framer.h"
+
+/* 1 start, 8 data, 1 stop bit at 9600 baud */
+#define BYTE_TIME_US	    (10 * 1000000.0 / 9600)
+#define CPU_MHZ		    8
+#define MAX_FRAME_SIZE	    256
+
+typedef struct {
+    double gap_us;
+    uint8_t data[MAX_FRAME_SIZE];
+    unsigned int length;
+    uint8_t poll;
+} frame_t;
+
+typedef struct {
+    unsigned long frames;
+    unsigned long ok;
+    unsigned long crc_errors;
+    unsigned long rx_overflows;
+    unsigned long tx_full;
+    unsigned long corrupted;
+    unsigned long bytes;
+    unsigned long long cycles;
+    uint32_t max_isr_cycles;
+    unsigned int max_tx_fill;
+} stats_t;
+
+uint32_t framer_cycles;
+uint8_t framer_use_crc_table;
+
+static frame_t *frames;
+static size_t frame_count, frame_alloc;
+
+/* frames expected on the host side, in order */
+static const frame_t **expected;
+static size_t expected_head, expected_tail;
+static uint8_t out_buffer[MAX_FRAME_SIZE + 4];
+static size_t out_pos;
+
+static frame_t *add_frame(void)
+{
+    if (frame_count == frame_alloc) {
+	frame_alloc = frame_alloc ? frame_alloc * 2 : 64;
+	frames = realloc(frames, frame_alloc * sizeof(frame_t));
+	if (!frames) {
+	    perror("realloc");
+	    exit(1);
+	}
+    }
+    memset(&frames[frame_count], 0, sizeof(frame_t));
+    return &frames[frame_count++];
+}
+
+static int parse_bytes(frame_t *frame, char *fields)
+{
+    char *token;
+
+    for (token = strtok(fields, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+	if (frame->length >= MAX_FRAME_SIZE - 1) {
+	    return -1;
+	}
+	frame->data[frame->length++] = strtoul(token, NULL, 16);
+    }
+    return frame->length > 0 ? 0 : -1;
+}
+
+static void read_frames(const char *path, int corpus, double gap_ms)
+{
+    char line[1024];
+    unsigned int line_no = 0;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+	perror(path);
+	exit(1);
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+	char *pos = line + strspn(line, " \t");
+	char *rest;
+	frame_t *frame;
+
+	line_no++;
+	if (*pos == '#' || *pos == '\n' || *pos == 0) {
+	    continue;
+	}
+
+	rest = pos + strcspn(pos, " \t");
+	frame = add_frame();
+	frame->gap_us = (corpus ? gap_ms : strtod(pos, NULL)) * 1000;
+	if (parse_bytes(frame, rest) < 0) {
+	    fprintf(stderr, "%s:%u: invalid frame\n", path, line_no);
+	    exit(1);
+	}
+    }
+    fclose(file);
+}
+
+static void generate_frames(unsigned int count, unsigned int length, double gap_ms)
+{
+    unsigned int i, j;
+
+    srand(1);
+    for (i = 0; i < count; i++) {
+	frame_t *frame = add_frame();
+
+	frame->gap_us = gap_ms * 1000;
+	frame->length = length;
+	for (j = 0; j < length; j++) {
+	    frame->data[j] = rand() & 0xff;
+	}
+    }
+}
+
+static void finish_frames(void)
+{
+    size_t i;
+
+    for (i = 0; i < frame_count; i++) {
+	frame_t *frame = &frames[i];
+
+	if (frame->length == 1) {
+	    frame->poll = 1;
+	} else {
+	    frame->data[frame->length] = calc_checksum(frame->data, frame->length);
+	    frame->length++;
+	}
+    }
+
+    expected = malloc(frame_count * sizeof(frame_t *));
+    if (!expected) {
+	perror("malloc");
+	exit(1);
+    }
+}
+
+/* parses the host side stream and compares it to the expected frames */
+static void host_receive(uint8_t byte, stats_t *stats)
+{
+    out_buffer[out_pos++] = byte;
+
+    if ((out_pos == 1 && byte != 0xaa) || (out_pos == 2 && byte != 0x55)) {
+	stats->corrupted++;
+	out_pos = 0;
+	return;
+    }
+    if (out_pos < 3 || out_pos < (size_t) out_buffer[2] + 4) {
+	return;
+    }
+
+    const frame_t *frame = expected_head < expected_tail ? expected[expected_head++] : NULL;
+    uint8_t length = out_buffer[2], csum = 0, i;
+
+    for (i = 0; i < length; i++) {
+	csum ^= out_buffer[3 + i];
+    }
+    /* the frame is forwarded without its CRC */
+    if (!frame || frame->length - 1 != length || csum != out_buffer[3 + length] ||
+	    memcmp(frame->data, &out_buffer[3], length) != 0) {
+	stats->corrupted++;
+    }
+    out_pos = 0;
+}
+
+static void rx_byte(uint8_t data, uint8_t frame_error, stats_t *stats)
+{
+    framer_cycles = 0;
+    framer_result_t result = framer_rx_byte(data, frame_error);
+
+    stats->cycles += framer_cycles;
+    stats->bytes++;
+    if (framer_cycles > stats->max_isr_cycles) {
+	stats->max_isr_cycles = framer_cycles;
+    }
+
+    switch (result) {
+	case FRAMER_FRAME_OK: stats->ok++; break;
+	case FRAMER_CRC_ERROR: stats->crc_errors++; break;
+	case FRAMER_RX_OVERFLOW: stats->rx_overflows++; break;
+	case FRAMER_TX_FULL: stats->tx_full++; break;
+	default: break;
+    }
+    if (result == FRAMER_FRAME_OK) {
+	unsigned int fill = framer_tx_fill();
+	if (fill > stats->max_tx_fill) {
+	    stats->max_tx_fill = fill;
+	}
+    }
+}
+
+static void simulate(uint8_t use_table, stats_t *stats)
+{
+    double now = 0, tx_free = 0;
+    size_t i, j;
+
+    memset(stats, 0, sizeof(stats_t));
+    framer_init();
+    framer_use_crc_table = use_table;
+    expected_head = expected_tail = 0;
+    out_pos = 0;
+
+    /* the framer only starts accepting data after the first break */
+    rx_byte(0, 1, stats);
+
+    for (i = 0; i < frame_count; i++) {
+	const frame_t *frame = &frames[i];
+	unsigned long ok_before = stats->ok;
+
+	now += frame->gap_us;
+	for (j = 0; j <= frame->length; j++) {
+	    now += BYTE_TIME_US;
+
+	    /* main loop: hand one byte to the UART whenever it is free */
+	    while (framer_tx_pending() && tx_free <= now) {
+		host_receive(framer_tx_peek(), stats);
+		framer_tx_advance();
+		tx_free += BYTE_TIME_US;
+	    }
+	    if (!framer_tx_pending() && tx_free < now) {
+		tx_free = now;
+	    }
+
+	    if (j < frame->length) {
+		rx_byte(frame->data[j], 0, stats);
+	    } else {
+		/* break at end of frame */
+		rx_byte(0, 1, stats);
+	    }
+	}
+
+	if (!frame->poll) {
+	    stats->frames++;
+	    if (stats->ok != ok_before) {
+		expected[expected_tail++] = frame;
+	    }
+	}
+    }
+
+    while (framer_tx_pending()) {
+	host_receive(framer_tx_peek(), stats);
+	framer_tx_advance();
+    }
+    if (expected_head != expected_tail) {
+	stats->corrupted += expected_tail - expected_head;
+    }
+}
+
+static void report(const char *name, const stats_t *stats)
+{
+    unsigned long dropped = stats->rx_overflows + stats->tx_full;
+
+    printf("%s CRC:\n", name);
+    printf("  frames %lu, forwarded %lu, CRC errors %lu\n",
+	   stats->frames, stats->ok, stats->crc_errors);
+    printf("  dropped %lu (%.2f%%): RX buffer overflow %lu, TX ring full %lu\n",
+	   dropped, stats->frames ? 100.0 * dropped / stats->frames : 0.0,
+	   stats->rx_overflows, stats->tx_full);
+    printf("  max TX ring fill %u of %u bytes\n", stats->max_tx_fill, TRANSMIT_BUF_SIZE);
+    printf("  ISR cycles: %.1f per byte, max %u per interrupt (%.1f%% of a byte time)\n",
+	   stats->bytes ? (double) stats->cycles / stats->bytes : 0.0, stats->max_isr_cycles,
+	   100.0 * stats->max_isr_cycles / (BYTE_TIME_US * CPU_MHZ));
+    if (stats->corrupted) {
+	printf("  ERROR: %lu packets on the host side did not match their frame\n",
+	       stats->corrupted);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+	    "Usage: %s [-g <gap ms>] (<timeline> | -c <corpus> | -s <count>:<length>)\n"
+	    "  -c <file>   replay a collector-bench corpus file\n"
+	    "  -s <n>:<l>  replay n random frames of l bytes (without CRC)\n"
+	    "  -g <ms>     bus idle time before each frame for -c and -s (default 5)\n"
+	    "  -r <n>      replay the frames n times (default 1)\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *corpus = NULL, *synthetic = NULL;
+    double gap_ms = 5;
+    unsigned int repeat = 1, i;
+    stats_t bitwise, table;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:s:g:r:h")) != -1) {
+	switch (opt) {
+	    case 'c': corpus = optarg; break;
+	    case 's': synthetic = optarg; break;
+	    case 'g': gap_ms = atof(optarg); break;
+	    case 'r': repeat = atoi(optarg); break;
+	    default: usage(argv[0]);
+	}
+    }
+
+    if (corpus) {
+	read_frames(corpus, 1, gap_ms);
+    } else if (synthetic) {
+	unsigned int count, length;
+	if (sscanf(synthetic, "%u:%u", &count, &length) != 2 ||
+		length < 1 || length >= MAX_FRAME_SIZE - 1) {
+	    usage(argv[0]);
+	}
+	generate_frames(count, length, gap_ms);
+    } else if (optind < argc) {
+	read_frames(argv[optind], 0, 0);
+    } else {
+	usage(argv[0]);
+    }
+
+    size_t count = frame_count;
+    for (i = 1; i < repeat; i++) {
+	size_t j;
+	for (j = 0; j < count; j++) {
+	    frame_t *frame = add_frame();
+	    *frame = frames[j];
+	}
+    }
+    finish_frames();
+
+    /* both CRC variants must agree before comparing their cost */
+    for (i = 0; i < frame_count; i++) {
+	if (calc_checksum(frames[i].data, frames[i].length) !=
+		calc_checksum_table(frames[i].data, frames[i].length)) {
+	    fprintf(stderr, "CRC table mismatch for frame %u\n", i);
+	    return 1;
+	}
+    }
+
+    simulate(0, &bitwise);
+    simulate(1, &table);
+
+    printf("buffers: RX %u bytes, TX ring %u bytes\n", RECV_BUF_SIZE, TRANSMIT_BUF_SIZE);
+    report("bitwise", &bitwise);
+    report("table", &table);
+    if (bitwise.ok) {
+	printf("table CRC saves %.1f cycles per forwarded frame, %d cycles of the "
+	       "longest interrupt, for 256 bytes of flash\n",
+	       (double) (bitwise.cycles - table.cycles) / bitwise.ok,
+	       (int) bitwise.max_isr_cycles - (int) table.max_isr_cycles);
+    }
+
+    return bitwise.corrupted || table.corrupted ? 1 : 0;
+}
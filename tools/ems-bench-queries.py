@@ -0,0 +1,113 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+#
+# Times the queries of the web page and the graph generator against numeric
+# data tables of different layouts, e.g. before and after running
+# 'collectord --migrate-schema', which keeps the old table as
+# numeric_data_myisam:
+#
+#   ems-bench-queries.py numeric_data_myisam numeric_data
+#
+# The time of each query is the median of several runs as measured by the
+# server, so it doesn't include starting the mysql client.
+
+import optparse
+import subprocess
+import sys
+
+mysql_user = "emsdata"
+mysql_password = "emsdata"
+mysql_db_name = "ems_data"
+
+queries = [
+    ("current values", """
+        select s.type, v.value from sensors s
+        inner join (select sensor, max(endtime) maxtime from TABLE group by sensor) maxtimes
+        on s.type = maxtimes.sensor
+        inner join TABLE v on maxtimes.sensor = v.sensor and maxtimes.maxtime = v.endtime"""),
+    ("minimum of INTERVAL", """
+        select sensor, if(endtime > @endtime, @endtime, endtime) time, value from TABLE
+        where sensor = SENSOR and starttime < @endtime and endtime >= @starttime
+        order by value asc limit 1"""),
+    ("maximum of INTERVAL", """
+        select sensor, if(endtime > @endtime, @endtime, endtime) time, value from TABLE
+        where sensor = SENSOR and starttime < @endtime and endtime >= @starttime
+        order by value desc limit 1"""),
+    ("average of INTERVAL", """
+        select sum(time * value) / sum(time) value from (
+            select value, timediff(endtime, starttime) time from (
+                select value,
+                       if(starttime < @starttime, @starttime, starttime) starttime,
+                       if(endtime > @endtime, @endtime, endtime) endtime from TABLE
+                where sensor = SENSOR and starttime < @endtime and endtime >= @starttime) t1) t2"""),
+    ("changes of yesterday", """
+        select upper.sensor, upper.value - lower.value from
+        (select v.sensor, v.value from TABLE v
+         inner join (select sensor, max(endtime) maxtime from TABLE
+                     where endtime < curdate() group by sensor) uppertimes
+         on v.sensor = uppertimes.sensor and v.endtime = uppertimes.maxtime) upper
+        inner join
+        (select v.sensor, v.value from TABLE v
+         inner join (select sensor, max(endtime) maxtime from TABLE
+                     where endtime < subdate(curdate(), interval 1 day) group by sensor) lowertimes
+         on v.sensor = lowertimes.sensor and v.endtime = lowertimes.maxtime) lower
+        on upper.sensor = lower.sensor"""),
+    ("graph of INTERVAL", """
+        select time, value from (
+            select adddate(if(starttime < @starttime, @starttime, starttime), interval 1 second) time,
+                   value from TABLE
+            where sensor = SENSOR and endtime >= @starttime
+            union all
+            select if(endtime > @endtime, @endtime, endtime) time, value from TABLE
+            where sensor = SENSOR and endtime >= @starttime)
+        t1 order by time"""),
+]
+
+def run_mysql(script):
+    # --force, as servers without query cache reject disabling it
+    process = subprocess.Popen(["mysql", "-A", "-N", "-B", "--force",
+                                "-u%s" % mysql_user, "-p%s" % mysql_password, mysql_db_name],
+                               shell = False, stdin = subprocess.PIPE,
+                               stdout = subprocess.PIPE, stderr = subprocess.PIPE)
+    output = process.communicate(script)[0]
+    return output.strip().split("\n")
+
+def time_query(query, interval, runs):
+    script = """
+        set session query_cache_type = off;
+        set @starttime = subdate(now(), interval %s);
+        set @endtime = now();
+        set @t0 = now(6);
+        %s;
+        select timestampdiff(microsecond, @t0, now(6));
+        """ % (interval, query)
+    times = []
+    for i in range(runs):
+        times.append(int(run_mysql(script)[-1]) / 1000.0)
+    times.sort()
+    return times[len(times) / 2]
+
+parser = optparse.OptionParser(usage = "%prog [options] <table> [<table>...]")
+parser.add_option("-s", "--sensor", type = "int", default = 0,
+                  help = "numeric sensor to query (default: the first one found)")
+parser.add_option("-i", "--interval", default = "1 week",
+                  help = "time span of the per sensor queries (default: 1 week)")
+parser.add_option("-r", "--runs", type = "int", default = 5,
+                  help = "number of runs per query (default: 5)")
+(options, tables) = parser.parse_args()
+
+if not tables:
+    parser.print_help()
+    sys.exit(1)
+
+sensor = options.sensor
+if sensor == 0:
+    sensor = int(run_mysql("select sensor from %s limit 1;" % tables[0])[-1])
+
+print "%-32s" % ("sensor %d" % sensor) + "".join(["%24s" % table for table in tables])
+for (name, query) in queries:
+    line = "%-32s" % name.replace("INTERVAL", options.interval)
+    for table in tables:
+        statement = query.replace("TABLE", table).replace("SENSOR", str(sensor))
+        line += "%21.1fms" % time_query(statement, options.interval, options.runs)
+    print line
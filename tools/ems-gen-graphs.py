@@ -54,14 +54,15 @@ def do_graphdata(sensor, filename):
     process.communicate("""
         set @starttime = subdate(now(), interval %s);
         set @endtime = now();
-        select time, value from (
+        set @scale = coalesce((select scale from sensors where type = %d), 1);
+        select time, value / @scale from (
             select adddate(if(starttime < @starttime, @starttime, starttime), interval 1 second) time, value from numeric_data
             where sensor = %d and endtime >= @starttime
             union all
             select if(endtime > @endtime, @endtime, endtime) time, value from numeric_data
             where sensor = %d and endtime >= @starttime)
         t1 order by time;
-        """ % (timespan_clause, sensor, sensor))
+        """ % (timespan_clause, sensor, sensor, sensor))
     datafile.close()
 
 def do_plot(name, filename, ylabel, definitions):
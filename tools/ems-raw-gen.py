@@ -0,0 +1,111 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+#
+# Feeds EMS frames to the collector's rawserial target as a bus attached
+# UART would receive them.
+#
+# Without a device argument, a pseudo terminal is created and its slave
+# path printed; run 'collectord rawserial:<path>' on it. As there are no
+# breaks on pseudo terminals, the break after each frame and doubled 0xff
+# bytes are written the way the tty reports them with PARMRK. With a
+# device argument, frames are written to that serial port with a real
+# break after each one, for looping back into a bus adapter.
+#
+# Frames are read from a file in the collector-bench corpus format
+# (<name> <source> <dest> <type> <offset> [data...] in hex).
+
+import optparse
+import os
+import sys
+import termios
+import time
+
+def calc_checksum(data):
+    crc = 0
+    for byte in data:
+        d = 0
+        if crc & 0x80:
+            crc ^= 0xc
+            d = 1
+        crc = ((crc << 1) & 0xfe) | d
+        crc ^= byte
+    return crc
+
+def read_frames(path):
+    frames = []
+    for line in open(path):
+        fields = line.split()
+        if not fields or fields[0].startswith("#"):
+            continue
+        frames.append(bytearray(int(f, 16) for f in fields[1:]))
+    return frames
+
+def marked(frame, corrupt):
+    data = bytearray(frame)
+    data.append(calc_checksum(frame) ^ (0x01 if corrupt else 0))
+    out = bytearray()
+    for byte in data:
+        out.append(byte)
+        if byte == 0xff:
+            out.append(0xff)
+    # break: zero byte with framing error
+    out.extend((0xff, 0x00, 0x00))
+    return out
+
+def main():
+    parser = optparse.OptionParser(usage = "%prog [options] <corpus file> [device]")
+    parser.add_option("-r", "--repeat", type = "int", default = 1,
+                      help = "send the frames this many times (0 = forever)")
+    parser.add_option("-g", "--gap", type = "float", default = 20,
+                      help = "pause between frames in ms")
+    parser.add_option("-c", "--corrupt-every", type = "int", default = 0,
+                      help = "send a wrong CRC for every n-th frame")
+    (options, args) = parser.parse_args()
+    if len(args) < 1:
+        parser.error("no corpus file given")
+
+    frames = read_frames(args[0])
+    if len(args) > 1:
+        fd = os.open(args[1], os.O_RDWR | os.O_NOCTTY)
+        attrs = termios.tcgetattr(fd)
+        attrs[4] = attrs[5] = termios.B9600
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+        real_port = True
+    else:
+        fd, slave = os.openpty()
+        attrs = termios.tcgetattr(slave)
+        attrs[3] &= ~(termios.ICANON | termios.ECHO | termios.ISIG | termios.IEXTEN)
+        attrs[0] &= ~(termios.ICRNL | termios.IXON)
+        termios.tcsetattr(slave, termios.TCSANOW, attrs)
+        print(os.ttyname(slave))
+        sys.stdout.flush()
+        real_port = False
+
+    # leading break, so the first frame is not taken for a partial one
+    if real_port:
+        termios.tcsendbreak(fd, 0)
+    else:
+        os.write(fd, bytes(bytearray((0xff, 0x00, 0x00))))
+
+    count = 0
+    iteration = 0
+    while options.repeat == 0 or iteration < options.repeat:
+        for frame in frames:
+            count += 1
+            corrupt = options.corrupt_every > 0 and count % options.corrupt_every == 0
+            if real_port:
+                data = bytearray(frame)
+                data.append(calc_checksum(frame) ^ (0x01 if corrupt else 0))
+                os.write(fd, bytes(data))
+                termios.tcdrain(fd)
+                termios.tcsendbreak(fd, 0)
+            else:
+                os.write(fd, bytes(marked(frame, corrupt)))
+            time.sleep(options.gap / 1000.0)
+        iteration += 1
+
+    # keep the pty open until the reader had time to drain it
+    time.sleep(1)
+
+if __name__ == "__main__":
+    main()